@@ -0,0 +1,128 @@
+/*
+ * arena.c - Per-file memory arena
+ * 
+ * This file implements a simple bump allocator used for the state of the
+ * file being assembled (symbols, names, macro bodies, relocation names).
+ * It handles:
+ * - Aligned allocation from a chain of blocks
+ * - String copies
+ * - Releasing everything in one step between files
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "helpers.h"
+
+/* Alignment suitable for any object stored in the arena */
+typedef union ArenaAlign {
+    long l;
+    double d;
+    void *p;
+}ArenaAlign;
+
+#define ARENA_ALIGN sizeof(ArenaAlign)
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+#define BLOCK_HEADER ALIGN_UP(sizeof(ArenaBlock))
+
+/*
+ * Allocates a block with at least size usable bytes and links it in
+ * front of the chain.
+ */
+static ArenaBlock* new_block(Arena *arena, size_t size, const char *error_msg) {
+    ArenaBlock *block;
+
+    if (size < ARENA_BLOCK_SIZE) {
+        size = ARENA_BLOCK_SIZE;
+    }
+    block = (ArenaBlock*)safe_malloc(BLOCK_HEADER + size, error_msg);
+    block->size = size;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    return block;
+}
+
+/*
+ * init_arena - Prepares an empty arena with no blocks allocated
+ */
+void init_arena(Arena *arena) {
+    arena->blocks = NULL;
+}
+
+/*
+ * Returns size bytes of aligned memory owned by the arena.
+ * Exits with error_msg if no memory is available.
+ */
+void* arena_alloc(Arena *arena, size_t size, const char *error_msg) {
+    ArenaBlock *block = arena->blocks;
+    void *ptr;
+
+    size = ALIGN_UP(size ? size : 1);
+    if (block == NULL || block->size - block->used < size) {
+        block = new_block(arena, size, error_msg);
+    }
+    ptr = (char*)block + BLOCK_HEADER + block->used;
+    block->used += size;
+    return ptr;
+}
+
+/*
+ * arena_strdup - Copies a null-terminated string into the arena
+ */
+char* arena_strdup(Arena *arena, const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = (char*)arena_alloc(arena, len, "Memory allocation failed in arena_strdup");
+    memcpy(copy, str, len);
+    return copy;
+}
+
+/*
+ * arena_size - Returns the bytes allocated for the blocks of the arena
+ */
+size_t arena_size(const Arena *arena) {
+    const ArenaBlock *block;
+    size_t size = 0;
+
+    for (block = arena->blocks; block != NULL; block = block->next) {
+        size += BLOCK_HEADER + block->size;
+    }
+    return size;
+}
+
+/*
+ * Releases every allocation. The first block is kept and rewound so the
+ * next file starts without touching malloc; larger or extra blocks are
+ * returned, keeping memory bounded across a long run.
+ */
+void reset_arena(Arena *arena) {
+    ArenaBlock *keep = NULL;
+
+    while (arena->blocks != NULL) {
+        ArenaBlock *tmp = arena->blocks;
+        arena->blocks = tmp->next;
+        if (arena->blocks == NULL && tmp->size == ARENA_BLOCK_SIZE) {
+            keep = tmp; /* Oldest default-sized block */
+        } else {
+            free(tmp);
+        }
+    }
+    if (keep != NULL) {
+        keep->used = 0;
+        keep->next = NULL;
+        arena->blocks = keep;
+    }
+}
+
+/*
+ * destroy_arena - Frees every block, including the one kept by reset_arena
+ */
+void destroy_arena(Arena *arena) {
+    while (arena->blocks != NULL) {
+        ArenaBlock *tmp = arena->blocks;
+        arena->blocks = tmp->next;
+        free(tmp);
+    }
+}
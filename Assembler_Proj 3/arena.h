@@ -0,0 +1,43 @@
+/*
+ * arena.h - Per-file memory arena header
+ * 
+ * This header file defines the Arena structure and the functions used to
+ * allocate the short-lived state of one assembled file. Everything taken
+ * from an arena is released together when the file is finished.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE 65536  /* Default size of an arena block */
+
+/*
+ * ArenaBlock - One contiguous block of arena memory
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;    /* Previously filled block */
+    size_t size;                /* Usable bytes in this block */
+    size_t used;                /* Bytes already handed out */
+}ArenaBlock;
+
+/*
+ * Arena - Bump allocator made of a chain of blocks
+ * 
+ * Allocations are carved from the newest block; a request that does not
+ * fit starts a new block. Individual allocations are never freed.
+ */
+typedef struct Arena {
+    ArenaBlock *blocks;         /* Newest block first */
+}Arena;
+
+/* Arena management functions */
+void init_arena(Arena *arena);                                       /* Prepares an empty arena */
+void* arena_alloc(Arena *arena, size_t size, const char *error_msg); /* Allocates size bytes */
+char* arena_strdup(Arena *arena, const char *str);                   /* Copies a string into the arena */
+size_t arena_size(const Arena *arena);                               /* Bytes allocated for the blocks */
+void reset_arena(Arena *arena);                                      /* Releases all allocations */
+void destroy_arena(Arena *arena);                                    /* Frees every block */
+
+#endif /* ARENA_H */
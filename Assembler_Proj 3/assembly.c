@@ -0,0 +1,733 @@
+/*
+ * assembly.c - Assembly passes
+ * 
+ * This file contains the core assembly logic for a two-pass assembler.
+ * It handles the first and second passes of assembly over a per-file
+ * Assembly context, managing symbol tables, orders, and data words, and
+ * drives one file from preprocessing to the output files. All messages
+ * are collected in the context's buffer, errors and warnings with their
+ * file and line, and written to stderr once the file is done.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assembly.h"
+#include "helpers.h"
+#include "input.h"
+#include "order.h"
+#include "decode.h"
+#include "symbolTable.h"
+#include "macros.h"
+#include "output.h"
+#include "arena.h"
+#include "diag.h"
+#include "tokenizer.h"
+#include "cache.h"
+#include "stats.h"
+#include "sim.h"
+#include "profile.h"
+
+/*
+ * Reads a positive count such as the value of --max-errors. Returns it,
+ * or 0 if the value is not a positive number.
+ */
+int parse_count(const char *value) {
+    char *end = NULL;
+    long count = strtol(value, &end, 10);
+
+    if (end == value || *end != '\0' || count < 1 || count > 1000000L) {
+        return 0;
+    }
+    return (int)count;
+}
+
+/*
+ * Reads the value of --format: "text", "bin" or "both". Returns the
+ * FORMAT_ flags, or 0 if the value is not one of these.
+ */
+int parse_formats(const char *value) {
+    if (strcmp(value, "text") == 0) {
+        return FORMAT_TEXT;
+    }
+    if (strcmp(value, "bin") == 0) {
+        return FORMAT_BIN;
+    }
+    if (strcmp(value, "both") == 0) {
+        return FORMAT_TEXT | FORMAT_BIN;
+    }
+    return 0;
+}
+
+/*
+ * init_assembly - Prepares a context with empty tables and counters
+ */
+void init_assembly(Assembly *as) {
+    init_arena(&as->arena);
+    as->symbol_head = NULL;
+    as->symbol_tail = NULL;
+    init_symbol_index(&as->symbol_index, &as->arena);
+    init_image(&as->code_image);
+    init_image(&as->data_image);
+    init_relocations(&as->relocations, &as->arena);
+    init_shapes(&as->matrices);
+    init_lines(&as->code_lines);
+    init_origins(&as->origins);
+    as->entry_head = NULL;
+    as->entry_tail = NULL;
+    init_source(&as->expanded_source);
+    init_output_buffer(&as->output);
+    init_ob_stream(&as->ob_stream);
+    as->memory_limit = 0;
+    as->source_size = 0;
+    init_diagnostics(&as->messages);
+    init_source(&as->cache_record);
+    as->outputs = 0;
+    as->entries_flag = 0;
+    as->IC = IC_START;
+    as->DC = 0;
+}
+
+/*
+ * This function cleans up all dynamically allocated memory of the last
+ * file including symbol tables, the code and data images, and the
+ * relocation table. Symbols, names and macro bodies live in the arena
+ * and are all released by a single reset. It resets the context to its
+ * initial state, keeping one arena block for the next file.
+ */
+void reset_assembly(Assembly *as) {
+    /* Forget symbol tables; their nodes belong to the arena */
+    as->symbol_head = NULL;
+    as->symbol_tail = NULL;
+    as->entry_head = NULL;
+    as->entry_tail = NULL;
+    destroy_symbol_index(&as->symbol_index); /* Releases the hash slots */
+
+    /* Free memory images and fixups */
+    destroy_image(&as->code_image);
+    destroy_image(&as->data_image);
+    destroy_relocations(&as->relocations);
+    destroy_shapes(&as->matrices);
+    destroy_lines(&as->code_lines);
+    destroy_origins(&as->origins);
+    destroy_source(&as->expanded_source);
+    close_ob_stream(&as->ob_stream);
+    reset_arena(&as->arena);
+    as->entries_flag = 0;
+    as->memory_limit = 0;
+    as->source_size = 0;
+
+    /* Reset counters */
+    as->IC = IC_START;
+    as->DC = 0;
+}
+
+/*
+ * destroy_assembly - Resets the context and frees its arena blocks
+ * and output buffer
+ */
+void destroy_assembly(Assembly *as) {
+    reset_assembly(as);
+    destroy_output_buffer(&as->output);
+    destroy_diagnostics(&as->messages);
+    destroy_source(&as->cache_record);
+    destroy_arena(&as->arena);
+}
+
+/*
+ * Returns the bytes held by the file being assembled, the memory that
+ * --max-memory limits: its .as text, the expanded source, and the tables
+ * and buffers of the passes.
+ */
+static size_t assembly_memory(const Assembly *as) {
+    return as->source_size
+         + arena_size(&as->arena)
+         + sizeof(Symbol*) * as->symbol_index.capacity
+         + sizeof(unsigned short) * (as->code_image.capacity + as->data_image.capacity)
+         + sizeof(Relocation) * as->relocations.capacity
+         + sizeof(RelocSymbol) * as->relocations.symbol_capacity
+         + sizeof(int) * as->relocations.slot_capacity
+         + sizeof(MatrixShape) * as->matrices.capacity
+         + sizeof(int) * as->code_lines.capacity
+         + sizeof(LineOrigin) * as->origins.capacity
+         + as->expanded_source.capacity
+         + as->messages.capacity;
+}
+
+/*
+ * Reports and returns 1 if the file holds more memory than its limit.
+ */
+static int memory_exceeded(const Assembly *as) {
+    if (as->memory_limit == 0 || assembly_memory(as) <= as->memory_limit) {
+        return 0;
+    }
+    report_error(0, "The file needs more than the %lu KB allowed by --max-memory\n",
+                 (unsigned long)(as->memory_limit / 1024));
+    return 1;
+}
+
+/*
+ * This function reads the expanded source of as line by line, splits
+ * each line into tokens once, and:
+ * - Processes symbol definitions and adds them to symbol table
+ * - Handles directives (.data, .string, .mat, .entry, .extern)
+ * - Records .entry names for second_scan to resolve
+ * - Processes instructions and calculates their sizes
+ * - Records symbol operands in the relocation table
+ * - Updates instruction and data counters
+ * With --max-memory, the code words are written to the streamed .ob file
+ * every OB_STREAM_WORDS words, and the memory held is checked every
+ * MEMORY_CHECK_LINES lines.
+ */
+int first_scan(Assembly* as) {
+    int directive;              /* Flag for directive processing */
+    int symbol = 0;             /* Flag for symbol definition */
+    int index = 0;              /* Current position in line */
+    int index2 = 0;             /* Temporary position marker */
+    int L = 0;                  /* Instruction length in words */
+    int num_of_line = 0;        /* Current line number */
+    int error_flag = 0;         /* Error flag */
+    int result = 0;             /* Result from decode_data function */
+    Order order;                /* Instruction being assembled */
+    LineTokens tokens;          /* Label, keyword and operands of the line */
+    const Instruction *instruction; /* Description of the mnemonic */
+    const Operand *source;      /* Source operand of a two-operand instruction */
+    const Operand *target;      /* Destination operand, NULL if none */
+    char symbol1[MAX_LINE_LENGTH]; /* Symbol name */
+    char* line = NULL;          /* Current line, inside the expanded source */
+    LineView view;              /* Span of the current line */
+    size_t position = 0;        /* Offset of the next line */
+
+    while (next_line(as->expanded_source.text, as->expanded_source.length, &position, &view) && !error_limit_reached()) {
+        num_of_line++;
+        if (num_of_line % MEMORY_CHECK_LINES == 0 && memory_exceeded(as)) {
+            error_flag = 1;
+            break;
+        }
+        if (is_line_too_long(&view)) {
+            report_error(num_of_line, "Line too long (max 80 characters allowed)\n");
+            error_flag = 1;
+            continue;
+        }
+        /* The source buffer belongs to this context and is only read */
+        line = (char*)view.text;
+
+        /* Find the label and the mnemonic or directive */
+        scan_line_head(line, &tokens);
+        if (tokens.label_length == 0 && tokens.keyword_length == 0) {
+            continue; /* empty sentence or comment */
+        }
+        if (tokens.label_length > 0) { /* Check if we found a symbol definition */
+            strncpy(symbol1, line+tokens.label_start, tokens.label_length);
+            symbol1[tokens.label_length] = '\0';
+            symbol = 1;
+        }
+        index = tokens.keyword_start;
+        directive = tokens.directive;
+
+        if (directive > 0 && directive < 4) { /* it is data or string or mat sentence */
+            if(symbol) {
+                if (search_symbol(&as->symbol_index, symbol1) != NULL) {
+                    report_error(num_of_line, "Symbol already exists\n");
+                    error_flag = 1;
+                    symbol = 0;
+                    continue;
+                }
+                add_symbol(&as->symbol_head, &as->symbol_tail, &as->symbol_index, symbol1);
+                set_type(as->symbol_tail, 1); /* .data */
+                set_value(as->symbol_tail, as->DC);
+                symbol = 0;
+            }
+
+            result = decode_data(&as->data_image, line, index, directive, as->DC, num_of_line);
+            if (result == -1) {
+                error_flag = 1;
+                continue; /* Skip this line entirely if directive failed */
+            }
+            if (directive == 3) { /* Remember the shape for running the image */
+                add_shape(&as->matrices, as->DC, matrix_columns(line + index));
+            }
+            as->DC = result;
+            continue;
+        }
+        
+        if (directive == 5) { /* entry directive */
+            if (symbol) {
+                report_warning(num_of_line, "Symbol before entry\n");
+                symbol = 0;
+            }
+            index = skip_spaces(line, index+6); /* now index points to the symbol after the entry directive */
+            index2 = is_symbol(line, index);
+            if (index2 <= 0) { /* Check if we found a symbol */
+                report_error(num_of_line, "Expecting symbol after entry directive\n");
+                error_flag = 1;
+                continue; /* Skip this line entirely if directive failed */
+            }
+            strncpy(symbol1, line+index, index2-index);
+            symbol1[index2-index] = '\0';
+            append_symbol(&as->entry_head, &as->entry_tail, &as->arena, symbol1);
+            set_value(as->entry_tail, num_of_line); /* Kept for error reporting */
+            continue; /* Only continue if directive was processed successfully */
+        }
+        
+        if (directive == 4) { /* extern directive */
+            if (symbol) {
+                report_warning(num_of_line, "Symbol before extern\n");
+                symbol = 0;
+            }
+            index = skip_spaces(line, index+7); /* now index points to the symbol after the extern directive */
+            index2 = is_symbol(line, index);
+            if (index2 <= 0) { /* Check if we found a symbol */
+                report_error(num_of_line, "Expecting symbol after extern directive\n");
+                error_flag = 1;
+                continue; /* Skip this line entirely if directive failed */
+            }
+            strncpy(symbol1, line+index, index2-index);
+            symbol1[index2-index] = '\0';
+            add_symbol(&as->symbol_head, &as->symbol_tail, &as->symbol_index, symbol1);
+            set_type(as->symbol_tail, 4); /* .extern */
+            continue; /* Only continue if directive was processed successfully */
+        }
+        
+        if (symbol) { /* an order sentence */
+            if (search_symbol(&as->symbol_index, symbol1) != NULL) {
+                report_error(num_of_line, "Symbol already exists\n");
+                error_flag = 1;
+                symbol = 0;
+                continue;
+            }
+            as->symbol_tail = add_symbol(&as->symbol_head, &as->symbol_tail, &as->symbol_index, symbol1);
+            set_type(as->symbol_tail, 2);
+            set_value(as->symbol_tail, as->IC);
+            symbol = 0;
+        }
+
+        instruction = tokens.instruction;
+        if (instruction == NULL) {
+            report_error(num_of_line, "Invalid opcode '%.*s'\n", tokens.keyword_length, line + index);
+            error_flag = 1;
+            continue;
+        }
+        init_order(&order, instruction->opcode, as->IC);
+
+        /* Drop words left behind by a previous instruction that failed */
+        as->code_image.count = as->IC - IC_START - as->code_image.base;
+        truncate_relocations(&as->relocations, as->IC - IC_START);
+
+        if (scan_operands(line, &tokens, num_of_line) == -1) {
+            error_flag = 1;
+            continue;
+        }
+
+        /* The source is the first of two operands; a lone operand is the destination */
+        source = (instruction->operands == 2) ? &tokens.operands[0] : NULL;
+        target = (instruction->operands == 2) ? &tokens.operands[1] :
+                 (instruction->operands == 1) ? &tokens.operands[0] : NULL;
+        order.operand1 = source ? source->mode : -1;
+        order.operand2 = target ? target->mode : -1;
+        order.number_of_operands = instruction->operands;
+
+        /* Validate the addressing modes before anything is encoded */
+        if (validate_operands(&order, num_of_line)) {
+            error_flag = 1;
+            continue;
+        }
+
+        L = number_of_lines(order.operand1, order.operand2);
+        order.number_of_words = L;
+        decode_order_first_word(&order, &as->code_image);
+
+        if (source && source->mode == ADDR_REGISTER && target->mode == ADDR_REGISTER) {
+            add_image_word(&as->code_image, decode_registers(source->value, target->value)); /* registers share one word */
+        }
+        else {
+            if (source) {
+                decode_operand(&as->code_image, &as->relocations, line, source, 1, num_of_line);
+            }
+            if (target) {
+                decode_operand(&as->code_image, &as->relocations, line, target, 0, num_of_line);
+            }
+        }
+
+        if (as->memory_limit == 0) {
+            add_lines(&as->code_lines, num_of_line, L); /* only --profile reads them */
+        }
+        as->IC += L;
+        if (as->ob_stream.file != NULL && as->code_image.count >= OB_STREAM_WORDS) {
+            stream_code_words(&as->ob_stream, &as->code_image);
+        }
+    }
+    
+    update_data_symbols_value(as->symbol_head, as->IC);
+    STAT_ADD(lines, num_of_line);
+    STAT_ADD(symbols, as->symbol_index.count);
+    STAT_ADD(words, as->IC - IC_START + as->DC);
+    return error_flag;
+}
+
+
+/*
+ * This function performs the second pass over the state recorded by
+ * first_scan, without reading the source again:
+ * - Marks the recorded .entry symbols and validates they exist
+ * - Updates symbol operands with final addresses
+ * - Resolves external symbol references
+ * - Validates symbol existence and types
+ */
+int second_scan(Assembly* as) {
+    int error_flag = 0;         /* Error flag */
+    int update_result = 0;      /* Result from update_symbol_operands */
+    Symbol *entry;              /* Current pending entry */
+    Symbol *symbol;             /* Symbol named by the entry */
+
+    for (entry = as->entry_head; entry != NULL; entry = entry->next) {
+        as->entries_flag = 1;
+        symbol = search_symbol(&as->symbol_index, entry->name);
+        if (symbol == NULL) {
+            report_error(entry->value, "Symbol does not exist\n");
+            error_flag = 1;
+            continue;
+        }
+        set_type(symbol, 3); /* we need to check that type 3 is entry */
+    }
+    
+    update_result = update_symbol_operands(&as->code_image, &as->relocations, &as->symbol_index); /* external uses are marked in the relocation table */
+    if (update_result) {
+        error_flag = 1;
+    }
+    return error_flag; /* if error flag is on we should return 0 */
+}
+
+/*
+ * Writes one restored or built output file and records it in
+ * as->outputs if it was written. Returns 1 if the file could not be
+ * written.
+ */
+static int write_output(Assembly *as, char *filename, const char *suffix, const char *text, size_t length,
+                        int output) {
+    if (!write_output_file(filename, suffix, text, length)) {
+        return 1;
+    }
+    as->outputs |= output;
+    return 0;
+}
+
+/*
+ * This function runs the preprocessor and both passes over the contents
+ * of <filename>.as, leaving the expanded source, images and symbol tables
+ * in the context, and with write_am writes the expanded source to
+ * <filename>.am. Messages go to the routed buffer and name lines of the
+ * .as file: the passes read the expanded source, and their lines are
+ * translated back through the origins recorded by the preprocessor.
+ * Returns 0 on success and 1 if any phase reported an error. The caller
+ * resets the context once it is done with the results.
+ */
+int assemble_source(Assembly *as, const SourceFile *file, char *filename, int write_am) {
+    char *as_filename = create_filename(filename, ".as");
+    Diagnostics *messages = routed_diagnostics();
+    int error_flag;             /* Error flag */
+    STAT_TIMER(timer);
+
+    STAT_START(timer);
+    if (messages != NULL) {
+        messages->source = as_filename;
+    }
+    as->source_size = file->size;
+    error_flag = preprocessor(file,&as->arena,&as->expanded_source,&as->origins);
+    if (write_am) {
+        error_flag |= write_output(as, filename, ".am", as->expanded_source.text, as->expanded_source.length,
+                                   OUTPUT_AM);
+    }
+    STAT_LAP(preprocess_ms, timer);
+    if (messages != NULL) {
+        messages->origins = &as->origins;
+    }
+    error_flag = error_flag || memory_exceeded(as) || first_scan(as);
+    error_flag = error_flag || memory_exceeded(as);
+    STAT_LAP(first_pass_ms, timer);
+    error_flag = error_flag || second_scan(as);
+    STAT_LAP(second_pass_ms, timer);
+    if (messages != NULL) {
+        messages->source = NULL;
+        messages->origins = NULL;
+    }
+    free(as_filename);
+    return error_flag;
+}
+
+/*
+ * Restores the outputs of a file from its cache entry: replays the
+ * messages of the passes and writes the files the run made, recording
+ * them in as->outputs. Returns 1 if a file could not be written.
+ */
+static int restore_outputs(Assembly *as, char *filename, const CacheEntry *entry, const Options *options) {
+    int error_flag = 0;
+
+    report_text(entry->text[CACHE_MESSAGES], entry->length[CACHE_MESSAGES]);
+    if (options->write_am) {
+        error_flag |= write_output(as, filename, ".am", entry->text[CACHE_AM], entry->length[CACHE_AM], OUTPUT_AM);
+    }
+    if (entry->length[CACHE_EXT] > 0) {
+        error_flag |= write_output(as, filename, ".ext", entry->text[CACHE_EXT], entry->length[CACHE_EXT], OUTPUT_EXT);
+    }
+    if (entry->length[CACHE_ENT] > 0) {
+        error_flag |= write_output(as, filename, ".ent", entry->text[CACHE_ENT], entry->length[CACHE_ENT], OUTPUT_ENT);
+    }
+    if (entry->length[CACHE_OB] > 0) {
+        error_flag |= write_output(as, filename, ".ob", entry->text[CACHE_OB], entry->length[CACHE_OB], OUTPUT_OB);
+    }
+    if (entry->length[CACHE_BIN] > 0) {
+        error_flag |= write_output(as, filename, ".bin", entry->text[CACHE_BIN], entry->length[CACHE_BIN], OUTPUT_BIN);
+    }
+    return error_flag;
+}
+
+/*
+ * Checks that the entry holds exactly the object formats asked for, as
+ * an entry made with other --format settings can't be restored.
+ */
+static int has_formats(const CacheEntry *entry, const Options *options) {
+    return (entry->length[CACHE_OB] > 0) == ((options->formats & FORMAT_TEXT) != 0) &&
+           (entry->length[CACHE_BIN] > 0) == ((options->formats & FORMAT_BIN) != 0);
+}
+
+/*
+ * Builds the output files of a file that assembled cleanly. With a cache
+ * directory, the outputs are also recorded and stored in the cache along
+ * with the messages of the passes, which start at pass_messages. Returns
+ * 1 if a file could not be written, and nothing is cached then.
+ */
+static int write_outputs(Assembly *as, const SourceFile *file, const char *fullfilename, char *filename,
+                         size_t pass_messages, const Options *options) {
+    int caching = options->cache_dir != NULL;
+    int error_flag = 0;
+    size_t size;                /* Size of the last output file */
+
+    if (caching) {
+        as->cache_record.length = 0;
+        add_cache_section(&as->cache_record, as->messages.text + pass_messages,
+                          as->messages.length - pass_messages);
+        add_cache_section(&as->cache_record, as->expanded_source.text, as->expanded_source.length);
+    }
+    size = 0;
+    if (as->relocations.externals > 0) {
+        size = build_ext(&as->relocations,&as->output);
+        error_flag |= write_output(as, filename, ".ext", as->output.text, size, OUTPUT_EXT);
+    }
+    if (caching) {
+        add_cache_section(&as->cache_record, as->output.text, size);
+    }
+    size = 0;
+    if (as->entries_flag) {
+        size = build_ent(as->symbol_head,&as->output);
+        error_flag |= write_output(as, filename, ".ent", as->output.text, size, OUTPUT_ENT);
+    }
+    if (caching) {
+        add_cache_section(&as->cache_record, as->output.text, size);
+    }
+    size = 0;
+    if ((options->formats & FORMAT_TEXT) && as->ob_stream.file != NULL) {
+        if (finish_ob_stream(&as->ob_stream, &as->code_image, &as->data_image, &as->relocations,
+                             filename, as->IC-IC_START, as->DC)) {
+            as->outputs |= OUTPUT_OB;
+        }
+        else {
+            error_flag = 1;
+        }
+    }
+    else if (options->formats & FORMAT_TEXT) {
+        size = build_ob(&as->code_image,&as->data_image,as->IC-IC_START,as->DC,&as->output);
+        error_flag |= write_output(as, filename, ".ob", as->output.text, size, OUTPUT_OB);
+    }
+    if (caching) {
+        add_cache_section(&as->cache_record, as->output.text, size);
+    }
+    size = 0;
+    if (options->formats & FORMAT_BIN) {
+        size = build_bin(&as->code_image,&as->data_image,as->symbol_head,&as->relocations,&as->output);
+        error_flag |= write_output(as, filename, ".bin", as->output.text, size, OUTPUT_BIN);
+    }
+    if (caching && !error_flag) {
+        add_cache_section(&as->cache_record, as->output.text, size);
+        cache_store(options->cache_dir, fullfilename, file, &as->cache_record, as);
+    }
+    return error_flag;
+}
+
+/*
+ * Runs the program of a file that assembled cleanly on the simulator,
+ * with red reading stdin. The program's output goes to stdout and a
+ * summary with the instruction rate to the file's messages. The
+ * executions of each address are added to counts unless it is NULL.
+ * Returns 1 if the run faulted or hit the instruction limit.
+ */
+static int run_program(Assembly *as, const char *fullfilename, const Options *options, unsigned long *counts) {
+    Machine machine;            /* Simulated computer */
+    double start;               /* Clock at the start of the run */
+    double elapsed;             /* Wall time of the run in milliseconds */
+    int state;                  /* How the run ended */
+
+    init_machine(&machine);
+    machine.input = stdin;
+    machine.profile = counts;
+    start = stats_clock();
+    state = SIM_FAULT;
+    if (load_machine(&machine, &as->code_image, &as->data_image, &as->matrices)) {
+        state = run_machine(&machine, options->run_limit);
+    }
+    elapsed = stats_clock() - start;
+    if (elapsed <= 0) {
+        elapsed = 0.001;
+    }
+
+    fwrite(machine.output.text, 1, machine.output.length, stdout);
+    fflush(stdout);
+    if (state == SIM_HALTED) {
+        report("Run of %s: stop after %lu instructions, %.0f instructions/s\n",
+               fullfilename, machine.steps, machine.steps / elapsed * 1000.0);
+    }
+    else if (state == SIM_LIMIT) {
+        report("Run of %s: Error: no stop after %lu instructions\n", fullfilename, machine.steps);
+    }
+    else {
+        report("Run of %s: Error at address %d: %s\n", fullfilename, machine.fault_address, machine.fault);
+    }
+    destroy_machine(&machine);
+    return state != SIM_HALTED;
+}
+
+/*
+ * Runs and/or profiles the program of a file that assembled cleanly:
+ * with --run it runs on the simulator, and with --profile the counts of
+ * the run and of the --profile file go into <filename>.prof. Returns 1
+ * if the run failed, or the profile file could not be read or written.
+ */
+static int run_and_profile(Assembly *as, const char *fullfilename, char *filename, const Options *options) {
+    unsigned long *counts = NULL; /* Executions of each address, for the report */
+    int size = 0;               /* Addresses in counts */
+    int error_flag = 0;
+
+    if (options->profile) {
+        counts = new_profile(as, &size);
+    }
+    if (options->run) {
+        error_flag = run_program(as, fullfilename, options, counts);
+    }
+    if (options->profile && options->profile_file != NULL && !read_profile(options->profile_file, counts, size)) {
+        error_flag = 1;
+    }
+    if (options->profile && !error_flag) {
+        error_flag = write_profile(as, counts, filename);
+    }
+    free(counts);
+    return error_flag;
+}
+
+/*
+ * This function assembles one file:
+ * 1. Preprocessor phase (macro expansion into memory, optional .am file)
+ * 2. First pass (the only read of the source: symbols, sizes, words, fixups)
+ * 3. Second pass (entry and address resolution over the recorded fixups)
+ * 4. Output generation (.ob and/or .bin, .ent, .ext files)
+ * 5. With --run, running the program on the simulator, and with
+ *    --profile, writing the .prof hot spot report
+ * With a cache directory, a file whose contents were assembled before is
+ * restored from the cache instead, and a successful run is stored there;
+ * --run and --profile always assemble, as they need the images.
+ * With --max-memory, the file is stopped once it holds more memory than
+ * allowed, and its .ob file is streamed while the first pass runs.
+ * With --stats, the timings and counts of the file are printed to stderr
+ * as one JSON line.
+ * Returns 0 on success and 1 if the file could not be assembled. The
+ * context is reset before returning either way.
+ */
+int assemble_file(Assembly *as, char *filename, const Options *options) {
+    SourceFile file;            /* Contents of the .as file */
+    CacheEntry entry;           /* Cached outputs of the same contents */
+    Diagnostics *outer = NULL;  /* Where messages went before this file */
+    Stats stats;                /* Timings and counts of this file */
+    char *fullfilename = NULL;  /* Full filename with path */
+    int caching = options->cache_dir != NULL;
+    int cached = 0;             /* Set when the outputs came from the cache */
+    int error_flag = 0;         /* Error flag */
+    size_t pass_messages;       /* Where the messages of the passes start */
+    STAT_TIMER(timer);
+
+    if (options->stats) {
+        init_stats(&stats);
+        route_stats(&stats);
+    }
+
+    /* Collect this file's messages, written out at once at the end */
+    outer = routed_diagnostics();
+    route_diagnostics(&as->messages);
+    as->messages.length = 0;
+    as->messages.errors = 0;
+    as->messages.max_errors = options->max_errors;
+    as->messages.source = NULL;
+    as->outputs = 0;
+
+    /* Allocate memory for fullfilename */
+    fullfilename = create_filename(filename, ".as");
+
+    if (!open_source_file(&file, fullfilename)) {
+        report("Can't open file %s or it does not exist.\n",fullfilename);
+        error_flag = 1;
+    }
+    else {
+        report("Processing file: %s\n", fullfilename);
+
+        if (caching && !options->run && !options->profile && cache_lookup(options->cache_dir, fullfilename, &file, &entry)) {
+            cached = has_formats(&entry, options);
+            if (cached) {
+                error_flag = restore_outputs(as, filename, &entry, options);
+                if (error_flag) {
+                    report("Can't finish the assembler process on file: %s.\n", fullfilename);
+                }
+            }
+            close_cache_entry(&entry);
+        }
+    }
+
+    if (!error_flag && !cached) {
+        pass_messages = as->messages.length;
+        if (options->max_memory > 0) {
+            as->memory_limit = (size_t)options->max_memory * 1024;
+            error_flag = !open_ob_stream(&as->ob_stream, filename);
+        }
+        error_flag = error_flag || assemble_source(as, &file, filename, options->write_am);
+        STAT_START(timer);
+
+        if (error_flag) {
+            report("Can't finish the assembler process on file: %s.\n", fullfilename);
+        }
+        else {
+            /* Only create output files if both scans completed successfully */
+            error_flag = write_outputs(as, &file, fullfilename, filename, pass_messages, options);
+            STAT_LAP(output_ms, timer);
+            if (error_flag) {
+                report("Can't finish the assembler process on file: %s.\n", fullfilename);
+            }
+            else if (options->run || options->profile) {
+                error_flag = run_and_profile(as, fullfilename, filename, options);
+            }
+        }
+        close_source_file(&file);
+        reset_assembly(as);
+    }
+    else if (cached) {
+        close_source_file(&file);
+    }
+
+    route_diagnostics(outer);
+    report_text(as->messages.text, as->messages.length);
+    as->messages.length = 0;
+
+    if (options->stats) {
+        route_stats(NULL);
+        write_stats(&stats, fullfilename, !error_flag, cached, stderr);
+    }
+    free(fullfilename);
+    return error_flag;
+}
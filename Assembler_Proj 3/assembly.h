@@ -0,0 +1,96 @@
+/*
+ * assembly.h - Per-file assembly context header
+ * 
+ * This header file defines the Assembly structure, which holds all the
+ * state of one file being assembled, and the passes that work on it.
+ * Contexts share nothing, so different files can be assembled at the
+ * same time on different threads.
+ */
+
+#ifndef ASSEMBLY_H
+#define ASSEMBLY_H
+
+#include "arena.h"
+#include "input.h"
+#include "symbolTable.h"
+#include "word.h"
+#include "order.h"
+#include "output.h"
+#include "diag.h"
+#include "macros.h"
+
+/* Object file formats selected with --format */
+#define FORMAT_TEXT 1               /* Base-4 text object (.ob), the default */
+#define FORMAT_BIN 2                /* Binary object (.bin) */
+
+#define MEMORY_CHECK_LINES 1024     /* Lines between --max-memory checks in the first pass */
+
+/* Files written for the last file, recorded in Assembly.outputs */
+#define OUTPUT_AM 1                 /* Expanded source (.am) */
+#define OUTPUT_EXT 2                /* External uses (.ext) */
+#define OUTPUT_ENT 4                /* Entry symbols (.ent) */
+#define OUTPUT_OB 8                 /* Base-4 text object (.ob) */
+#define OUTPUT_BIN 16               /* Binary object (.bin) */
+
+/*
+ * Options - Command line settings shared by every file
+ */
+typedef struct Options {
+    int write_am;               /* Write the .am file, cleared by --no-am */
+    int jobs;                   /* Files assembled at the same time, from -j */
+    const char *cache_dir;      /* Output cache directory from --cache, or NULL */
+    int formats;                /* FORMAT_TEXT and/or FORMAT_BIN, from --format */
+    int stats;                  /* Print per-file statistics, set by --stats */
+    int max_errors;             /* Stop a file after this many errors, 0 for no limit */
+    int run;                    /* Run each assembled program, set by --run */
+    unsigned long run_limit;    /* Most instructions of each run, from --run=N */
+    int profile;                /* Write the .prof hot spot report, set by --profile */
+    const char *profile_file;   /* Counts to add to the report, from --profile=FILE, or NULL */
+    int max_memory;             /* Memory ceiling of each file in KB from --max-memory, 0 for none */
+}Options;
+
+/*
+ * Assembly - State of one file being assembled
+ */
+typedef struct Assembly {
+    Arena arena;                /* Per-file allocations, released by reset_assembly */
+    Symbol *symbol_head;        /* Head of main symbol table */
+    Symbol *symbol_tail;        /* Tail of main symbol table */
+    SymbolIndex symbol_index;   /* Hash index over the main symbol table */
+    Image code_image;           /* Instruction words, indexed from IC_START */
+    Image data_image;           /* Data words, indexed from DC 0 */
+    RelocTable relocations;     /* Symbol operand fixups in the code image */
+    ShapeTable matrices;        /* Shapes of the .mat blocks in the data image */
+    LineTable code_lines;       /* .am line of every code word */
+    OriginTable origins;        /* .as origin of every .am line */
+    Symbol *entry_head;         /* Pending .entry names, value = source line */
+    Symbol *entry_tail;         /* Tail of pending .entry names */
+    SourceText expanded_source; /* Preprocessor output read by first_scan */
+    OutputBuffer output;        /* Output files are formatted here, kept across files */
+    ObStream ob_stream;         /* .ob written during the passes with --max-memory */
+    size_t memory_limit;        /* Bytes the file may keep, 0 for no limit */
+    size_t source_size;         /* Bytes of the .as text, counted against the limit */
+    Diagnostics messages;       /* Messages of the file, written when it is done */
+    SourceText cache_record;    /* Outputs of the file, stored in the cache */
+    int outputs;                /* OUTPUT_ flags of the files written for the last file */
+    int entries_flag;           /* Flag for entry symbols */
+    int IC;                     /* Instruction Counter (starts at 100) */
+    int DC;                     /* Data Counter (starts at 0) */
+}Assembly;
+
+/* Option parsing functions */
+int parse_count(const char *value);   /* Reads a positive count, 0 if invalid */
+int parse_formats(const char *value); /* Reads text, bin or both, 0 if invalid */
+
+/* Context management functions */
+void init_assembly(Assembly *as);     /* Prepares an empty context */
+void reset_assembly(Assembly *as);    /* Releases the state of the last file */
+void destroy_assembly(Assembly *as);  /* Frees the context memory */
+
+/* Assembly passes */
+int first_scan(Assembly *as);         /* Symbols, sizes, words and fixups */
+int second_scan(Assembly *as);        /* Entry and address resolution */
+int assemble_source(Assembly *as, const SourceFile *file, char *filename, int write_am); /* Preprocessor and both passes */
+int assemble_file(Assembly *as, char *filename, const Options *options); /* Assembles <filename>.as */
+
+#endif /* ASSEMBLY_H */
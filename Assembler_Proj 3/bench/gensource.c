@@ -0,0 +1,220 @@
+/*
+ * gensource.c - Synthetic source generator for the benchmarks
+ * 
+ * This program writes a valid assembly source of the requested size to
+ * stdout, so the assembler can be timed on inputs far larger than the
+ * test fixtures. The mix of the generated lines is set with:
+ *   -l LINES    instruction lines in the code section (default 100000)
+ *   -b PERCENT  code lines that define a label (default 20)
+ *   -m MACROS   macros defined at the top and called in the code (default 20)
+ *   -d PERCENT  share of data lines (.data/.mat/.string) to code lines (default 25)
+ *   -x EXTERNS  external symbols declared and referenced (default 16)
+ *   -s SEED     seed of the random choices (default 1)
+ * The same options always produce the same source.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Settings - Shape of the generated source
+ */
+typedef struct Settings {
+    long lines;                 /* Instruction lines */
+    int label_percent;          /* Code lines with a label */
+    int macros;                 /* Macros defined */
+    int data_percent;           /* Data lines per 100 code lines */
+    int externs;                /* External symbols */
+    unsigned long seed;         /* Random seed */
+}Settings;
+
+static unsigned long state;     /* Random generator state */
+
+/*
+ * Returns a pseudo-random number in 0..limit-1 from a linear
+ * congruential generator, so the output is the same on every platform.
+ */
+static long pick(long limit) {
+    state = (state * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+    return limit > 0 ? (long)((state >> 8) % (unsigned long)limit) : 0;
+}
+
+/*
+ * Prints an operand of the given kind: 0 immediate, 1 direct, 2 matrix
+ * or 3 register. Direct operands name a data label or, when there are
+ * externs, sometimes an external symbol.
+ */
+static void print_operand(int mode, const Settings *settings, long data_labels) {
+    switch (mode) {
+        case 0:
+            printf("#%ld", pick(200) - 100);
+            break;
+        case 1:
+            if (settings->externs > 0 && pick(4) == 0) {
+                printf("X%ld", pick(settings->externs));
+            }
+            else {
+                printf("D%ld", pick(data_labels));
+            }
+            break;
+        case 2:
+            printf("M%ld[r%ld][r%ld]", pick(data_labels), pick(8), pick(8));
+            break;
+        default:
+            printf("r%ld", pick(8));
+            break;
+    }
+}
+
+/*
+ * Prints one instruction with operands its addressing modes allow.
+ */
+static void print_instruction(const Settings *settings, long data_labels) {
+    static const char *two[] = {"mov", "cmp", "add", "sub", "lea"};
+    static const char *one[] = {"clr", "not", "inc", "dec", "jmp", "bne", "jsr", "red", "prn"};
+    long kind = pick(20);
+    long n;
+
+    if (kind < 10) {
+        n = pick(5);
+        printf("%s ", two[n]);
+        /* lea takes only direct or matrix sources */
+        print_operand(n == 4 ? 1 + (int)pick(2) : (int)pick(4), settings, data_labels);
+        printf(", ");
+        /* cmp takes any destination, lea a direct, matrix or register
+         * one, and mov, add and sub a direct or register one */
+        if (n == 1) {
+            print_operand((int)pick(4), settings, data_labels);
+        }
+        else if (n == 4) {
+            print_operand(1 + (int)pick(3), settings, data_labels);
+        }
+        else {
+            print_operand(pick(2) ? 1 : 3, settings, data_labels);
+        }
+    }
+    else if (kind < 19) {
+        n = pick(9);
+        printf("%s ", one[n]);
+        print_operand(n == 8 ? (int)pick(4) : 1 + (int)pick(3), settings, data_labels);
+    }
+    else {
+        printf(pick(2) ? "rts" : "stop");
+    }
+    printf("\n");
+}
+
+/*
+ * Prints the data line of data label number i: a .data list, a 2x2
+ * .mat or a .string, all under the names the code refers to.
+ */
+static void print_data(long i) {
+    long kind = pick(3);
+    long n;
+
+    printf("D%ld: ", i);
+    if (kind == 0) {
+        printf(".data %ld", pick(1000) - 500);
+        for (n = pick(6); n > 0; n--) {
+            printf(", %ld", pick(1000) - 500);
+        }
+    }
+    else if (kind == 1) {
+        printf(".string \"generated%ld\"", pick(1000));
+    }
+    else {
+        printf(".data 0");
+    }
+    printf("\n");
+    printf("M%ld: .mat [2][2] %ld, %ld, %ld, %ld\n", i, pick(100), pick(100), pick(100), pick(100));
+}
+
+/*
+ * Reads a non-negative number option, exiting with a message if it is
+ * malformed.
+ */
+static long read_number(const char *option, const char *value) {
+    char *end = NULL;
+    long number = value != NULL ? strtol(value, &end, 10) : -1;
+
+    if (value == NULL || *end != '\0' || number < 0) {
+        fprintf(stderr, "gensource: %s expects a non-negative number\n", option);
+        exit(1);
+    }
+    return number;
+}
+
+int main(int argc, char *argv[]) {
+    Settings settings;
+    long data_labels;
+    long i;
+    int j;
+
+    settings.lines = 100000;
+    settings.label_percent = 20;
+    settings.macros = 20;
+    settings.data_percent = 25;
+    settings.externs = 16;
+    settings.seed = 1;
+
+    for (j = 1; j < argc; j++) {
+        const char *value = j + 1 < argc ? argv[j + 1] : NULL;
+        if (strcmp(argv[j], "-l") == 0) {
+            settings.lines = read_number(argv[j], value);
+        }
+        else if (strcmp(argv[j], "-b") == 0) {
+            settings.label_percent = (int)read_number(argv[j], value);
+        }
+        else if (strcmp(argv[j], "-m") == 0) {
+            settings.macros = (int)read_number(argv[j], value);
+        }
+        else if (strcmp(argv[j], "-d") == 0) {
+            settings.data_percent = (int)read_number(argv[j], value);
+        }
+        else if (strcmp(argv[j], "-x") == 0) {
+            settings.externs = (int)read_number(argv[j], value);
+        }
+        else if (strcmp(argv[j], "-s") == 0) {
+            settings.seed = (unsigned long)read_number(argv[j], value);
+        }
+        else {
+            fprintf(stderr, "usage: gensource [-l lines] [-b label%%] [-m macros] [-d data%%] [-x externs] [-s seed]\n");
+            return 1;
+        }
+        j++;
+    }
+    state = settings.seed;
+    data_labels = settings.lines * settings.data_percent / 100;
+    if (data_labels < 1) {
+        data_labels = 1;
+    }
+
+    for (j = 0; j < settings.externs; j++) {
+        printf(".extern X%d\n", j);
+    }
+    printf(".entry MAIN\n");
+    for (j = 0; j < settings.macros; j++) {
+        printf("mcro macro%d\n", j);
+        print_instruction(&settings, data_labels);
+        print_instruction(&settings, data_labels);
+        printf("mcroend\n");
+    }
+
+    printf("MAIN: ");
+    print_instruction(&settings, data_labels);
+    for (i = 1; i < settings.lines; i++) {
+        if (settings.macros > 0 && pick(50) == 0) {
+            printf("macro%ld\n", pick(settings.macros));
+            continue;
+        }
+        if (pick(100) < settings.label_percent) {
+            printf("L%ld: ", i);
+        }
+        print_instruction(&settings, data_labels);
+    }
+    for (i = 0; i < data_labels; i++) {
+        print_data(i);
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * runbench.c - Stage timing harness for the assembler
+ * 
+ * This program assembles each named file (without the .as suffix) a
+ * number of times, timing the stages of assemble_file separately:
+ * reading the source, preprocessor, first_scan, second_scan and
+ * build_ob. It then prints the time of each stage, the throughput in
+ * source lines per second and the peak memory of the process.
+ * 
+ * Usage: runbench [-r REPEAT] file...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "assembly.h"
+#include "macros.h"
+#include "output.h"
+#include "helpers.h"
+
+#define NUM_STAGES 5
+
+static const char *STAGE_NAMES[NUM_STAGES] = {
+    "read", "preprocessor", "first_scan", "second_scan", "build_ob"
+};
+
+/*
+ * Returns the monotonic clock in seconds.
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * Counts the lines of a source file.
+ */
+static long count_lines(const SourceFile *file) {
+    const char *p = file->data;
+    const char *end = file->data + file->size;
+    long lines = 0;
+
+    while (p < end && (p = (const char*)memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        lines++;
+        p++;
+    }
+    if (file->size > 0 && file->data[file->size - 1] != '\n') {
+        lines++;
+    }
+    return lines;
+}
+
+/*
+ * Assembles filename repeat times in as, adding the time of each stage
+ * to seconds. Returns the number of source lines, or -1 if the file
+ * can't be read or does not assemble.
+ */
+static long run_file(Assembly *as, char *filename, int repeat, double seconds[NUM_STAGES]) {
+    char *fullfilename = create_filename(filename, ".as");
+    SourceFile file;
+    double start, t[NUM_STAGES];
+    long lines = 0;
+    size_t size;
+    int run, failed = 0, i;
+
+    for (run = 0; run < repeat && !failed; run++) {
+        start = now();
+        if (!open_source_file(&file, fullfilename)) {
+            fprintf(stderr, "Can't open file %s or it does not exist.\n", fullfilename);
+            failed = 1;
+            break;
+        }
+        t[0] = now();
+        failed = preprocessor(&file, &as->arena, &as->expanded_source, &as->origins);
+        t[1] = now();
+        failed = failed || first_scan(as);
+        t[2] = now();
+        failed = failed || second_scan(as);
+        t[3] = now();
+        if (!failed) {
+            size = build_ob(&as->code_image, &as->data_image, as->IC - IC_START, as->DC, &as->output);
+            failed = !write_output_file(filename, ".ob", as->output.text, size);
+        }
+        t[4] = now();
+
+        seconds[0] += t[0] - start;
+        for (i = 1; i < NUM_STAGES; i++) {
+            seconds[i] += t[i] - t[i - 1];
+        }
+        lines = count_lines(&file);
+        close_source_file(&file);
+        reset_assembly(as);
+    }
+    if (failed) {
+        fprintf(stderr, "runbench: %s did not assemble\n", fullfilename);
+    }
+    free(fullfilename);
+    return failed ? -1 : lines;
+}
+
+int main(int argc, char *argv[]) {
+    Assembly as;
+    struct rusage usage;
+    double seconds[NUM_STAGES], total;
+    long lines;
+    int repeat = 5;
+    int files = 1, i;
+
+    if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+        repeat = atoi(argv[2]);
+        files = 3;
+    }
+    if (repeat < 1 || files >= argc) {
+        fprintf(stderr, "usage: runbench [-r REPEAT] file...\n");
+        return 1;
+    }
+
+    init_assembly(&as);
+    for (; files < argc; files++) {
+        memset(seconds, 0, sizeof(seconds));
+        lines = run_file(&as, argv[files], repeat, seconds);
+        if (lines < 0) {
+            destroy_assembly(&as);
+            return 1;
+        }
+
+        printf("%s.as: %ld lines, %d runs\n", argv[files], lines, repeat);
+        printf("  %-14s %12s %14s\n", "stage", "ms per run", "lines/s");
+        total = 0;
+        for (i = 0; i < NUM_STAGES; i++) {
+            total += seconds[i];
+            printf("  %-14s %12.3f %14.0f\n", STAGE_NAMES[i], seconds[i] * 1000 / repeat,
+                   seconds[i] > 0 ? lines * repeat / seconds[i] : 0.0);
+        }
+        printf("  %-14s %12.3f %14.0f\n", "total", total * 1000 / repeat,
+               total > 0 ? lines * repeat / total : 0.0);
+    }
+    destroy_assembly(&as);
+
+    getrusage(RUSAGE_SELF, &usage);
+    printf("peak RSS: %ld KB\n", usage.ru_maxrss);
+    return 0;
+}
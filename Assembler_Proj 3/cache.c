@@ -0,0 +1,147 @@
+/*
+ * cache.c - Assembly output cache
+ * 
+ * This file implements the cache enabled with --cache=DIR. Each entry is
+ * one file in the cache directory, named after hashes of the .as name
+ * and contents, the size of the contents and the assembler version. It
+ * starts with a header line and holds the sections listed in cache.h,
+ * each written as its length on a line of its own followed by its bytes.
+ * The name is part of the key because the cached messages mention it.
+ * The name and source are stored too and compared on lookup, so a hash
+ * collision is only a miss.
+ * 
+ * Entries are written to a temporary file and renamed into place, so
+ * assemblers running at the same time never see a partial entry.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "input.h"
+#include "helpers.h"
+
+#define CACHE_HEADER "asmcache " ASSEMBLER_VERSION "\n"
+#define MAX_LENGTH_DIGITS 24    /* Room for a section length and newline */
+
+/*
+ * Returns the path of the entry for the given source name and contents,
+ * in a new buffer the caller frees.
+ */
+static char* cache_path(const char *dir, const char *source_name, const SourceFile *source) {
+    char name[80];
+    char *path;
+
+    sprintf(name, "/%08lx-%08lx-%lx-v%s.cache", hash_text(source_name, strlen(source_name)),
+            hash_text(source->data, source->size), (unsigned long)source->size, ASSEMBLER_VERSION);
+    path = (char*)safe_malloc(strlen(dir) + strlen(name) + 1, "Memory allocation error in cache_path");
+    strcpy(path, dir);
+    strcat(path, name);
+    return path;
+}
+
+/*
+ * Looks up the entry for the given source and loads it into entry.
+ * Returns 1 on a hit; on a miss, including a missing, partial or
+ * foreign entry file, returns 0 and leaves nothing to release.
+ */
+int cache_lookup(const char *dir, const char *name, const SourceFile *source, CacheEntry *entry) {
+    char *path = cache_path(dir, name, source);
+    const char *p;
+    const char *end;
+    char *digits_end;
+    unsigned long length;
+    int i;
+
+    if (!open_source_file(&entry->file, path)) {
+        free(path);
+        return 0;
+    }
+    free(path);
+
+    p = entry->file.data;
+    end = entry->file.data + entry->file.size;
+    if (entry->file.size < strlen(CACHE_HEADER) ||
+        strncmp(p, CACHE_HEADER, strlen(CACHE_HEADER)) != 0) {
+        close_cache_entry(entry);
+        return 0;
+    }
+    p += strlen(CACHE_HEADER);
+
+    for (i = 0; i < CACHE_SECTIONS; i++) {
+        /* The file is followed by '\0', so strtoul stops inside it */
+        length = strtoul(p, &digits_end, 10);
+        if (digits_end == p || *digits_end != '\n' || length > (unsigned long)(end - digits_end - 1)) {
+            close_cache_entry(entry);
+            return 0;
+        }
+        entry->text[i] = digits_end + 1;
+        entry->length[i] = (size_t)length;
+        p = entry->text[i] + length;
+    }
+
+    if (p != end || entry->length[CACHE_SOURCE] != source->size ||
+        memcmp(entry->text[CACHE_SOURCE], source->data, source->size) != 0 ||
+        entry->length[CACHE_NAME] != strlen(name) ||
+        memcmp(entry->text[CACHE_NAME], name, strlen(name)) != 0) {
+        close_cache_entry(entry);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * close_cache_entry - Releases the contents of a loaded entry
+ */
+void close_cache_entry(CacheEntry *entry) {
+    close_source_file(&entry->file);
+}
+
+/*
+ * Appends the next section, its length line and then its text, to the
+ * record of a run that is going to be stored.
+ */
+void add_cache_section(SourceText *record, const char *text, size_t length) {
+    char digits[MAX_LENGTH_DIGITS];
+
+    sprintf(digits, "%lu\n", (unsigned long)length);
+    append_source_bytes(record, digits, strlen(digits));
+    append_source_bytes(record, text, length);
+}
+
+/*
+ * Stores the entry for the named source, made of the given record of
+ * its sections after the name. The entry is written under a name unique to this process
+ * and owner, the context doing the store, then renamed over the final
+ * name. The cache is only an optimization, so failures are ignored.
+ */
+void cache_store(const char *dir, const char *name, const SourceFile *source, const SourceText *record, const void *owner) {
+    char *path = cache_path(dir, name, source);
+    char *temp_path = (char*)safe_malloc(strlen(path) + 64, "Memory allocation error in cache_store");
+    char digits[MAX_LENGTH_DIGITS];
+    FILE *file;
+    int ok;
+
+    mkdir(dir, 0777); /* Fails harmlessly if it already exists */
+    sprintf(temp_path, "%s.%ld.%lx.tmp", path, (long)getpid(), (unsigned long)(size_t)owner);
+    sprintf(digits, "%lu\n", (unsigned long)source->size);
+
+    file = fopen(temp_path, "wb");
+    if (file != NULL) {
+        ok = fputs(CACHE_HEADER, file) != EOF && fputs(digits, file) != EOF;
+        ok = ok && fwrite(source->data, 1, source->size, file) == source->size;
+        ok = ok && fprintf(file, "%lu\n%s", (unsigned long)strlen(name), name) > 0;
+        ok = ok && fwrite(record->text, 1, record->length, file) == record->length;
+        if (fclose(file) != 0) {
+            ok = 0;
+        }
+        if (!ok || rename(temp_path, path) != 0) {
+            remove(temp_path);
+        }
+    }
+    free(temp_path);
+    free(path);
+}
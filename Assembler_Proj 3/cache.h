@@ -0,0 +1,50 @@
+/*
+ * cache.h - Assembly output cache header
+ * 
+ * This header file declares the optional cache of assembled outputs.
+ * An entry is keyed by the name and contents of a .as file and the
+ * assembler version, and holds everything a successful run produced for it, so an
+ * unchanged file can be restored without running the passes.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include "input.h"
+
+/* Part of every cache key; change it whenever the output for a given
+ * source can change, so entries made by older builds are never used */
+#define ASSEMBLER_VERSION "1.28"
+
+/*
+ * Sections of a cache entry, in the order they are stored
+ */
+enum {
+    CACHE_SOURCE,               /* The .as contents, compared on lookup */
+    CACHE_NAME,                 /* The .as name, compared on lookup */
+    CACHE_MESSAGES,             /* Messages reported by the passes, which name the file */
+    CACHE_AM,                   /* Expanded source */
+    CACHE_EXT,                  /* .ext contents, empty if none was made */
+    CACHE_ENT,                  /* .ent contents, empty if none was made */
+    CACHE_OB,                   /* .ob contents, empty if none was made */
+    CACHE_BIN,                  /* .bin contents, empty if none was made */
+    CACHE_SECTIONS              /* Number of sections */
+};
+
+/*
+ * CacheEntry - A cache entry loaded from the cache directory
+ */
+typedef struct CacheEntry {
+    SourceFile file;                    /* Contents of the entry file */
+    const char *text[CACHE_SECTIONS];   /* Start of each section in file */
+    size_t length[CACHE_SECTIONS];      /* Length of each section */
+}CacheEntry;
+
+/* Cache functions */
+int cache_lookup(const char *dir, const char *name, const SourceFile *source, CacheEntry *entry); /* Loads the entry for source */
+void close_cache_entry(CacheEntry *entry);                                      /* Releases a loaded entry */
+void add_cache_section(SourceText *record, const char *text, size_t length);    /* Appends the next section */
+void cache_store(const char *dir, const char *name, const SourceFile *source, const SourceText *record, const void *owner); /* Saves an entry */
+
+#endif /* CACHE_H */
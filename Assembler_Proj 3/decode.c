@@ -7,7 +7,7 @@
  * - Character encoding in binary format
  * - Register encoding for source and target operands
  * - Operand decoding and validation
- * - Data section processing (.data, .string, .mat)
+ * - Data section processing (.data, .string, .mat), in word runs
  * - Base-4 encoding for output files
  */
 
@@ -16,242 +16,109 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "decode.h"
 #include "helpers.h"
+#include "input.h"
 #include "order.h"
 #include "word.h"
+#include "tokenizer.h"
+#include "diag.h"
+
+#define MAX_LINE_VALUES (MAX_LINE_LENGTH / 2 + 1) /* Most values a line of "n,n,..." can hold */
+
+/* How each addressing mode is named in operand errors */
+static const char *MODE_NAMES[4] = {"immediate", "a label", "a matrix", "a register"};
 
 /*
- * This function implements comprehensive operand validation for all assembly instructions.
- * It checks that operands follow the correct addressing mode rules for each instruction type.
+ * Checks the addressing modes of an instruction against the legal mode
+ * masks of its opcode, one AND per operand. The tokenizer leaves an
+ * operand the line is missing at mode -1, which is an error when the
+ * instruction takes it; a lone operand is the destination.
+ * Returns 0 if the modes are legal and 1 after reporting the first that
+ * is not.
  */
 int validate_operands(Order* order, int line_num) {
-    int opcode = order->opcode;
-    int operand1 = order->operand1;
-    int operand2 = order->operand2;
-    
-    /* Handle instructions with no operands */
-    if (opcode == 14 || opcode == 15) { /* rts, stop */
-        if (operand1 != -1 || operand2 != -1) {
-            printf("Error: Instruction '%s' expects no operands at line %d\n", 
-                   (opcode == 14) ? "rts" : "stop", line_num);
-            return 1;
-        }
-        return 0;
+    const Instruction* instruction = &INSTRUCTIONS[order->opcode];
+
+    if (instruction->operands == 2 && order->operand1 < 0) {
+        report_error(line_num, "Missing source operand\n");
+        return 1;
     }
-    
-    /* Handle two-operand instructions */
-    if (opcode >= 0 && opcode <= 3) { /* mov, cmp, add, sub */
-        /* Source operand validation */
-        if (operand1 < 0 || operand1 > 3) {
-            printf("Error: Invalid source operand type at line %d\n", line_num);
-            return 1;
-        }
-        
-        /* Destination operand validation */
-        if (operand2 < 0 || operand2 > 3) {
-            printf("Error: Invalid destination operand type at line %d\n", line_num);
-            return 1;
-        }
-        
-        /* For mov, add, sub: destination cannot be immediate (0) or matrix (2) */
-        if (opcode == 0 || opcode == 2 || opcode == 3) {
-            if (operand2 == 0) {
-                printf("Error: Destination operand cannot be immediate at line %d\n", line_num);
-                return 1;
-            }
-            if (operand2 == 2) {
-                printf("Error: Destination operand cannot be matrix at line %d\n", line_num);
-                return 1;
-            }
-        }
-        
-        return 0;
+    if (instruction->operands >= 1 && order->operand2 < 0) {
+        report_error(line_num, "Missing destination operand\n");
+        return 1;
     }
-    
-    /* Handle lea instruction */
-    if (opcode == 4) { /* lea */
-        /* Source must be symbol or matrix */
-        if (operand1 != 1 && operand1 != 2) {
-            printf("Error: LEA source operand must be a label at line %d\n", line_num);
-            return 1;
-        }
-        
-        /* Destination allowed types: 1 (symbol), 2 (matrix), 3 (register) */
-        if (operand2 != 1 && operand2 != 2 && operand2 != 3) {
-            printf("Error: LEA destination operand must be label or register at line %d\n", line_num);
-            return 1;
-        }
-        
-        return 0;
+    if (order->operand1 >= 0 && !(instruction->src_modes & MODE_BIT(order->operand1))) {
+        report_error(line_num, "Source operand cannot be %s\n", MODE_NAMES[order->operand1]);
+        return 1;
     }
-    
-    if (opcode > 4 && opcode < 13) { 
-        /* Should have only one operand */
-        if (operand1 != -1) {
-            printf("Error: Unary instruction '%s' expects only one operand at line %d\n", 
-                   (opcode == 4) ? "not" : (opcode == 5) ? "clr" : (opcode == 7) ? "inc" : "dec", line_num);
-            return 1;
-        }
-        
-        /* Allowed types: symbol (1), matrix (2), register (3) */
-        if (operand2 != 1 && operand2 != 2 && operand2 != 3 ) {
-            printf("Error: Unary instruction operand must be label or register at line %d\n", line_num);
-            return 1;
-        }
-        
-        return 0;
+    if (order->operand2 >= 0 && !(instruction->dst_modes & MODE_BIT(order->operand2))) {
+        report_error(line_num, "Destination operand cannot be %s\n", MODE_NAMES[order->operand2]);
+        return 1;
     }
-
-    
-    /* Handle prn instruction */
-    if (opcode == 13) { /* prn */
-        /* Should have only one operand */
-        if (operand1 != -1) {
-            printf("Error: PRN instruction expects only one operand at line %d\n", line_num);
-            return 1;
-        }
-        
-        /* All operand types allowed (0, 1, 2, 3) */
-        if (operand2 < 0 || operand2 > 3) {
-            printf("Error: Invalid PRN operand type at line %d\n", line_num);
-            return 1;
-        }
-        
-        return 0;
-    }
-    
-    /* Default case: invalid opcode */
-    return 1;
+    return 0;
 }
-    
+
 /*
- * Converts a signed integer to its 10-bit binary representation.
+ * Converts a signed integer to its 10-bit machine word representation.
  * Uses a mask to ensure only the lowest 10 bits are considered.
  */
-char* decode_number(int number) {
-    char* str = (char*) safe_malloc(sizeof(char) * 11, "Memory allocation failed in decode_number");
-    unsigned int mask = (1 << 10) - 1;  /* = 0x3FF = 1023 */
-    unsigned int val = number & mask;
-    int i;
-    for (i=9 ; i>=0; i--) {
-        str[9 - i] = ((val >> i) & 1) ? '1' : '0';
-    }
-    str[10] = '\0';
-    return str;
+unsigned int decode_number(int number) {
+    return (unsigned int)number & WORD_MASK;
 }
 
 /*
- * Converts a signed integer to its 8-bit binary representation.
- * Handles negative numbers using two's complement representation.
+ * Converts a signed integer to its 8-bit representation.
+ * Negative numbers keep their two's complement low byte.
  */
-char* decode_number_in_8_bits(int number) {
-    char* str = (char*) safe_malloc(sizeof(char) * 9, "Memory allocation failed in decode_number_in_8_bits");
-
-    unsigned int val;
-    int i;
-
-    if (number < 0)
-        val = (1 << 8) + number;  /* Two's complement for 8 bits */
-    else
-        val = number;
-
-    for (i = 7; i >= 0; i--) {
-        str[7 - i] = ((val >> i) & 1) ? '1' : '0';
-    }
-    str[8] = '\0';
-    return str;
+unsigned int decode_number_in_8_bits(int number) {
+    return (unsigned int)number & 0xFF;
 }
 
 /*
- * Constructs the first word of an assembly instruction by combining:
- * - Opcode (bits 2-5)
- * - Source operand addressing mode (bits 6-7)
- * - Destination operand addressing mode (bits 8-9)
+ * Constructs the first word of an assembly instruction, looked up in
+ * FIRST_WORDS, which combines:
+ * - Opcode (bits 6-9)
+ * - Source operand addressing mode (bits 4-5)
+ * - Destination operand addressing mode (bits 2-3)
  * - Reserved bits (bits 0-1)
  */
-void decode_order_first_word(Order* order) {
-    Word* tmp = (Word*) safe_malloc(sizeof(Word), "Memory allocation failed in decode_order_first_word");
-
-    char* str = (char*) safe_malloc(11, "Memory allocation failed for str in decode_order_first_word");
-
-    strncpy(str, decode_number(order->opcode) + 6, 4); /* bits 2-5 */
-    strncpy(str + 4, decode_number(order->operand1) + 8, 2); /* bits 6-7 */
-    strncpy(str + 6, decode_number(order->operand2) + 8, 2); /* bits 8-9 */
-    strcpy(str + 8, "00\0"); /* bits 0-1 */
-    tmp->word = (char*) safe_malloc(sizeof(char) * 11, "Memory allocation failed for word field");
-    strncpy(tmp->word, str, 11);
-    tmp->type = 1;
-    tmp->next = NULL;
-
-    add_word_to_order(order, tmp);
-    free(str);
+void decode_order_first_word(Order* order, Image* code) {
+    int source = order->operand1 < 0 ? 0 : order->operand1;  /* Absent operands encode as 0 */
+    int target = order->operand2 < 0 ? 0 : order->operand2;
+    add_image_word(code, FIRST_WORDS[order->opcode & 0xF][source & 3][target & 3]);
 }
 
 /*
- * Converts a character to its 10-bit binary representation.
+ * Converts a character to its 10-bit machine word representation.
  * The character is treated as an unsigned value (0-255).
  */
-char* decode_char(char ch) {
-    char *bin = (char *)safe_malloc(11, "Memory allocation failed in decode_char");
-    unsigned int val;
-    int i;
-
-    val = (unsigned char)ch;  /* force into range 0–255 */
-
-    for (i = 9; i >= 0; i--) {
-        bin[9 - i] = ((val >> i) & 1) ? '1' : '0';
-    }
-
-    bin[10] = '\0';
-    return bin;
-}
-
-/*
- * Converts a register number (0-15) to its 4-bit binary representation.
- */
-char* reg_in_str(int num) {
-    char* str = (char*) safe_malloc(sizeof(char) * 5, "Memory allocation failed in reg_in_str");
-    int i;
-    for (i = 3; i >= 0; i--) {
-        str[3 - i] = ((num >> i) & 1) ? '1' : '0';
-    }
-    str[4] = '\0';
-    return str;
+unsigned int decode_char(char ch) {
+    return (unsigned char)ch;  /* force into range 0-255 */
 }
 
 /*
- * Creates the binary encoding for a target register operand.
+ * Creates the encoding for a target register operand.
  * Format: "0000" + register_bits + "00"
  */
-char* decode_target_register(int number) {
-    char* str = (char*) safe_malloc(sizeof(char) * 11, "Memory allocation failed in decode_target_register");
-    strcpy(str,"0000");
-    strncpy(str+4,reg_in_str(number),4);
-    strncpy(str+8,"00\0",3);
-    return str;
+unsigned int decode_target_register(int number) {
+    return REGISTER_WORDS[0][number & 7];
 }
 
 /*
- * Creates the binary encoding for a source register operand.
- * Format: "00" + register_bits + "0000"
+ * Creates the encoding for a source register operand.
+ * Format: register_bits + "000000"
  */
-char* decode_source_register(int number) {
-    char* str = (char*) safe_malloc(sizeof(char) * 11, "Memory allocation failed in decode_source_register");
-    strncpy(str,reg_in_str(number),4);
-    strcpy(str+4,"000000\0");
-    return str;
+unsigned int decode_source_register(int number) {
+    return REGISTER_WORDS[number & 7][0];
 }
 
 /*
- * Creates the binary encoding for a matrix operand.
+ * Creates the encoding for a register pair (matrix indices or two registers).
  * Format: register1_bits + register2_bits + "00"
  */
-char* decode_registers(int number1,int number2) {
-    char* str = (char*) safe_malloc(sizeof(char) * 11, "Memory allocation failed in decode_registers");
-    strncpy(str,reg_in_str(number1),4);
-    strncpy(str+4,reg_in_str(number2),4);
-    strncpy(str+8,"00\0",3);
-    return str;
+unsigned int decode_registers(int number1,int number2) {
+    return REGISTER_WORDS[number1 & 7][number2 & 7];
 }
 
 /*
@@ -278,230 +145,186 @@ int str_to_int(const char* str) {
 }
 
 /*
- * Decodes an operand from a line of assembly code.
- * Handles immediate, register, and symbol operands.
- * Validates matrix operand syntax.
- * Updates order structure with operand information.
+ * Encodes one scanned operand into the code image.
+ * Immediate and register operands are encoded directly; a symbol
+ * operand gets a placeholder word and a relocation that is resolved in
+ * the second pass, followed by the index register word for a matrix.
+ * A register is encoded in the source field when is_source is set, and
+ * line_num is the source line a relocation reports when its symbol is
+ * not defined.
  */
-void decode_operand(Order* order,char* line,int index,int line_num) { /* we need to check if there is memory allocation to free and add checks that the allocation succeed (not null) */
-    char* str = (char*) safe_malloc(sizeof(char) * 11, "Memory allocation failed in decode_operand");
-    char* symbol_name = (char*) safe_malloc(sizeof(char) * MAX_SYMBOL_LENGTH, "Memory allocation failed for symbol_name");
-    Word* tmp = NULL;
-    Word* tmp2 = NULL;
-    int num, index2;
-    int flag = 0;
-
-
-    if (str == NULL) {
-        printf("Error in decode_operand() at line %d - str allocation failed\n", line_num);
-        exit(1);
-    }
-
-    tmp = new_word();
-    tmp2 = new_word();
-
-    if (tmp == NULL || tmp2 == NULL) {
-        printf("Error in decode_operand() at line %d - word allocation failed\n", line_num);
-        free(str);
-        free(symbol_name);
-        exit(1);
-    }
-
-    if (line == NULL) {
-        printf("Error in decode_operand() at line %d - line is NULL\n", line_num);
-        free(str);
-        free(symbol_name);
-        free(tmp);
-        free(tmp2);
-        exit(1);
-    }
-    if (index < 0 || index >= strlen(line)) {
-        printf("Error in decode_operand() at line %d - index %d out of bounds (line length: %d)\n", line_num, index, strlen(line));
-        free(str);
-        free(symbol_name);
-        free(tmp);
-        free(tmp2);
-        exit(1);
+void decode_operand(Image* code,RelocTable* relocs,const char* line,const Operand* operand,int is_source,int line_num) {
+    int offset;
+
+    switch (operand->mode) {
+        case ADDR_IMMEDIATE: /* 8-bit immediate value */
+            add_image_word(code, (decode_number_in_8_bits(operand->value) << 2) | ARE_ABSOLUTE);
+            break;
+        case ADDR_REGISTER:
+            add_image_word(code, is_source ? decode_source_register(operand->value)
+                                           : decode_target_register(operand->value));
+            break;
+        case ADDR_DIRECT:
+        case ADDR_MATRIX:
+            /* Placeholder, filled in by update_symbol_operands */
+            offset = add_image_word(code, 0);
+            add_relocation(relocs, offset, line + operand->start, operand->name_length, line_num);
+            if (operand->mode == ADDR_MATRIX) {
+                add_image_word(code, decode_registers(operand->row_register, operand->column_register));
+            }
+            break;
     }
+}
 
-    /* Check for immediate addressing (#number) */
-    if (line[index] == '#') {
-        index++;
-        if (is_number(line, index)) {
-            num = str_to_int(line + index);
-            strncpy(str, decode_number_in_8_bits(num), 8);  /* 8-bit immediate value */
-            strncpy(str+8,"00\0",3);                        /* Addressing mode bits */
-        } else {
-            printf("Error in decode_operand() at line %d - invalid immediate value\n", line_num);
-            free(str);
-            free(symbol_name);
-            free(tmp);
-            free(tmp2);
-            exit(1);
+/*
+ * Scans a list of values "n, n, ..." from index to the end of the line in
+ * one pass and appends their words to data as one contiguous run. Only
+ * the well-formed shape is taken: signed numbers of at most MAX_NUM_LENGTH
+ * characters separated by commas, with spaces and tabs around them.
+ * Returns the number of values, or -1 leaving data unchanged if the list
+ * is empty or has any other shape, so that the caller can validate the
+ * line and report the exact error.
+ */
+static int scan_values(Image *data, const char *line, int index) {
+    int start = data->count;
+    unsigned short *run = append_image_words(data, MAX_LINE_VALUES);
+    int count = 0;
+    int value, negative, token;
+
+    while (1) {
+        index = skip_spaces(line, index);
+        token = index;
+        negative = line[index] == '-';
+        if (line[index] == '-' || line[index] == '+') {
+            index++;
         }
-    }
-    else if ( is_register(line,index,line_num) == 1 ) {
-        free(str); /* Free the original allocation */
-        str = decode_source_register(atoi(line+index+1));  /* Extract register number after 'r' */
-    }
-    else if (is_register(line,index,line_num) == 2) {
-        free(str); /* Free the original allocation */
-        str = decode_target_register(atoi(line+index+1));  /* Extract register number after 'r' */
-    }
-    else {
-        index2 = is_symbol(line,index);
-        if (index2 <= 0) {
-            printf("Error in decode_operand() at line %d - invalid symbol\n", line_num);
-            free(str);
-            free(symbol_name);
-            free(tmp);
-            free(tmp2);
-            exit(1);
+        value = 0;
+        while (line[index] >= '0' && line[index] <= '9') {
+            value = value * 10 + (line[index] - '0');
+            index++;
         }
-        
-        /* Set symbol flag and copy symbol name */
-        order->symbol_flag = 1;
-        strncpy(symbol_name,line+index,index2-index);
-        symbol_name[index2-index] = '\0'; /* Ensure null termination */
-
-
-        /* Check if this symbol is part of a matrix operand */
-        if (is_mat_operand(line,index,line_num)) {
-            int reg_index, reg1_start, reg2_start, reg1_len, reg2_len, i;
-            char reg1_str[10], reg2_str[10];
-            /* Process matrix operand - find the register indices */
-
-            reg_index = index2; /* Start after the symbol */
-            while (reg_index < strlen(line) && line[reg_index] != '[') {
-                reg_index++;
-            }
-            if (line[reg_index] == '[') {
-                reg_index++; /* Skip the '[' */
-                reg1_start = reg_index;
-                while (reg_index < strlen(line) && line[reg_index] != ']') {
-                    reg_index++;
-                }
-                if (line[reg_index] == ']') {
-                    reg_index++; /* Skip the ']' */
-                    if (line[reg_index] == '[') {
-                        reg_index++; /* Skip the second '[' */
-                        reg2_start = reg_index;
-                        while (reg_index < strlen(line) && line[reg_index] != ']') {
-                            reg_index++;
-                        }
-                        if (line[reg_index] == ']') {
-                            /* Extract register numbers */
-                            reg1_len = 0;
-                            reg2_len = 0;
-
-                            /* Extract first register */
-                            i = reg1_start;
-                            while (i < strlen(line) && line[i] != ']' && reg1_len < 9) {
-                                if (line[i] == 'r') {
-                                    i++;
-                                    while (i < strlen(line) && isdigit(line[i]) && reg1_len < 9) {
-                                        reg1_str[reg1_len++] = line[i];
-                                        i++;
-                                    }
-                                } else {
-                                    i++;
-                                }
-                            }
-                            reg1_str[reg1_len] = '\0';
-
-                            /* Extract second register */
-                            i = reg2_start;
-                            while (i < strlen(line) && line[i] != ']' && reg2_len < 9) {
-                                if (line[i] == 'r') {
-                                    i++;
-                                    while (i < strlen(line) && isdigit(line[i]) && reg2_len < 9) {
-                                        reg2_str[reg2_len++] = line[i];
-                                        i++;
-                                    }
-                                } else {
-                                    i++;
-                                }
-                            }
-                            reg2_str[reg2_len] = '\0';
-
-
-                            /* Decode the registers */
-                            strcpy(tmp2->word, decode_registers(atoi(reg1_str), atoi(reg2_str)));
-                            flag=1;
-                        }
-                    }
-                }
-            }
+        if (index == token || !isdigit((unsigned char)line[index - 1]) ||
+            index - token > MAX_NUM_LENGTH || count == MAX_LINE_VALUES) {
+            data->count = start;
+            return -1;
         }
+        run[count++] = (unsigned short)decode_number(negative ? -value : value);
 
-        /* Allocate memory for symbol names if needed */
-                    if (order->symbol_name1 == NULL && (order->operand1 == 2 || order->operand1 == 1)) {
-                order->symbol_name1 = (char*)safe_malloc(strlen(symbol_name) + 1, "Memory allocation failed for symbol_name1");
-                if (order->symbol_name1 == NULL) {
-                    printf("Error in decode_operand() at line %d - memory allocation failed\n", line_num);
-                    free(str);
-                    free(symbol_name);
-                    free(tmp);
-                    free(tmp2);
-                    exit(1);
-                }
-            strcpy(order->symbol_name1, symbol_name);
+        index = skip_spaces(line, index);
+        if (line[index] == ',') {
+            index++;
+        }
+        else if (line[index] == '\n' || line[index] == '\0') {
+            break;
         }
         else {
-            order->symbol_name2 = (char*)safe_malloc(strlen(symbol_name) + 1, "Memory allocation failed for symbol_name2");
-            if (order->symbol_name2 == NULL) {
-                printf("Error in decode_operand() at line %d - memory allocation failed\n", line_num);
-                free(str);
-                free(symbol_name);
-                free(tmp);
-                free(tmp2);
-                exit(1);
-            }
-            strcpy(order->symbol_name2, symbol_name);
+            data->count = start;
+            return -1;
         }
-        strcpy(str, "0000000000\0");
     }
+    data->count = start + count;
+    return count;
+}
 
-    strcpy(tmp->word,str);
+/*
+ * Encodes the quoted string at index into data in one pass: checks the
+ * quotes, translates the escape sequences \" \\ \n \t and \0, and writes
+ * the character words and the terminator as one run. Returns the number
+ * of words written, or -1 after reporting an error, leaving data as it
+ * was.
+ */
+static int encode_string(Image *data, const char *line, int index, int line_num) {
+    int start = data->count;
+    unsigned short *run = append_image_words(data, MAX_LINE_LENGTH);
+    int count = 0;
+    char ch;
+
+    if (line[index] != '"') {
+        report_error(line_num, "String must start with '\"'\n");
+        data->count = start;
+        return -1;
+    }
+    index++; /* skip starting " */
+
+    while (line[index] != '"') {
+        ch = line[index++];
+        if (ch == '\0' || ch == '\n' || count == MAX_LINE_LENGTH - 1) {
+            report_error(line_num, "Missing closing '\"' in string\n");
+            data->count = start;
+            return -1;
+        }
+        if (ch == '\\') {
+            switch (line[index]) {
+                case '"':  ch = '"'; break;
+                case '\\': ch = '\\'; break;
+                case 'n':  ch = '\n'; break;
+                case 't':  ch = '\t'; break;
+                case '0':  ch = '\0'; break;
+                default:
+                    if (line[index] == '\0' || line[index] == '\n') {
+                        report_error(line_num, "Missing closing '\"' in string\n");
+                    }
+                    else {
+                        report_error(line_num, "Unknown escape sequence '\\%c' in string\n", line[index]);
+                    }
+                    data->count = start;
+                    return -1;
+            }
+            index++;
+        }
+        run[count++] = (unsigned short)decode_char(ch);
+    }
 
-    add_word_to_order(order,tmp);
-    free(str);
+    index = skip_spaces(line, index + 1); /* Skip after closing quote */
+    if (line[index] != '\0' && line[index] != '\n' && line[index] != '\r') {
+        report_error(line_num, "Unexpected characters after string\n");
+        data->count = start;
+        return -1;
+    }
 
-    if (flag)
-        add_word_to_order(order,tmp2);
+    run[count++] = 0; /* String terminator */
+    data->count = start + count;
+    return count;
 }
 
 /*
  * Decodes a .data directive.
  * Handles data initialization and matrix initialization.
  * Validates data format and matrix syntax.
- * Updates DC (data counter) and adds words to the data list.
+ * Updates DC (data counter) and appends the words to the data image,
+ * each directive as one run. Well-formed value lists are encoded in a
+ * single scan; the others go through the checks that name their error.
  */
-int decode_data(Word **D_word_head, Word **D_word_tail, char *line, int index, int directive, int DC, int line_num) {
+int decode_data(Image *data, char *line, int index, int directive, int DC, int line_num) {
+    int count;
     int i;
-    Word *tmp = NULL;
 
     if (directive == 1) { /* .data */
         index += 5;
-        
+
+        count = scan_values(data, line, index);
+        if (count >= 0) {
+            return DC + count;
+        }
+
         /* Check for comma errors first */
         if (contains_invalid_commas(line, index)) {
             int error_type = get_data_comma_error_type(line, index);
             switch (error_type) {
                 case 1:
-                    printf("Error: Leading comma in .data directive at line %d\n", line_num);
+                    report_error(line_num, "Leading comma in .data directive\n");
                     break;
                 case 2:
-                    printf("Error: Trailing comma in .data directive at line %d\n", line_num);
+                    report_error(line_num, "Trailing comma in .data directive\n");
                     break;
                 case 3:
-                    printf("Error: Double comma in .data directive at line %d\n", line_num);
+                    report_error(line_num, "Double comma in .data directive\n");
                     break;
                 case 4:
-                    printf("Error: Missing comma between values in .data directive at line %d\n", line_num);
+                    report_error(line_num, "Missing comma between values in .data directive\n");
                     break;
                 default:
-                    printf("Error: Invalid comma usage in .data directive at line %d\n", line_num);
+                    report_error(line_num, "Invalid comma usage in .data directive\n");
                     break;
             }
             return -1;  /* Return error value */
@@ -512,23 +335,15 @@ int decode_data(Word **D_word_head, Word **D_word_tail, char *line, int index, i
         }
 
         while (line[index] != '\n' && line[index] != '\0') {
-            index = space_skip(line, index);
+            index = skip_spaces(line, index);
             if (line[index] == '\n' || line[index] == '\0') break;
 
             if (!isdigit(line[index]) && line[index] != '-' && line[index] != '+') {
-                printf("Error: Expected number at index %d but found '%c' at line %d\n", index, line[index], line_num);
+                report_error(line_num, "Expected number at index %d but found '%c'\n", index, line[index]);
                 break;
             }
 
-            tmp = add_word(D_word_head, D_word_tail);
-            if (!tmp) {
-                printf("Error in memory allocation\n");
-                return DC;
-            }
-
-
-            tmp->address = DC;
-            strncpy(tmp->word, decode_number(str_to_int(line + index)), 11);
+            add_image_word(data, decode_number(str_to_int(line + index)));
             DC++;
 
             while (line[index] != ',' && line[index] != '\n' && line[index] != '\0') {
@@ -542,76 +357,56 @@ int decode_data(Word **D_word_head, Word **D_word_tail, char *line, int index, i
     }
     else if (directive == 2) { /* .string */
         index += 7;
-        index = space_skip(line, index);
+        index = skip_spaces(line, index);
 
-        if (!is_legal_string(line, index, line_num)) {
+        count = encode_string(data, line, index, line_num);
+        if (count == -1) {
             return -1;  /* Return error value */
         }
-
-        index++; /* skip starting " */
-
-        while (line[index] != '"' && line[index] != '\0') {
-            tmp = add_word(D_word_head, D_word_tail);
-            if (!tmp) {
-                printf("Error in memory allocation\n");
-                return DC;
-            }
-
-            strncpy(tmp->word, decode_char(line[index]), 11);
-            tmp->address = DC;
-            DC++;
-            index++;
-        }
-        tmp = add_word(D_word_head, D_word_tail);
-        if (!tmp) {
-            printf("Error in memory allocation\n");
-            return DC;
-        }
-        strncpy(tmp->word, "0000000000\0", 11);
-        tmp->address = DC;
-        DC++;
+        DC += count;
     }
 
     else if (directive == 3) { /* .mat */
         int dim_end;
         int data_start;
         int dim;
+        int cells;
         
         index += 4;
-        while (line[index] != '[' && line[index] != '\0')
+        while (line[index] != '[' && line[index] != '\0' && line[index] != '\n')
             index++;
 
         /* Check for comma errors in matrix data initialization */
         /* First, find the end of the matrix dimensions */
         dim_end = index;
         for (dim = 0; dim < 2; dim++) {
-            while (dim_end < strlen(line) && line[dim_end] != '[') dim_end++;
+            while (line[dim_end] != '\0' && line[dim_end] != '\n' && line[dim_end] != '[') dim_end++;
             if (line[dim_end] == '[') dim_end++;
-            while (dim_end < strlen(line) && line[dim_end] != ']') dim_end++;
+            while (line[dim_end] != '\0' && line[dim_end] != '\n' && line[dim_end] != ']') dim_end++;
             if (line[dim_end] == ']') dim_end++;
         }
         
         /* Now find the start of the data initialization */
-        data_start = space_skip(line, dim_end);
+        data_start = skip_spaces(line, dim_end);
         
-        if (data_start < strlen(line) && line[data_start] != '\n' && line[data_start] != '\0') {
+        if (line[data_start] != '\n' && line[data_start] != '\0') {
             if (contains_invalid_commas(line, data_start)) {
                 int error_type = get_data_comma_error_type(line, data_start);
                 switch (error_type) {
                     case 1:
-                        printf("Error: Leading comma in .mat directive at line %d\n", line_num);
+                        report_error(line_num, "Leading comma in .mat directive\n");
                         break;
                     case 2:
-                        printf("Error: Trailing comma in .mat directive at line %d\n", line_num);
+                        report_error(line_num, "Trailing comma in .mat directive\n");
                         break;
                     case 3:
-                        printf("Error: Double comma in .mat directive at line %d\n", line_num);
+                        report_error(line_num, "Double comma in .mat directive\n");
                         break;
                     case 4:
-                        printf("Error: Missing comma between values in .mat directive at line %d\n", line_num);
+                        report_error(line_num, "Missing comma between values in .mat directive\n");
                         break;
                     default:
-                        printf("Error: Invalid comma usage in .mat directive at line %d\n", line_num);
+                        report_error(line_num, "Invalid comma usage in .mat directive\n");
                         break;
                 }
                 return -1;  /* Return error value */
@@ -623,138 +418,100 @@ int decode_data(Word **D_word_head, Word **D_word_tail, char *line, int index, i
         }
 
         for (i = 0; i < 2; i++) {
-            while (line[index] != ']' && line[index] != '\0') index++;
+            while (line[index] != ']' && line[index] != '\0' && line[index] != '\n') index++;
             if (line[index] == ']') index++;
         }
 
-        index = space_skip(line, index);
+        index = skip_spaces(line, index);
 
-        if (line[index] == '\n' || line[index] == '\0') {
-            int cells = save_place(line, line_num);
-            if (cells != -1) DC += cells;
-            return DC;
+        /* The matrix takes rows * columns words; cells without a value are zero */
+        cells = save_place(line, line_num);
+        if (cells == -1) {
+            return -1;
         }
+        if (cells > ADDRESS_WORDS - IC_START) {
+            report_error(line_num, "A %d cell matrix does not fit in the %d words of memory after the code start\n",
+                         cells, ADDRESS_WORDS - IC_START);
+            return -1;
+        }
+        count = 0;
+        if (line[index] != '\n' && line[index] != '\0') {
+            count = scan_values(data, line, index);
+            if (count < 0) { /* Validated already, so only unusual spacing gets here */
+                count = 0;
+                while (line[index] != '\n' && line[index] != '\0') {
+                    index = skip_spaces(line, index);
+                    if (!isdigit(line[index]) && line[index] != '-' && line[index] != '+') break;
+
+                    add_image_word(data, decode_number(str_to_int(line + index)));
+                    count++;
+
+                    while (line[index] != ',' && line[index] != '\n' && line[index] != '\0') {
+                        index++;
+                    }
 
-        while (line[index] != '\n' && line[index] != '\0') {
-            index = space_skip(line, index);
-            if (!isdigit(line[index]) && line[index] != '-' && line[index] != '+') break;
-
-            tmp = add_word(D_word_head, D_word_tail);
-            if (!tmp) {
-                printf("Error in memory allocation\n");
-                return DC;
-            }
-
-            strncpy(tmp->word, decode_number(str_to_int(line + index)), 11);
-            tmp->address = DC;
-            DC++;
-
-            while (line[index] != ',' && line[index] != '\n' && line[index] != '\0') {
-                index++;
-            }
-
-            if (line[index] == ',') {
-                index++;
+                    if (line[index] == ',') {
+                        index++;
+                    }
+                }
             }
         }
+        if (count > cells) {
+            report_error(line_num, "Too many values for a %d cell matrix in .mat directive\n", cells);
+            data->count -= count;
+            return -1;
+        }
+        reserve_image_words(data, cells - count);
+        DC += cells;
     }
 
     return DC;
 }
 
-/*
- * Converts a 2-bit binary string to a base 4 character.
- * Validates the input string and returns the corresponding base 4 character.
- */
-char bin_to_base4char(const char *two_bits) {
-    if (strncmp(two_bits, "00", 2) == 0) return 'a';
-    if (strncmp(two_bits, "01", 2) == 0) return 'b';
-    if (strncmp(two_bits, "10", 2) == 0) return 'c';
-    if (strncmp(two_bits, "11", 2) == 0) return 'd';
-    return '?'; /* invalid input */
-}
+/* Builds the first word of every opcode and operand mode pair at compile time */
+#define FIRST_WORD(op, s, t) (((op) << 6) | ((s) << 4) | ((t) << 2))
+#define FIRST_WORDS_1(op, s) {FIRST_WORD(op, s, 0), FIRST_WORD(op, s, 1), FIRST_WORD(op, s, 2), FIRST_WORD(op, s, 3)}
+#define FIRST_WORDS_2(op) {FIRST_WORDS_1(op, 0), FIRST_WORDS_1(op, 1), FIRST_WORDS_1(op, 2), FIRST_WORDS_1(op, 3)}
 
 /*
- * Converts a 5-bit binary string to a special base 4 string.
- * Validates the input string and returns the corresponding base 4 string.
+ * First word of every instruction: opcode in bits 6-9, source mode in
+ * bits 4-5 and destination mode in bits 2-3, indexed [opcode][src][dst].
  */
-char* binary_to_special_base4(const char *word) {
-    char *result = (char *)safe_malloc(6, "Memory allocation failed in binary_to_special_base4");  /* 5 chars + null terminator */
-    int i;
-    if (!result) return NULL;
-
-    for (i = 0; i < 5; i++) {
-        result[i] = bin_to_base4char(word + (i * 2));
-    }
-    result[5] = '\0';
-    return result;
-}
+const unsigned short FIRST_WORDS[NUM_OPCODES][4][4] = {
+    FIRST_WORDS_2(0),  FIRST_WORDS_2(1),  FIRST_WORDS_2(2),  FIRST_WORDS_2(3),
+    FIRST_WORDS_2(4),  FIRST_WORDS_2(5),  FIRST_WORDS_2(6),  FIRST_WORDS_2(7),
+    FIRST_WORDS_2(8),  FIRST_WORDS_2(9),  FIRST_WORDS_2(10), FIRST_WORDS_2(11),
+    FIRST_WORDS_2(12), FIRST_WORDS_2(13), FIRST_WORDS_2(14), FIRST_WORDS_2(15)
+};
+
+/* Builds the word of every register pair at compile time */
+#define REGISTER_WORD(s, t) (((s) << 6) | ((t) << 2))
+#define REGISTER_WORDS_1(s) {REGISTER_WORD(s, 0), REGISTER_WORD(s, 1), REGISTER_WORD(s, 2), REGISTER_WORD(s, 3), \
+                             REGISTER_WORD(s, 4), REGISTER_WORD(s, 5), REGISTER_WORD(s, 6), REGISTER_WORD(s, 7)}
 
 /*
- * Converts an address to a base 4 string.
- * Validates the input address and returns the corresponding base 4 string.
+ * Register word of every source and target register pair: the source
+ * in bits 6-9 and the target in bits 2-5, indexed [source][target].
+ * Row 0 and column 0 give the words of a single target or source.
  */
-char* address_to_base4(int address) {
-    char *result = (char *)safe_malloc(5, "Memory allocation failed in address_to_base4");  /* 4 chars + null terminator */
-    int i;
-    if (!result) return NULL;
-
-    /* Convert address to base 4 (4 characters) */
-    for (i = 0; i < 4; i++) {
-        int digit = (address >> (6 - i * 2)) & 3;  /* Extract 2 bits at position 6-i*2 */
-        switch (digit) {
-            case 0: result[i] = 'a'; break;  /* 00 -> 'a' */
-            case 1: result[i] = 'b'; break;  /* 01 -> 'b' */
-            case 2: result[i] = 'c'; break;  /* 10 -> 'c' */
-            case 3: result[i] = 'd'; break;  /* 11 -> 'd' */
-        }
-    }
-    result[4] = '\0';
-    return result;
-}
+const unsigned short REGISTER_WORDS[8][8] = {
+    REGISTER_WORDS_1(0), REGISTER_WORDS_1(1), REGISTER_WORDS_1(2), REGISTER_WORDS_1(3),
+    REGISTER_WORDS_1(4), REGISTER_WORDS_1(5), REGISTER_WORDS_1(6), REGISTER_WORDS_1(7)
+};
 
-/*
- * Converts a header address to a base 4 string.
- * Validates the input address and returns the corresponding base 4 string.
- */
-char* header_address_to_base4(int address) {
-    char *result = (char *)safe_malloc(4, "Memory allocation failed in header_address_to_base4");  /* 3 chars + null terminator */
-    int i;
-    if (!result) return NULL;
-
-    /* Convert address to base 4 (3 characters for header) */
-    for (i = 0; i < 3; i++) {
-        int digit = (address >> (4 - i * 2)) & 3;
-        switch (digit) {
-            case 0: result[i] = 'a'; break;
-            case 1: result[i] = 'b'; break;
-            case 2: result[i] = 'c'; break;
-            case 3: result[i] = 'd'; break;
-        }
-    }
-    result[3] = '\0';
-    return result;
-}
+/* Base-4 digit alphabet - digit value selects the letter */
+const char BASE4_DIGITS[4] = {'a', 'b', 'c', 'd'};
+
+/* Builds the 4 digit strings for every byte value at compile time */
+#define BASE4_1(p) p "a", p "b", p "c", p "d"
+#define BASE4_2(p) BASE4_1(p "a"), BASE4_1(p "b"), BASE4_1(p "c"), BASE4_1(p "d")
+#define BASE4_3(p) BASE4_2(p "a"), BASE4_2(p "b"), BASE4_2(p "c"), BASE4_2(p "d")
 
 /*
- * Converts a header code to a base 4 string.
- * Validates the input code and returns the corresponding base 4 string.
+ * Base-4 form of every 8-bit value, most significant digit first.
+ * A 10-bit word is one digit from BASE4_DIGITS followed by the quad of
+ * its low byte; shorter fields use the tail of a quad.
  */
-char* header_code_to_base4(int code) {
-    char *result = (char *)safe_malloc(3, "Memory allocation failed in header_code_to_base4");  /* 2 chars + null terminator */
-    int i;
-    if (!result) return NULL;
-
-    /* Convert code to base 4 (2 characters for header) */
-    for (i = 0; i < 2; i++) {
-        int digit = (code >> (2 - i * 2)) & 3;
-        switch (digit) {
-            case 0: result[i] = 'a'; break;
-            case 1: result[i] = 'b'; break;
-            case 2: result[i] = 'c'; break;
-            case 3: result[i] = 'd'; break;
-        }
-    }
-    result[2] = '\0';
-    return result;
-}
\ No newline at end of file
+const char BASE4_QUADS[256][5] = {
+    BASE4_3("a"), BASE4_3("b"), BASE4_3("c"), BASE4_3("d")
+};
@@ -0,0 +1,241 @@
+/*
+ * diag.c - Buffered diagnostics
+ * 
+ * This file implements message reporting for the assembler. Each thread
+ * can route its reports into its own Diagnostics buffer; a thread that
+ * has not routed them prints straight to stderr. It handles:
+ * - printf-style formatting into a growing buffer
+ * - "file:line:" prefixes and error counting for errors and warnings
+ * - Translating expanded lines back to their source and macro call
+ * - Stopping a file once it reaches its error limit
+ * - Per-thread routing through a thread-specific key
+ * - Writing a buffer out in one call
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "diag.h"
+#include "macros.h"
+#include "helpers.h"
+
+#define INITIAL_DIAG_CAPACITY 1024  /* Bytes allocated on first report */
+#define MESSAGE_RESERVE 256         /* Room kept free for a typical message */
+#define MAX_MESSAGE 512             /* Longest error or warning text kept */
+
+static pthread_key_t diag_key;                      /* Current buffer of each thread */
+static pthread_once_t diag_once = PTHREAD_ONCE_INIT; /* Guards creating diag_key */
+
+/*
+ * Creates the thread-specific key, called once by pthread_once.
+ */
+static void make_diag_key(void) {
+    pthread_key_create(&diag_key, NULL);
+}
+
+/*
+ * Makes room for at least extra more bytes, doubling the capacity.
+ */
+static void grow_diagnostics(Diagnostics *diag, size_t extra) {
+    size_t new_capacity = diag->capacity ? diag->capacity : INITIAL_DIAG_CAPACITY;
+
+    while (new_capacity < diag->length + extra) {
+        new_capacity *= 2;
+    }
+    diag->text = (char*)safe_realloc(diag->text, new_capacity,
+                                     "Memory allocation failed in grow_diagnostics");
+    diag->capacity = new_capacity;
+}
+
+/*
+ * init_diagnostics - Prepares an empty buffer with no memory allocated
+ */
+void init_diagnostics(Diagnostics *diag) {
+    diag->text = NULL;
+    diag->length = 0;
+    diag->capacity = 0;
+    diag->source = NULL;
+    diag->origins = NULL;
+    diag->errors = 0;
+    diag->max_errors = 0;
+}
+
+/*
+ * route_diagnostics - Sends the reports of the calling thread to diag.
+ * Passing NULL makes the thread print to stderr again.
+ */
+void route_diagnostics(Diagnostics *diag) {
+    pthread_once(&diag_once, make_diag_key);
+    pthread_setspecific(diag_key, diag);
+}
+
+/*
+ * routed_diagnostics - Returns the buffer the calling thread reports
+ * into, or NULL if it prints to stderr
+ */
+Diagnostics* routed_diagnostics(void) {
+    pthread_once(&diag_once, make_diag_key);
+    return (Diagnostics*)pthread_getspecific(diag_key);
+}
+
+/*
+ * report - Formats a message like printf and appends it to the calling
+ * thread's buffer, or prints it to stderr if the thread has none.
+ */
+void report(const char *format, ...) {
+    Diagnostics *diag;
+    va_list args;
+    int needed;
+
+    pthread_once(&diag_once, make_diag_key);
+    diag = (Diagnostics*)pthread_getspecific(diag_key);
+
+    if (diag == NULL) {
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+        return;
+    }
+
+    if (diag->capacity - diag->length < MESSAGE_RESERVE) {
+        grow_diagnostics(diag, MESSAGE_RESERVE);
+    }
+    va_start(args, format);
+    needed = vsnprintf(diag->text + diag->length, diag->capacity - diag->length, format, args);
+    va_end(args);
+    if (needed < 0) {
+        return;
+    }
+
+    /* The message did not fit: grow and format it again */
+    if ((size_t)needed >= diag->capacity - diag->length) {
+        grow_diagnostics(diag, (size_t)needed + 1);
+        va_start(args, format);
+        vsnprintf(diag->text + diag->length, diag->capacity - diag->length, format, args);
+        va_end(args);
+    }
+    diag->length += (size_t)needed;
+}
+
+/*
+ * report_text - Reports length bytes of messages that are already
+ * formatted, such as messages collected in another buffer
+ */
+void report_text(const char *text, size_t length) {
+    Diagnostics *diag = routed_diagnostics();
+
+    if (length == 0) {
+        return;
+    }
+    if (diag == NULL) {
+        fwrite(text, 1, length, stderr);
+        return;
+    }
+    if (diag->capacity - diag->length < length) {
+        grow_diagnostics(diag, length);
+    }
+    memcpy(diag->text + diag->length, text, length);
+    diag->length += length;
+}
+
+/*
+ * Reports "source:line: kind: message", leaving out the parts that are
+ * not known. The message is formatted first so the whole line is added
+ * at once. An expanded line is reported at its line in the source, and
+ * a line expanded from a macro is followed by a note naming the call.
+ */
+static void report_located(Diagnostics *diag, const char *kind, int line, const char *format, va_list args) {
+    char message[MAX_MESSAGE];
+    const char *source = diag != NULL && diag->source != NULL ? diag->source : NULL;
+    const LineOrigin *origin = diag != NULL ? find_origin(diag->origins, line) : NULL;
+
+    vsnprintf(message, sizeof(message), format, args);
+    if (source != NULL && origin != NULL && origin->macro != NULL) {
+        report("%s:%d: %s: %s%s:%d: Note: in expansion of mcro %s\n", source, origin->line, kind, message,
+               source, origin->call_line, origin->macro->name);
+    }
+    else if (source != NULL && origin != NULL) {
+        report("%s:%d: %s: %s", source, origin->line, kind, message);
+    }
+    else if (source != NULL && line > 0) {
+        report("%s:%d: %s: %s", source, line, kind, message);
+    }
+    else if (source != NULL) {
+        report("%s: %s: %s", source, kind, message);
+    }
+    else if (line > 0) {
+        report("line %d: %s: %s", line, kind, message);
+    }
+    else {
+        report("%s: %s", kind, message);
+    }
+}
+
+/*
+ * report_error - Reports an error at the given line of the current
+ * source, or with no line if it is 0. Once the file reaches its error
+ * limit, a last message says so and later errors are dropped.
+ */
+void report_error(int line, const char *format, ...) {
+    Diagnostics *diag = routed_diagnostics();
+    va_list args;
+
+    if (diag != NULL && diag->max_errors > 0 && diag->errors >= diag->max_errors) {
+        return;
+    }
+    va_start(args, format);
+    report_located(diag, "Error", line, format, args);
+    va_end(args);
+
+    if (diag != NULL && ++diag->errors == diag->max_errors) {
+        report("%s: stopping after %d errors\n", diag->source != NULL ? diag->source : "input", diag->errors);
+    }
+}
+
+/*
+ * report_warning - Reports a warning at the given line of the current
+ * source. Warnings are not counted, and are dropped once the file has
+ * stopped.
+ */
+void report_warning(int line, const char *format, ...) {
+    Diagnostics *diag = routed_diagnostics();
+    va_list args;
+
+    if (diag != NULL && diag->max_errors > 0 && diag->errors >= diag->max_errors) {
+        return;
+    }
+    va_start(args, format);
+    report_located(diag, "Warning", line, format, args);
+    va_end(args);
+}
+
+/*
+ * error_limit_reached - Checks if the file the calling thread assembles
+ * has reported its maximum number of errors, so the passes can stop.
+ */
+int error_limit_reached(void) {
+    Diagnostics *diag = routed_diagnostics();
+    return diag != NULL && diag->max_errors > 0 && diag->errors >= diag->max_errors;
+}
+
+/*
+ * flush_diagnostics - Writes the collected messages to stream in one
+ * call and leaves the buffer empty for reuse.
+ */
+void flush_diagnostics(Diagnostics *diag, FILE *stream) {
+    if (diag->length > 0) {
+        fwrite(diag->text, 1, diag->length, stream);
+    }
+    diag->length = 0;
+}
+
+/*
+ * destroy_diagnostics - Frees the text and leaves the buffer empty
+ */
+void destroy_diagnostics(Diagnostics *diag) {
+    free(diag->text);
+    init_diagnostics(diag);
+}
@@ -0,0 +1,47 @@
+/*
+ * diag.h - Buffered diagnostics header
+ * 
+ * This header file declares the Diagnostics buffer that collects the
+ * messages reported while one file is assembled, so each file's messages
+ * are written in one call and files assembled on different threads can
+ * still print their messages in order.
+ */
+
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+struct OriginTable;             /* Line origins of an expanded source, from macros.h */
+
+/*
+ * Diagnostics - Growing text buffer of reported messages. Errors and
+ * warnings are prefixed with the source name and line, and are counted
+ * so a file can be stopped after max_errors errors. While origins is
+ * set, the lines reported are lines of the expanded source and are
+ * translated back to the lines of source they came from.
+ */
+typedef struct Diagnostics {
+    char *text;                 /* Messages, not null-terminated */
+    size_t length;              /* Bytes used in text */
+    size_t capacity;            /* Bytes allocated for text */
+    const char *source;         /* File named in error and warning prefixes */
+    const struct OriginTable *origins; /* Origins of the reported lines, NULL if they are source lines */
+    int errors;                 /* Errors reported since the last reset */
+    int max_errors;             /* Stop after this many errors, 0 for no limit */
+}Diagnostics;
+
+/* Diagnostics functions */
+void init_diagnostics(Diagnostics *diag);                /* Prepares an empty buffer */
+void route_diagnostics(Diagnostics *diag);               /* Sends this thread's reports to diag, NULL for stderr */
+Diagnostics* routed_diagnostics(void);                   /* This thread's buffer, NULL for stderr */
+void report(const char *format, ...);                    /* Reports a printf-style message */
+void report_text(const char *text, size_t length);       /* Reports text that is already formatted */
+void report_error(int line, const char *format, ...);    /* Reports an error at a source line, 0 for none */
+void report_warning(int line, const char *format, ...);  /* Reports a warning at a source line */
+int error_limit_reached(void);                           /* Checks if this thread's file hit max_errors */
+void flush_diagnostics(Diagnostics *diag, FILE *stream); /* Writes the buffer out and empties it */
+void destroy_diagnostics(Diagnostics *diag);             /* Frees the buffer */
+
+#endif /* DIAG_H */
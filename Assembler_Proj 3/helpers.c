@@ -5,7 +5,6 @@
  * - Memory management (safe allocation)
  * - String manipulation and parsing
  * - Symbol and directive validation
- * - Operand type checking
  * - File name manipulation
  */
 
@@ -17,6 +16,8 @@
 #include "macros.h"
 #include "helpers.h"
 #include "decode.h"
+#include "diag.h"
+#include "stats.h"
 
 /*
  * Allocates memory and exits with error message if allocation fails.
@@ -24,13 +25,28 @@
  */
 void* safe_malloc(size_t size, const char* error_msg) {
     void* ptr = malloc(size);
+    STAT_ADD(bytes_allocated, size);
     if (ptr == NULL) {
-        printf("ERROR: %s\n", error_msg);
+        fprintf(stderr, "ERROR: %s\n", error_msg);
         exit(1);
     }
     return ptr;
 }
 
+/*
+ * Resizes a block to size bytes, like realloc, and exits with error
+ * message if that fails. The new size is counted as allocated.
+ */
+void* safe_realloc(void* ptr, size_t size, const char* error_msg) {
+    void* new_ptr = realloc(ptr, size);
+    STAT_ADD(bytes_allocated, size);
+    if (new_ptr == NULL) {
+        fprintf(stderr, "ERROR: %s\n", error_msg);
+        exit(1);
+    }
+    return new_ptr;
+}
+
 /*
  * Concatenates a base filename with an extension to create
  * a complete filename (e.g., "file" + ".ob" = "file.ob")
@@ -43,20 +59,29 @@ char* create_filename(const char* base_name, const char* extension) {
 }
 
 /*
- * Advances the index past spaces and tabs, returning the position
- * of the next non-whitespace character or special return values
- * for end-of-line, comma, or bracket characters.
+ * FNV-1a hash of the first length characters of text, used by the
+ * symbol and macro tables. Kept to 32 bits so it is the same on every
+ * platform.
  */
-int space_skip(const char*line,int i) {
+unsigned long hash_text(const char *text, size_t length) {
+    unsigned long hash = 2166136261UL;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+    }
+    return hash;
+}
+
+/*
+ * Advances the index past spaces and tabs and returns the position of
+ * the next character. Unlike space_skip it never returns a special
+ * value, so the result can always be used to index the line.
+ */
+int skip_spaces(const char *line, int i) {
     while (line[i] == ' ' || line[i] == '\t') {
-        i+=1;
+        i += 1;
     }
-    if (line[i] == '\n' || line[i] == '\r' || line[i] == '\0')
-        return -2;
-    if (line[i] == ',')
-        return -1;
-    if (line[i] == '[')
-        return -3;
     return i;
 }
 
@@ -93,22 +118,39 @@ int is_symbol(const char * line, int i) {
 
 
 
+/* Directive names, indexed by the value is_directive returns */
+static const char *DIRECTIVES[6] = {
+    NULL, ".data", ".string", ".mat", ".extern", ".entry"
+};
+
 /*
- * Checks if the string starting at position i matches any of the
- * supported assembly directives (.data, .string, .mat, .extern, .entry)
+ * Checks if the string starting at position i is one of the supported
+ * assembly directives (.data, .string, .mat, .extern, .entry) followed by
+ * whitespace or the end of the line. The second character selects the
+ * only possible candidate, which is then confirmed with one comparison.
+ * Returns 1-5 for the directive, or 0 if there is none.
  */
 int is_directive(const char *line, int i){
-    if (strncmp(line+i,".data ",5) ==0)
-        return 1;
-    if (strncmp(line+i,".string ",7) ==0)
-        return 2;
-    if (strncmp(line+i,".mat ",4) ==0)
-        return 3;
-    if (strncmp(line+i,".extern ",7) ==0)
-        return 4;
-    if (strncmp(line+i,".entry ",6) ==0)
-        return 5;
-    return 0;
+    int directive;
+    int length;
+    char next;
+
+    if (line[i] != '.')
+        return 0;
+    switch (line[i+1]) {
+        case 'd': directive = 1; break;                              /* .data */
+        case 's': directive = 2; break;                              /* .string */
+        case 'm': directive = 3; break;                              /* .mat */
+        case 'e': directive = (line[i+2] == 'x') ? 4 : 5; break;     /* .extern, .entry */
+        default: return 0;
+    }
+    length = strlen(DIRECTIVES[directive]);
+    if (strncmp(line+i, DIRECTIVES[directive], length) != 0)
+        return 0;
+    next = line[i+length];
+    if (next != ' ' && next != '\t' && next != '\n' && next != '\r' && next != '\0')
+        return 0;
+    return directive;
 }
 
 /*
@@ -126,7 +168,6 @@ int is_number(char* line, int index) {
     }
 
     if (!isdigit(line[i])) {
-        printf("is_number: Not a digit after sign\n");
         return 0;
     }
 
@@ -139,8 +180,7 @@ int is_number(char* line, int index) {
         return 1;
     }
 
-    printf("is_number: Unexpected character after number: '%c'\n", line[i]);
-    return 0;
+    return 0; /* The caller reports the error with its line */
 }
 
 
@@ -152,59 +192,59 @@ int is_number(char* line, int index) {
  * - Valid number format for each value
  */
 int is_legal_data_or_matrix_initialization(const char *line, int i, int line_num) {
-    char tmp[MAX_NUM_LENGTH + 1]; /* Max 10-bit number as string */
+    char tmp[MAX_NUM_LENGTH + 2]; /* Max 10-bit number as string, plus one char to detect overlong ones */
     int j;
 
     while (line[i] != '\0' && line[i] != '\n') {
         j = 0;
 
         /* Skip leading whitespace */
-        i = space_skip(line, i);
+        i = skip_spaces(line, i);
 
         /* Check for leading comma */
         if (line[i] == ',') {
-            printf("Error: Leading comma at line %d\n", line_num);
+            report_error(line_num, "Leading comma\n");
             return 0;
         }
 
         /* Read number into tmp */
-        while (!isspace(line[i]) && line[i] != ',' && line[i] != '\0' && line[i] != '\n' && j <= MAX_NUM_LENGTH) {
+        while (!isspace((unsigned char)line[i]) && line[i] != ',' && line[i] != '\0' && line[i] != '\n' && j <= MAX_NUM_LENGTH) {
             tmp[j++] = line[i++];
         }
 
         if (j == 0) {
-            printf("Error: Missing number or double comma at line %d\n", line_num);
+            report_error(line_num, "Missing number or double comma\n");
             return 0;
         }
 
         tmp[j] = '\0';
 
         if (j > MAX_NUM_LENGTH) {
-            printf("Error: Number too long at line %d\n", line_num);
+            report_error(line_num, "Number too long\n");
             return 0;
         }
 
         if (!is_number(tmp, 0)) {
-            printf("Error: Not a valid number: %s at line %d\n", tmp, line_num);
+            report_error(line_num, "Not a valid number: %s\n", tmp);
             return 0;
         }
 
-        i = space_skip(line, i); /* skip space after number */
+        i = skip_spaces(line, i); /* skip space after number */
 
         if (line[i] == ',') {
             i++; /* skip the comma */
-            i = space_skip(line, i); /* skip spaces after comma */
-            if (line[i] == '\0' || line[i] == '\n') {
-                printf("Error: Trailing comma at line %d\n", line_num);
+            i = skip_spaces(line, i); /* skip spaces after comma */
+            if (line[i] == '\0' || line[i] == '\n' || line[i] == '\r') {
+                report_error(line_num, "Trailing comma\n");
                 return 0;
             }
             /* Check for double comma after skipping spaces */
             if (line[i] == ',') {
-                printf("Error: Double comma at line %d\n", line_num);
+                report_error(line_num, "Double comma\n");
                 return 0;
             }
-        } else if (line[i] != '\0' && line[i] != '\n') {
-            printf("Error: Missing comma between values at line %d\n", line_num);
+        } else if (line[i] != '\0' && line[i] != '\n' && line[i] != '\r') {
+            report_error(line_num, "Missing comma between values\n");
             return 0;
         } else {
             /* End of line - this is valid */
@@ -216,41 +256,6 @@ int is_legal_data_or_matrix_initialization(const char *line, int i, int line_num
 }
 
 
-/*
- * Checks if the string starting at position i follows proper string syntax:
- * - Must start with double quote
- * - Must end with double quote
- * - No characters after closing quote except whitespace
- */
-int is_legal_string(const char *line, int i, int line_num) {
-    if (line[i] != '\"') {
-        printf("Error: String must start with '\"' at line %d\n", line_num);
-        return 0;
-    }
-
-    i++;  /* Skip the opening quote */
-
-    /* Look for closing quote */
-    while (line[i] != '\0' && line[i] != '\"') {
-        i++;
-    }
-
-    if (line[i] != '\"') {
-        printf("Error: Missing closing '\"' in string at line %d\n", line_num);
-        return 0;
-    }
-
-    i = space_skip(line, i + 1); /* Skip after closing quote */
-
-    if (line[i] != '\0') {
-        printf("Error: Unexpected characters after string at line %d\n", line_num);
-        return 0;
-    }
-
-    return 1;
-}
-
-
 /*
  * Validates comma usage in data initialization strings:
  * - No comma at the beginning
@@ -286,22 +291,22 @@ int contains_invalid_commas(const char *line, int index) {
     i = index;
     while (line[i] == ' ' || line[i] == '\t') i++;
     
-    while (i < strlen(line) && line[i] != '\n' && line[i] != '\0') {
+    while (line[i] != '\n' && line[i] != '\0') {
         /* Skip to next non-whitespace character */
-        while (i < strlen(line) && (line[i] == ' ' || line[i] == '\t')) i++;
-        if (i >= strlen(line) || line[i] == '\n' || line[i] == '\0') break;
+        while (line[i] == ' ' || line[i] == '\t') i++;
+        if (line[i] == '\n' || line[i] == '\0') break;
         
         /* If we find a number */
         if (line[i] == '-' || line[i] == '+' || isdigit(line[i])) {
             /* Skip the number */
             if (line[i] == '-' || line[i] == '+') i++;
-            while (i < strlen(line) && isdigit(line[i])) i++;
+            while (isdigit(line[i])) i++;
             
             /* Skip whitespace after number */
-            while (i < strlen(line) && (line[i] == ' ' || line[i] == '\t')) i++;
+            while (line[i] == ' ' || line[i] == '\t') i++;
             
             /* If we're not at the end and the next character is not a comma, check if it's another number */
-            if (i < strlen(line) && line[i] != '\n' && line[i] != '\0' && line[i] != ',') {
+            if (line[i] != '\n' && line[i] != '\0' && line[i] != ',') {
                 if (line[i] == '-' || line[i] == '+' || isdigit(line[i])) {
                     return 1;  /* missing comma between numbers */
                 }
@@ -378,22 +383,22 @@ int get_data_comma_error_type(const char *line, int index) {
     i = index;
     while (line[i] == ' ' || line[i] == '\t') i++;
     
-    while (i < strlen(line) && line[i] != '\n' && line[i] != '\0') {
+    while (line[i] != '\n' && line[i] != '\0') {
         /* Skip to next non-whitespace character */
-        while (i < strlen(line) && (line[i] == ' ' || line[i] == '\t')) i++;
-        if (i >= strlen(line) || line[i] == '\n' || line[i] == '\0') break;
+        while (line[i] == ' ' || line[i] == '\t') i++;
+        if (line[i] == '\n' || line[i] == '\0') break;
         
         /* If we find a number */
         if (line[i] == '-' || line[i] == '+' || isdigit(line[i])) {
             /* Skip the number */
             if (line[i] == '-' || line[i] == '+') i++;
-            while (i < strlen(line) && isdigit(line[i])) i++;
+            while (isdigit(line[i])) i++;
             
             /* Skip whitespace after number */
-            while (i < strlen(line) && (line[i] == ' ' || line[i] == '\t')) i++;
+            while (line[i] == ' ' || line[i] == '\t') i++;
             
             /* If we're not at the end and the next character is not a comma, check if it's another number */
-            if (i < strlen(line) && line[i] != '\n' && line[i] != '\0' && line[i] != ',') {
+            if (line[i] != '\n' && line[i] != '\0' && line[i] != ',') {
                 if (line[i] == '-' || line[i] == '+' || isdigit(line[i])) {
                     return 4;  /* missing comma between numbers */
                 }
@@ -418,189 +423,81 @@ int is_legal_mat(const char * line, int i, int line_num) {
     int j = 0;
 
     if (line[i] != '[') {
-        printf("Error: Expected '[' after .mat at line %d\n", line_num);
+        report_error(line_num, "Expected '[' after .mat\n");
         return 0;
     }
 
     i++;  /* Skip '[' */
     j = 0;
-    while (line[i] != '\0' && line[i] != ']' && j < MAX_NUM_LENGTH) {
+    while (line[i] != '\0' && line[i] != '\n' && line[i] != ']' && j < MAX_NUM_LENGTH) {
         num[j++] = line[i++];
     }
     num[j] = '\0';
 
     if (line[i] != ']') {
-        printf("Error: Missing closing ']' in first dimension at line %d\n", line_num);
+        report_error(line_num, "Missing closing ']' in first dimension\n");
         return 0;
     }
 
     if (!is_number(num, 0)) {
-        printf("Error: Invalid number in first matrix dimension at line %d\n", line_num);
+        report_error(line_num, "Invalid number in first matrix dimension\n");
         return 0;
     }
     if (str_to_int(num) <= 0) {
-        printf("Error: Invalid number in first matrix dimension at line %d\n", line_num);
+        report_error(line_num, "Invalid number in first matrix dimension\n");
         return 0;
     }
 
     i++;  /* Skip ']' */
 
     if (line[i] != '[') {
-        printf("Error: Expected second '[' after first dimension at line %d\n", line_num);
+        report_error(line_num, "Expected second '[' after first dimension\n");
         return 0;
     }
 
     i++;  /* Skip '[' */
     j = 0;
-    while (line[i] != '\0' && line[i] != ']' && j < MAX_NUM_LENGTH) {
+    while (line[i] != '\0' && line[i] != '\n' && line[i] != ']' && j < MAX_NUM_LENGTH) {
         num[j++] = line[i++];
     }
     num[j] = '\0';
 
     if (line[i] != ']') {
-        printf("Error: Missing closing ']' in second dimension at line %d\n", line_num);
+        report_error(line_num, "Missing closing ']' in second dimension\n");
         return 0;
     }
 
     if (!is_number(num, 0)) {
-        printf("Error: Invalid number in second matrix dimension at line %d\n", line_num);
+        report_error(line_num, "Invalid number in second matrix dimension\n");
         return 0;
     }
     if (str_to_int(num) <= 0) {
-        printf("Error: Invalid number in second matrix dimension at line %d\n", line_num);
+        report_error(line_num, "Invalid number in second matrix dimension\n");
         return 0;
     }
 
     i++;  /* Skip final ']' */
-    i = space_skip(line, i);
+    i = skip_spaces(line, i);
 
     return is_legal_data_or_matrix_initialization(line, i, line_num);
 }
 
 
 /*
- * Checks if the string starting at position i represents a valid register:
- * - Must start with 'r' followed by a digit 0-7
- * - Must not be followed by alphanumeric characters
- * - Must end with valid delimiter (comma, newline, bracket, etc.)
+ * Reads the number of columns, the second dimension, of a matrix
+ * declaration that was already validated.
  */
-int is_register(const char *line, int i, int line_num) {
-    int skip_result;
-    
-    if (line == NULL) {
-        printf("is_register: line is NULL\n");
-        return 0;
-    }
-    if (i < 0 || i >= strlen(line) - 1) {
-        printf("is_register: index out of bounds\n");
-        return 0;
-    }
-    
-    if (line[i] == 'r' && line[i+1] >= '0' && line[i+1] <= '7') {
-        i += 2;
-        
-        if (i >= strlen(line) || isalnum(line[i])) {
-            return 0;
-        }
-        
-        skip_result = space_skip(line, i);
-        if (skip_result == -2)  /* newline or end of string */
-            return 2;
-        if (skip_result == -1)  /* comma */
-            return 1;
-        if (line[i] == ']')
-            return 3;
-        if (line[i] == '\n' || line[i] == '\0')
-            return 2;  /* Accept newline as valid delimiter */
-
-        /* Check if there's a missing comma after register */
-        if (line[i] != ' ' && line[i] != '\t' && line[i] != ',' && line[i] != '\n' && line[i] != '\0') {
-            printf("Error: Missing comma after register at line %d\n", line_num);
-        } else {
-            printf("Error: Invalid register format at line %d\n", line_num);
-        }
-    }
-    return 0;
-}
-
-/*
- * Checks if the string starting at position i represents a valid matrix operand:
- * - Must start with a valid symbol name
- * - Must be followed by two bracket-enclosed register indices
- * - Each index must be a valid register (r0-r7)
- * - Must end with valid delimiter (comma, newline, etc.)
- */
-int is_mat_operand(const char *line, int i, int line_num) {
-    int j;
-    i = is_symbol(line,i);
-    if (i == 0) {
-        return 0;
-    }
-    for (j = 0; j < 2 ; j++) {
-        if (line[i] != '[') {
-            if ( j == 1)
-                printf("Error: Invalid matrix operand format at line %d\n", line_num);
-            return 0;
-        }
-        i += 1;
-        if ( is_register(line,i, line_num) != 3) {
-            printf("Error: Invalid matrix index at line %d\n", line_num);
-            return 0;
-        }
+int matrix_columns(const char *line) {
+    int index = 0;
+    int dim;
 
-        i += 3;
-    }
-    if (space_skip(line,i) == -1)
-        return 1;
-    if (space_skip(line,i) == -2)
-        return 2;
-    if (space_skip(line,i) != i) {
-        /* Check if there's a missing comma after matrix operand */
-        if (line[i] != ' ' && line[i] != '\t' && line[i] != ',' && line[i] != '\n' && line[i] != '\0') {
-            printf("Error: Missing comma after matrix operand at line %d\n", line_num);
-        } else {
-            printf("Error: Invalid matrix operand syntax at line %d\n", line_num);
+    for (dim = 0; dim < 2; dim++) {
+        while (line[index] != '[') {
+            index++;
         }
+        index = skip_spaces(line, index + 1);
     }
-    return 0;
-}
-
-/*
- * Checks if the string starting at position i represents a valid immediate operand:
- * - Must start with '#' character
- * - Must be followed by a valid number
- * - Must end with valid delimiter (comma, newline, space, etc.)
- */
-int is_direct(const char *line, int i, int line_num) {
-    char num[MAX_NUM_LENGTH+1];
-    int j=0;
-    
-    if (line[i] != '#')
-        return 0;
-    i += 1;
-    while (line[i] != '\n' && line[i] != '\r' && line[i] != ',' && line[i] != ' '  && j <= MAX_NUM_LENGTH && line[i] != '\0') {
-        num[j] = line[i];
-        i+=1;
-        j+=1;
-    }
-    num[j] = '\0';
-    
-    if (!is_number(num, 0)) {
-        printf("Error: Invalid immediate value at line %d\n", line_num);
-        return 0;
-    }
-    if (space_skip(line,i) == -1)
-        return 1;
-    if (space_skip(line,i) == -2)
-        return 2;
-    /* Check if there's a missing comma after immediate value */
-    if (line[i] != ' ' && line[i] != '\t' && line[i] != ',' && line[i] != '\n' && line[i] != '\0') {
-        printf("Error: Missing comma after immediate value at line %d\n", line_num);
-    } else {
-        printf("Error: Invalid immediate addressing syntax at line %d\n", line_num);
-    }
-    return 0;
-
+    return str_to_int(line + index);
 }
 
 /*
@@ -615,16 +512,16 @@ int save_place(char *line, int line_num) {
         index ++;
     }
     index += 1;
-    index = space_skip(line,index);
+    index = skip_spaces(line,index);
     num1 = str_to_int(line + index);
     while (line[index] != '[') {
         index ++;
     }
     index += 1;
-    index = space_skip(line,index);
+    index = skip_spaces(line,index);
     num2 = str_to_int(line + index);
     if ( num1 < 0 || num2 < 0) {
-        printf("Error: Invalid matrix dimensions at line %d\n", line_num);
+        report_error(line_num, "Invalid matrix dimensions\n");
         return -1;
     }
     return num1 * num2;
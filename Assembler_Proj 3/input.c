@@ -2,37 +2,183 @@
  * input.c - File input operations
  * 
  * This file contains functions for reading and processing input files.
- * It provides a simple interface for reading lines from files with
- * proper buffer management and error handling.
+ * A source file is mapped into memory, or read with one call when it
+ * can't be mapped safely, and the preprocessor expands it into a
+ * SourceText buffer that the first pass reads without reopening the .am
+ * file. Both passes walk their buffer as line views found with memchr,
+ * so lines are parsed in place instead of being copied out one by one.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h> /* Added for strlen */
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "input.h"
+#include "helpers.h"
+
+#define INITIAL_SOURCE_CAPACITY 4096 /* Bytes allocated on first append */
+
+/*
+ * init_source - Prepares an empty source buffer with no memory allocated
+ */
+void init_source(SourceText *source) {
+    source->text = NULL;
+    source->length = 0;
+    source->capacity = 0;
+}
+
+/*
+ * Appends the given line to the end of the buffer.
+ */
+void append_source(SourceText *source, const char *line) {
+    append_source_bytes(source, line, strlen(line));
+}
 
 /*
- * Reads a single line from the specified file into the provided buffer.
- * The function handles end-of-file conditions and ensures the buffer
- * is properly null-terminated. Also validates that line length is not
- * more than 80 characters (excluding newline).
+ * Appends len bytes of text to the end of the buffer, doubling the
+ * capacity when it runs out so that building the whole file stays linear.
+ * One byte is kept free for the '\0' that follows the text.
  */
-int read_line(FILE *fp, char *buffer) {
-    int len;
-    
-    if (fgets(buffer, MAX_LINE_LENGTH + 1, fp) == NULL) {
-        return 0; /* EOF or error */
+void append_source_bytes(SourceText *source, const char *text, size_t len) {
+    size_t new_capacity;
+
+    if (source->length + len + 1 > source->capacity) {
+        new_capacity = source->capacity ? source->capacity : INITIAL_SOURCE_CAPACITY;
+        while (new_capacity < source->length + len + 1) {
+            new_capacity *= 2;
+        }
+        source->text = (char*)safe_realloc(source->text, new_capacity,
+                                           "Memory allocation failed in append_source");
+        source->capacity = new_capacity;
+    }
+    if (len > 0) {
+        memcpy(source->text + source->length, text, len);
     }
-    
-    /* Check line length - should be max 80 chars (excluding newline) */
-    len = strlen(buffer);
-    
-    if (len == MAX_LINE_LENGTH) {
-        printf("Error: Line too long (max 80 characters allowed)\n");
-        return 2; /* Return error */
+    source->length += len;
+    source->text[source->length] = '\0';
+}
+
+/*
+ * destroy_source - Frees the text and leaves the buffer empty
+ */
+void destroy_source(SourceText *source) {
+    free(source->text);
+    init_source(source);
+}
+
+/*
+ * Reads the whole file into a new buffer with as few reads as possible,
+ * starting from the size reported by fstat. Returns 1 on success.
+ */
+static int read_source_file(SourceFile *file, int fd, size_t size_hint) {
+    size_t capacity = size_hint + 1;
+    size_t length = 0;
+    char *data = (char*)safe_malloc(capacity, "Memory allocation failed in open_source_file");
+    ssize_t count;
+
+    while ((count = read(fd, data + length, capacity - length - 1)) > 0) {
+        length += (size_t)count;
+        if (length + 1 == capacity) {
+            data = (char*)safe_realloc(data, capacity * 2, "Memory allocation failed in open_source_file");
+            capacity *= 2;
+        }
     }
-    
-    return 1; /* success */
+    data[length] = '\0';
+    file->data = data;
+    file->size = length;
+    file->mapped = 0;
+    return 1;
 }
 
+/*
+ * Loads the named file into memory. A regular file is mapped when its
+ * last page has room to spare, since the system fills that room with
+ * zeros and the contents are then followed by '\0' for free. Other files
+ * are read into a buffer with the '\0' added.
+ * Returns 1 on success and 0 if the file can't be opened.
+ */
+int open_source_file(SourceFile *file, const char *filename) {
+    struct stat info;
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t size;
+    void *map;
+    int fd = open(filename, O_RDONLY);
+
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    size = S_ISREG(info.st_mode) ? (size_t)info.st_size : 0;
+    if (size > 0 && page_size > 0 && size % (size_t)page_size != 0) {
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            file->data = (char*)map;
+            file->size = size;
+            file->mapped = 1;
+            close(fd);
+            return 1;
+        }
+    }
+    read_source_file(file, fd, size > 0 ? size : INITIAL_SOURCE_CAPACITY);
+    close(fd);
+    return 1;
+}
+
+/*
+ * close_source_file - Unmaps or frees the contents of the file
+ */
+void close_source_file(SourceFile *file) {
+    if (file->mapped) {
+        munmap(file->data, file->size);
+    }
+    else {
+        free(file->data);
+    }
+    file->data = NULL;
+    file->size = 0;
+    file->mapped = 0;
+}
+
+/*
+ * Finds the line that starts at *position in text and advances *position
+ * past its newline. Returns 0 when there are no more lines.
+ */
+int next_line(const char *text, size_t size, size_t *position, LineView *line) {
+    const char *end;
+
+    if (*position >= size) {
+        return 0;
+    }
+    line->text = text + *position;
+    end = (const char*)memchr(line->text, '\n', size - *position);
+    line->length = end != NULL ? (size_t)(end - line->text) + 1 : size - *position;
+    *position += line->length;
+    return 1;
+}
+
+/*
+ * Checks that the line has at most 80 characters, not counting the
+ * newline or a carriage return just before it.
+ */
+int is_line_too_long(const LineView *line) {
+    size_t len = line->length;
+
+    if (len > 0 && line->text[len - 1] == '\n') {
+        len--;
+    }
+    if (len > 0 && line->text[len - 1] == '\r') {
+        len--;
+    }
+    return len > MAX_LINE_LENGTH - 1;
+}
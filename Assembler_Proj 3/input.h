@@ -7,9 +7,50 @@
 #ifndef INPUT_H
 #define INPUT_H
 
+#include <stddef.h>
+
 #define MAX_LINE_LENGTH 81
 
-/* File input functions */
-int read_line(FILE *fp, char *buffer);  /* Reads a line from file into buffer */
+/*
+ * SourceText - Expanded source kept in memory between the preprocessor
+ * and the first pass. A null character always follows the text, so the
+ * last line can be parsed in place like the others.
+ */
+typedef struct SourceText {
+    char *text;                 /* Expanded source, followed by '\0' */
+    size_t length;              /* Bytes used in text, without the '\0' */
+    size_t capacity;            /* Bytes allocated for text */
+} SourceText;
+
+/*
+ * SourceFile - Contents of a source file, mapped or read in one call.
+ * Like SourceText, the data is followed by a null character.
+ */
+typedef struct SourceFile {
+    char *data;                 /* File contents, followed by '\0' */
+    size_t size;                /* Bytes in the file */
+    int mapped;                 /* Nonzero if data is a memory mapping */
+} SourceFile;
+
+/*
+ * LineView - One line inside a source buffer. The text is not copied
+ * and ends with the newline, or with the buffer's '\0' on the last line.
+ */
+typedef struct LineView {
+    const char *text;           /* First character of the line */
+    size_t length;              /* Characters including the newline */
+} LineView;
+
+/* Source buffer functions */
+void init_source(SourceText *source);                           /* Prepares an empty source buffer */
+void append_source(SourceText *source, const char *line);       /* Appends a line to the buffer */
+void append_source_bytes(SourceText *source, const char *text, size_t length); /* Appends raw text */
+void destroy_source(SourceText *source);                        /* Frees the buffer */
+
+/* Source file and line functions */
+int open_source_file(SourceFile *file, const char *filename);   /* Maps or reads a whole file */
+void close_source_file(SourceFile *file);                       /* Releases the contents */
+int next_line(const char *text, size_t size, size_t *position, LineView *line); /* Finds the next line */
+int is_line_too_long(const LineView *line);                     /* Checks the 80 character limit */
 
-#endif /* INPUT_H */
\ No newline at end of file
+#endif /* INPUT_H */
@@ -0,0 +1,218 @@
+/*
+ * libassembler.c - In-memory assembler library
+ *
+ * This file implements the interface of libassembler.h on top of the
+ * Assembly context. The source is copied into a buffer of the handle and
+ * run through the same preprocessor and passes as the assembler program,
+ * with messages routed to the handle's buffer and no files written. The
+ * results are left in the context until the next call, so the handle's
+ * arena, images and buffers are reused and a warm handle hardly allocates.
+ * A successful result can be run on the handle's simulator.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libassembler.h"
+#include "assembly.h"
+#include "helpers.h"
+#include "input.h"
+#include "output.h"
+#include "diag.h"
+#include "sim.h"
+
+/*
+ * Assembler - Handle behind the opaque type of libassembler.h
+ */
+struct Assembler {
+    Assembly as;                /* Context holding the results of the last call */
+    SourceText source;          /* Copy of the caller's source, null-terminated */
+    AsmSymbol *symbols;         /* Symbols then external uses of the last call */
+    int symbol_capacity;        /* Number of entries allocated in symbols */
+    int max_errors;             /* Error limit of each call, 0 for no limit */
+    int assembled;              /* Set when the last call assembled without errors */
+    Machine machine;            /* Simulator of asm_run, holding its output */
+};
+
+/*
+ * asm_create - Creates a handle with an empty context
+ */
+Assembler* asm_create(void) {
+    Assembler *assembler = (Assembler*)safe_malloc(sizeof(Assembler), "Memory allocation error in asm_create");
+
+    init_assembly(&assembler->as);
+    init_source(&assembler->source);
+    assembler->symbols = NULL;
+    assembler->symbol_capacity = 0;
+    assembler->max_errors = 0;
+    assembler->assembled = 0;
+    init_machine(&assembler->machine);
+    return assembler;
+}
+
+/*
+ * asm_set_max_errors - Sets the error limit of the following calls
+ */
+void asm_set_max_errors(Assembler *assembler, int max_errors) {
+    assembler->max_errors = max_errors > 0 ? max_errors : 0;
+}
+
+/*
+ * Copies a list of symbols into rows of the symbols array starting at
+ * row, giving each the kind of its symbol type. Returns the next row.
+ */
+static int copy_symbols(AsmSymbol *rows, int row, const Symbol *head) {
+    const Symbol *current;
+
+    for (current = head; current != NULL; current = current->next) {
+        rows[row].name = current->name;
+        rows[row].address = current->value;
+        rows[row].kind = current->type;
+        row++;
+    }
+    return row;
+}
+
+/*
+ * Copies the external uses of the resolved relocation table into rows
+ * of the symbols array starting at row. Returns the next row.
+ */
+static int copy_externals(AsmSymbol *rows, int row, const RelocTable *relocs) {
+    const Relocation *reloc;
+    int i;
+
+    for (i = 0; i < relocs->count; i++) {
+        reloc = &relocs->entries[i];
+        if (reloc->kind == RELOC_EXTERNAL) {
+            rows[row].name = relocs->symbols[reloc->symbol].name;
+            rows[row].address = IC_START + reloc->offset;
+            rows[row].kind = ASM_SYMBOL_EXTERN;
+            row++;
+        }
+    }
+    return row;
+}
+
+/*
+ * Counts the symbols of a list
+ */
+static int count_symbols(const Symbol *head) {
+    int count = 0;
+
+    for (; head != NULL; head = head->next) {
+        count++;
+    }
+    return count;
+}
+
+/*
+ * This function assembles length bytes of source as if it were the file
+ * <name>.as and fills result with what the assembler would have written:
+ * the images, the symbols, the expanded source, the .ob text and the
+ * messages, whose lines are named after <name>.as and <name>.am.
+ * The results of the previous call on the handle are released first.
+ * Returns result->ok: nonzero if the source assembled without errors.
+ */
+int asm_assemble(Assembler *assembler, const char *name, const char *source, size_t length,
+                 AsmResult *result) {
+    Assembly *as = &assembler->as;
+    Diagnostics *outer = routed_diagnostics(); /* Where the caller's messages go */
+    SourceFile file;            /* View of the source copy */
+    char *filename = (char*)name;
+    int symbol_count;           /* Symbols plus external uses */
+    int row;
+    int error_flag;             /* Error flag */
+
+    /* Release the last results and copy the source behind its sentinel */
+    reset_assembly(as);
+    assembler->source.length = 0;
+    append_source_bytes(&assembler->source, source, length);
+    file.data = assembler->source.text;
+    file.size = length;
+    file.mapped = 0;
+
+    route_diagnostics(&as->messages);
+    as->messages.length = 0;
+    as->messages.errors = 0;
+    as->messages.max_errors = assembler->max_errors;
+    error_flag = assemble_source(as, &file, filename, 0);
+    route_diagnostics(outer);
+
+    /* Copy the symbols and external uses, whose names stay in the context's arena */
+    symbol_count = count_symbols(as->symbol_head) + as->relocations.externals;
+    if (symbol_count > assembler->symbol_capacity) {
+        free(assembler->symbols);
+        assembler->symbols = (AsmSymbol*)safe_malloc(sizeof(AsmSymbol) * symbol_count,
+                                                     "Memory allocation error in asm_assemble");
+        assembler->symbol_capacity = symbol_count;
+    }
+    row = copy_symbols(assembler->symbols, 0, as->symbol_head);
+    result->symbols = assembler->symbols;
+    result->symbol_count = row;
+    result->externals = assembler->symbols + row;
+    result->external_count = copy_externals(assembler->symbols, row, &as->relocations) - row;
+
+    result->ok = !error_flag;
+    assembler->assembled = result->ok;
+    result->code = as->code_image.words;
+    result->code_count = as->code_image.count;
+    result->data = as->data_image.words;
+    result->data_count = as->data_image.count;
+    result->expanded = as->expanded_source.text;
+    result->expanded_length = as->expanded_source.length;
+    result->object = NULL;
+    result->object_length = 0;
+    if (!error_flag) {
+        result->object_length = build_ob(&as->code_image, &as->data_image,
+                                         as->IC - IC_START, as->DC, &as->output);
+        result->object = as->output.text;
+    }
+    result->diagnostics = as->messages.text != NULL ? as->messages.text : "";
+    result->diagnostics_length = as->messages.length;
+    return result->ok;
+}
+
+/*
+ * This function runs the program of the last successful asm_assemble on
+ * the simulator until it stops, faults, or has run max_steps
+ * instructions (0 for no limit), and fills run with the final registers
+ * and the output. Returns nonzero if the program reached stop.
+ */
+int asm_run(Assembler *assembler, unsigned long max_steps, AsmRun *run) {
+    Assembly *as = &assembler->as;
+    Machine *machine = &assembler->machine;
+    int i;
+
+    machine->input = NULL;
+    if (!assembler->assembled) {
+        load_machine(machine, &as->code_image, &as->data_image, &as->matrices);
+        machine->state = SIM_FAULT;
+        machine->fault_address = IC_START;
+        strcpy(machine->fault, "the last source did not assemble");
+    }
+    else if (load_machine(machine, &as->code_image, &as->data_image, &as->matrices)) {
+        run_machine(machine, max_steps);
+    }
+
+    run->state = machine->state;
+    run->steps = machine->steps;
+    for (i = 0; i < SIM_REGISTERS; i++) {
+        run->registers[i] = machine->registers[i];
+    }
+    run->fault_address = machine->fault_address;
+    run->fault = machine->state == SIM_FAULT ? machine->fault : "";
+    run->output = machine->output.text;
+    run->output_length = machine->output.length;
+    return run->state == SIM_HALTED;
+}
+
+/*
+ * asm_destroy - Frees the handle with its context and results
+ */
+void asm_destroy(Assembler *assembler) {
+    destroy_assembly(&assembler->as);
+    destroy_source(&assembler->source);
+    free(assembler->symbols);
+    destroy_machine(&assembler->machine);
+    free(assembler);
+}
@@ -0,0 +1,92 @@
+/*
+ * libassembler.h - In-memory assembler library header
+ *
+ * This header file is the interface of libassembler.a. It assembles a
+ * source held in memory and returns the code and data images, the symbol
+ * tables, the object text and the messages in memory, without reading or
+ * writing any file, and can run the assembled program on the built-in
+ * simulator to check what it does. Each Assembler handle is independent, so different
+ * threads can assemble at the same time with one handle each.
+ */
+
+#ifndef LIBASSEMBLER_H
+#define LIBASSEMBLER_H
+
+#include <stddef.h>
+
+/* Symbol kinds, the same values as the assembler's symbol types */
+#define ASM_SYMBOL_DATA 1           /* Label of a data directive */
+#define ASM_SYMBOL_CODE 2           /* Label of an instruction */
+#define ASM_SYMBOL_ENTRY 3          /* Label named by .entry */
+#define ASM_SYMBOL_EXTERN 4         /* Name declared by .extern */
+
+/*
+ * AsmSymbol - One symbol, or one use of an external symbol
+ */
+typedef struct AsmSymbol {
+    const char *name;           /* Symbol name */
+    int address;                /* Address of the symbol, or of the word that uses it */
+    int kind;                   /* One of the ASM_SYMBOL_ kinds */
+}AsmSymbol;
+
+/*
+ * AsmResult - Everything produced for one source
+ *
+ * The pointers belong to the handle and stay valid until its next call
+ * to asm_assemble or asm_destroy. Without errors, code word i is at
+ * address 100 + i and data word i follows the code, at 100 + code_count
+ * + i; words are 10 bits wide.
+ */
+typedef struct AsmResult {
+    int ok;                             /* Nonzero if the source assembled without errors */
+    const unsigned short *code;         /* Instruction words */
+    int code_count;                     /* Number of instruction words (ICF) */
+    const unsigned short *data;         /* Data words */
+    int data_count;                     /* Number of data words (DCF) */
+    const AsmSymbol *symbols;           /* Defined and .extern symbols, in source order */
+    int symbol_count;                   /* Number of symbols */
+    const AsmSymbol *externals;         /* Uses of external symbols, as in the .ext file */
+    int external_count;                 /* Number of uses */
+    const char *expanded;               /* Source after macro expansion, as in the .am file */
+    size_t expanded_length;             /* Bytes of expanded */
+    const char *object;                 /* Base-4 object text, as in the .ob file, if ok */
+    size_t object_length;               /* Bytes of object */
+    const char *diagnostics;            /* Errors and warnings, one per line */
+    size_t diagnostics_length;          /* Bytes of diagnostics */
+}AsmResult;
+
+/* How a run ended, the same values as the simulator's states */
+#define ASM_RUN_HALTED 1            /* Reached stop */
+#define ASM_RUN_FAULT 2             /* Illegal instruction or memory access */
+#define ASM_RUN_LIMIT 3             /* Ran the most instructions allowed */
+
+/*
+ * AsmRun - Outcome of running the last assembled program
+ *
+ * The program runs with memory loaded from the images, registers and
+ * the zero flag cleared and no input (red reads -1). The semantics of
+ * each instruction are described in sim.h. The pointers stay valid until
+ * the next call on the handle.
+ */
+typedef struct AsmRun {
+    int state;                          /* One of the ASM_RUN_ states */
+    unsigned long steps;                /* Instructions executed */
+    unsigned short registers[8];        /* r0 to r7 at the end, 10-bit words */
+    int fault_address;                  /* Instruction that faulted, for ASM_RUN_FAULT */
+    const char *fault;                  /* What went wrong, "" unless ASM_RUN_FAULT */
+    const char *output;                 /* What prn printed, one value per line */
+    size_t output_length;               /* Bytes of output */
+}AsmRun;
+
+typedef struct Assembler Assembler;     /* Reusable assembler state */
+
+/* Library functions */
+Assembler* asm_create(void);                                 /* Creates a handle */
+void asm_set_max_errors(Assembler *assembler, int max_errors); /* Stops after max_errors errors, 0 for no limit */
+int asm_assemble(Assembler *assembler, const char *name, const char *source, size_t length,
+                 AsmResult *result);                         /* Assembles source, returns result->ok */
+int asm_run(Assembler *assembler, unsigned long max_steps,
+            AsmRun *run);                                    /* Runs the last result, nonzero if it stopped */
+void asm_destroy(Assembler *assembler);                      /* Frees the handle and its results */
+
+#endif /* LIBASSEMBLER_H */
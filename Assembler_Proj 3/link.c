@@ -0,0 +1,419 @@
+/*
+ * link.c - Module linker
+ *
+ * This file implements --link. Linking runs in four phases:
+ * 1. Loading: every <module>.bin is mapped and its header and tables are
+ *    checked, on a pool of -j threads.
+ * 2. Layout: the modules get their places in the linked code and data,
+ *    and their entries are added to one hash index of global symbols,
+ *    in command line order so duplicate entries are found reliably.
+ * 3. Relocation: every module copies its words into its own range of
+ *    the linked images, moving relocatable addresses and resolving the
+ *    uses of external symbols through the index, again on the pool.
+ * 4. Output: the linked images are written like an assembled file.
+ * The messages of each module are buffered and printed in module order.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "link.h"
+#include "assembly.h"
+#include "helpers.h"
+#include "input.h"
+#include "output.h"
+#include "decode.h"
+#include "diag.h"
+
+#define MAX_LINK_JOBS 256       /* Upper limit for -j, as for assembling */
+
+/*
+ * Module - One object file being linked
+ */
+typedef struct Module {
+    char *path;                 /* <name>.bin */
+    SourceFile file;            /* Mapped contents of the file */
+    int ok;                     /* Cleared when the module has an error */
+    int code_count;             /* Code words (ICF of the module) */
+    int data_count;             /* Data words (DCF of the module) */
+    int entry_count;            /* Rows in the entry table */
+    int extern_count;           /* Rows in the extern table */
+    const unsigned char *words; /* Code then data words, u16 each */
+    const unsigned char *entries; /* Entry rows: address, name offset */
+    const unsigned char *externs; /* Extern rows: address of the use, name offset */
+    const char *strings;        /* Names, null-terminated */
+    unsigned long strings_length; /* Bytes of names */
+    int code_base;              /* Index of the module's first code word in the linked code */
+    int data_base;              /* Index of its first data word in the linked data */
+    Diagnostics messages;       /* Messages about this module */
+}Module;
+
+/*
+ * Linker - State shared by the phases and the worker threads
+ */
+typedef struct Linker {
+    Module *modules;            /* Modules in command line order */
+    int count;                  /* Number of modules */
+    int next;                   /* Next module for a worker to take */
+    pthread_mutex_t lock;       /* Guards next */
+    void (*phase)(struct Linker *linker, Module *module); /* Work done on each module */
+    Arena arena;                /* Global symbols and their names */
+    SymbolIndex index;          /* Hash index of every entry by name */
+    Symbol *entry_head;         /* Entries of the linked program, in order */
+    Symbol *entry_tail;         /* Tail of the entries */
+    Image code;                 /* Linked code words */
+    Image data;                 /* Linked data words */
+}Linker;
+
+/*
+ * Reads a little-endian 16 or 32-bit field
+ */
+static unsigned int get_u16(const unsigned char *p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static unsigned long get_u32(const unsigned char *p) {
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+           ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+/*
+ * Returns the name at offset in the module's string table, or NULL if
+ * the offset does not start a null-terminated name inside the table
+ */
+static const char* module_name(const Module *module, unsigned long offset) {
+    if (offset >= module->strings_length ||
+        memchr(module->strings + offset, '\0', module->strings_length - offset) == NULL) {
+        return NULL;
+    }
+    return module->strings + offset;
+}
+
+/*
+ * Moves an address of the module to its place in the linked program.
+ * Code addresses move by the module's code base, data addresses follow
+ * all the linked code. Returns -1 if the address is outside the module.
+ */
+static int relocate(const Linker *linker, const Module *module, unsigned long address) {
+    unsigned long code_end = IC_START + (unsigned long)module->code_count;
+
+    if (address < IC_START || address >= code_end + (unsigned long)module->data_count) {
+        return -1;
+    }
+    if (address < code_end) {
+        return IC_START + module->code_base + (int)(address - IC_START);
+    }
+    return IC_START + linker->code.count + module->data_base + (int)(address - code_end);
+}
+
+/*
+ * Phase 1: maps the module's .bin file and checks that its header, its
+ * sizes and its tables are consistent
+ */
+static void load_module(Linker *linker, Module *module) {
+    const unsigned char *p;
+    unsigned long code_count;
+    unsigned long data_count;
+    unsigned long entry_count;
+    unsigned long extern_count;
+    unsigned long words_length;
+    unsigned long i;
+
+    report("Linking file: %s\n", module->path);
+    if (!open_source_file(&module->file, module->path)) {
+        report("Can't open file %s or it does not exist.\n", module->path);
+        module->ok = 0;
+        return;
+    }
+    p = (const unsigned char*)module->file.data;
+    if (module->file.size < BIN_HEADER_LENGTH || memcmp(p, BIN_MAGIC, 4) != 0 ||
+        get_u32(p + 4) != BIN_VERSION || get_u32(p + 8) != IC_START) {
+        report("%s: Error: not a binary object of this assembler\n", module->path);
+        module->ok = 0;
+        return;
+    }
+    code_count = get_u32(p + 12);
+    data_count = get_u32(p + 16);
+    entry_count = get_u32(p + 20);
+    extern_count = get_u32(p + 24);
+    module->strings_length = get_u32(p + 28);
+    words_length = ((code_count + data_count) * 2 + 3) & ~3UL;
+    if (code_count + data_count > module->file.size ||
+        entry_count + extern_count > module->file.size ||
+        BIN_HEADER_LENGTH + words_length + (entry_count + extern_count) * BIN_SYMBOL_LENGTH +
+        module->strings_length != module->file.size) {
+        report("%s: Error: the sizes in the header do not match the file\n", module->path);
+        module->ok = 0;
+        return;
+    }
+    module->code_count = (int)code_count;
+    module->data_count = (int)data_count;
+    module->entry_count = (int)entry_count;
+    module->extern_count = (int)extern_count;
+    module->words = p + BIN_HEADER_LENGTH;
+    module->entries = module->words + words_length;
+    module->externs = module->entries + entry_count * BIN_SYMBOL_LENGTH;
+    module->strings = (const char*)(module->externs + extern_count * BIN_SYMBOL_LENGTH);
+
+    for (i = 0; i < entry_count + extern_count; i++) {
+        if (module_name(module, get_u32(module->entries + i * BIN_SYMBOL_LENGTH + 4)) == NULL) {
+            report("%s: Error: symbol row %lu names no string\n", module->path, i + 1);
+            module->ok = 0;
+            return;
+        }
+    }
+}
+
+/*
+ * Phase 2, in module order: places the module after the previous ones
+ */
+static void place_module(Module *module, int *code_base, int *data_base) {
+    module->code_base = *code_base;
+    module->data_base = *data_base;
+    *code_base += module->code_count;
+    *data_base += module->data_count;
+}
+
+/*
+ * Adds the module's entries, at their linked addresses, to the global
+ * index. An entry already defined by an earlier module is an error.
+ */
+static void add_entries(Linker *linker, Module *module) {
+    const unsigned char *row;
+    const char *name;
+    Symbol *symbol;
+    int address;
+    int i;
+
+    for (i = 0; i < module->entry_count; i++) {
+        row = module->entries + i * BIN_SYMBOL_LENGTH;
+        name = module_name(module, get_u32(row + 4));
+        address = relocate(linker, module, get_u32(row));
+        if (address < 0) {
+            report("%s: Error: entry %s is outside the module\n", module->path, name);
+            module->ok = 0;
+            continue;
+        }
+        symbol = search_symbol(&linker->index, name);
+        if (symbol != NULL) {
+            report("%s: Error: entry %s is already defined by another module\n", module->path, name);
+            module->ok = 0;
+            continue;
+        }
+        symbol = add_symbol(&linker->entry_head, &linker->entry_tail, &linker->index, name);
+        set_type(symbol, 3);
+        set_value(symbol, address);
+    }
+}
+
+/*
+ * Phase 3: copies the module's words into its ranges of the linked
+ * images, moving every relocatable address word, and patches each use
+ * of an external symbol with the address of the entry that defines it
+ */
+static void relocate_module(Linker *linker, Module *module) {
+    unsigned short *code = linker->code.words + module->code_base;
+    unsigned short *data = linker->data.words + module->data_base;
+    const unsigned char *row;
+    const Symbol *symbol;
+    const char *name;
+    unsigned int word;
+    unsigned long use;
+    int address;
+    int i;
+
+    for (i = 0; i < module->code_count; i++) {
+        word = get_u16(module->words + i * 2) & WORD_MASK;
+        if ((word & 3) == ARE_RELOCATABLE) {
+            address = relocate(linker, module, (word >> 2) & 0xFF);
+            if (address < 0) {
+                report("%s: Error: word at address %d refers outside the module\n", module->path, IC_START + i);
+                module->ok = 0;
+                address = 0;
+            }
+            word = (decode_number_in_8_bits(address) << 2) | ARE_RELOCATABLE;
+        }
+        code[i] = (unsigned short)word;
+    }
+    for (i = 0; i < module->data_count; i++) {
+        data[i] = (unsigned short)(get_u16(module->words + (module->code_count + i) * 2) & WORD_MASK);
+    }
+
+    for (i = 0; i < module->extern_count; i++) {
+        row = module->externs + i * BIN_SYMBOL_LENGTH;
+        name = module_name(module, get_u32(row + 4));
+        use = get_u32(row);
+        if (use < IC_START || use >= IC_START + (unsigned long)module->code_count) {
+            report("%s: Error: use of %s is outside the module's code\n", module->path, name);
+            module->ok = 0;
+            continue;
+        }
+        symbol = search_symbol(&linker->index, name);
+        if (symbol == NULL) {
+            report("%s: Error: Undefined external symbol %s\n", module->path, name);
+            module->ok = 0;
+            continue;
+        }
+        code[use - IC_START] = (unsigned short)((decode_number_in_8_bits(symbol->value) << 2) | ARE_RELOCATABLE);
+    }
+}
+
+/*
+ * Worker thread: runs the current phase on the next module until none
+ * are left, with reports routed to that module's buffer
+ */
+static void* link_worker(void *arg) {
+    Linker *linker = (Linker*)arg;
+    Module *module;
+
+    while (1) {
+        pthread_mutex_lock(&linker->lock);
+        if (linker->next == linker->count) {
+            pthread_mutex_unlock(&linker->lock);
+            break;
+        }
+        module = &linker->modules[linker->next++];
+        pthread_mutex_unlock(&linker->lock);
+
+        route_diagnostics(&module->messages);
+        if (module->ok) {
+            linker->phase(linker, module);
+        }
+        route_diagnostics(NULL);
+    }
+    return NULL;
+}
+
+/*
+ * Runs phase on every module, on up to jobs threads
+ */
+static void run_phase(Linker *linker, void (*phase)(Linker*, Module*), int jobs) {
+    pthread_t threads[MAX_LINK_JOBS];
+    int num_of_threads = jobs < linker->count ? jobs : linker->count;
+    int i;
+
+    linker->phase = phase;
+    linker->next = 0;
+    if (num_of_threads > MAX_LINK_JOBS) {
+        num_of_threads = MAX_LINK_JOBS;
+    }
+    if (num_of_threads <= 1) {
+        link_worker(linker);
+        return;
+    }
+    for (i = 0; i < num_of_threads; i++) {
+        if (pthread_create(&threads[i], NULL, link_worker, linker) != 0) {
+            fprintf(stderr, "Error: can't create worker thread\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < num_of_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/*
+ * This function links the modules <module>.bin, in the order given,
+ * into <output>.ob (and <output>.bin when options->formats asks for
+ * it). The files are loaded and relocated on options->jobs threads.
+ * Messages are printed to stderr, each module's together. Returns 0 on
+ * success and 1 if any module could not be linked, in which case no
+ * output is written.
+ */
+int link_modules(char *output, char *modules[], int count, const Options *options) {
+    Linker linker;
+    OutputBuffer out;           /* Output files are formatted here */
+    size_t size;                /* Size of the file formatted in out */
+    RelocTable no_externs;      /* The linked program has no external uses */
+    int code_base = 0;          /* Linked code words placed so far */
+    int data_base = 0;          /* Linked data words placed so far */
+    int error_flag = 0;         /* Error flag */
+    int too_large;              /* Set if the program does not fit the address space */
+    int i;
+
+    linker.modules = (Module*)safe_malloc(sizeof(Module) * count, "Memory allocation error in link_modules");
+    linker.count = count;
+    pthread_mutex_init(&linker.lock, NULL);
+    init_arena(&linker.arena);
+    init_symbol_index(&linker.index, &linker.arena);
+    linker.entry_head = NULL;
+    linker.entry_tail = NULL;
+    init_image(&linker.code);
+    init_image(&linker.data);
+    for (i = 0; i < count; i++) {
+        linker.modules[i].path = create_filename(modules[i], ".bin");
+        linker.modules[i].file.data = NULL;
+        linker.modules[i].ok = 1;
+        init_diagnostics(&linker.modules[i].messages);
+    }
+
+    run_phase(&linker, load_module, options->jobs);
+
+    /* Lay the modules out and collect their entries, in order */
+    for (i = 0; i < count; i++) {
+        if (linker.modules[i].ok) {
+            place_module(&linker.modules[i], &code_base, &data_base);
+        }
+    }
+
+    /* Addresses are 8 bits, so the whole program must fit below ADDRESS_WORDS */
+    too_large = IC_START + code_base + data_base > ADDRESS_WORDS;
+    if (!too_large) {
+        append_image_words(&linker.code, code_base);
+        append_image_words(&linker.data, data_base);
+        for (i = 0; i < count; i++) {
+            if (linker.modules[i].ok) {
+                route_diagnostics(&linker.modules[i].messages);
+                add_entries(&linker, &linker.modules[i]);
+                route_diagnostics(NULL);
+            }
+        }
+
+        run_phase(&linker, relocate_module, options->jobs);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (!linker.modules[i].ok) {
+            error_flag = 1;
+        }
+        flush_diagnostics(&linker.modules[i].messages, stderr);
+        destroy_diagnostics(&linker.modules[i].messages);
+        if (linker.modules[i].file.data != NULL) {
+            close_source_file(&linker.modules[i].file);
+        }
+        free(linker.modules[i].path);
+    }
+
+    if (too_large) {
+        fprintf(stderr, "Error: the linked program takes %d words, but only %d fit after address %d\n",
+                code_base + data_base, ADDRESS_WORDS - IC_START, IC_START);
+        error_flag = 1;
+    }
+    if (error_flag) {
+        fprintf(stderr, "Can't finish linking %s.\n", output);
+    }
+    else {
+        init_output_buffer(&out);
+        init_relocations(&no_externs, &linker.arena);
+        if (options->formats & FORMAT_TEXT) {
+            size = build_ob(&linker.code, &linker.data, linker.code.count, linker.data.count, &out);
+            error_flag |= !write_output_file(output, ".ob", out.text, size);
+        }
+        if (options->formats & FORMAT_BIN) {
+            size = build_bin(&linker.code, &linker.data, linker.entry_head, &no_externs, &out);
+            error_flag |= !write_output_file(output, ".bin", out.text, size);
+        }
+        destroy_relocations(&no_externs);
+        destroy_output_buffer(&out);
+    }
+
+    destroy_image(&linker.code);
+    destroy_image(&linker.data);
+    destroy_symbol_index(&linker.index);
+    destroy_arena(&linker.arena);
+    pthread_mutex_destroy(&linker.lock);
+    free(linker.modules);
+    return error_flag;
+}
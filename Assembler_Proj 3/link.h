@@ -0,0 +1,21 @@
+/*
+ * link.h - Module linker header
+ *
+ * This header file declares the --link mode, which merges modules that
+ * were assembled separately with --format=bin into one program. The
+ * code of every module comes first, in command line order, followed by
+ * the data of every module. Each module's relocatable words and entries
+ * are moved to the new addresses, and every use of an external symbol
+ * is resolved against the entries of all modules through one hash
+ * table. The linked program is written as <output>.ob, and also as
+ * <output>.bin (keeping the entries) with --format=bin or both.
+ */
+
+#ifndef LINK_H
+#define LINK_H
+
+#include "assembly.h"
+
+int link_modules(char *output, char *modules[], int count, const Options *options); /* Links <module>.bin files */
+
+#endif /* LINK_H */
@@ -6,7 +6,9 @@
  * - Macro definition with "mcro" and "mcroend" directives
  * - Macro name validation against reserved instruction and directive names
  * - Macro expansion during preprocessing
- * - Memory management for macro structures
+ * - A hash table of macros, looked up straight from the source line
+ * - Macro bodies stored as one contiguous block of text in the arena
+ * - The origin of every expanded line, in the .as file and in macros
  * 
  * Macro syntax:
  *   mcro macro_name
@@ -21,57 +23,120 @@
 #include <stdio.h>
 #include "macros.h"
 #include "input.h"
+#include "arena.h"
+#include "helpers.h"
+#include "diag.h"
+#include "order.h"
+#include "stats.h"
 
 #include <stdlib.h>
 #include <string.h>
 
-/* Global macro list head - stores all defined macros */
-Macro* head = NULL;
+#define INITIAL_MACRO_CAPACITY 32   /* Starting number of hash slots */
 
 /*
- * Creates a new Macro structure with the given name and adds it to the
- * beginning of the global macro linked list. The macro is initialized
- * with an empty lines list.
+ * init_macro_table - Prepares an empty table with no slots allocated.
+ * Macros added to the table are taken from arena.
+ */
+void init_macro_table(MacroTable* table, Arena* arena) {
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+    table->arena = arena;
+}
+
+/*
+ * destroy_macro_table - Frees the slots; the macros themselves are
+ * released with the arena
+ */
+void destroy_macro_table(MacroTable* table) {
+    free(table->slots);
+    init_macro_table(table, table->arena);
+}
+
+/*
+ * Returns the slot that holds the macro named by the first length
+ * characters of name, or the empty slot where it belongs.
+ * Assumes the table has at least one free slot.
  */
-void add_macro(const char* name) {
-    Macro *new_macro = (Macro *) malloc(sizeof(Macro));
-    if (new_macro==NULL) {
-        printf("Memory error in add_macro()\n");
-        exit(1);
+static Macro** find_slot(const MacroTable* table, const char* name, size_t length, unsigned long hash) {
+    int mask = table->capacity - 1;
+    int i = (int)(hash & mask);
+    Macro *macro;
+
+    while ((macro = table->slots[i]) != NULL) {
+        if (macro->hash == hash && strlen(macro->name) == length &&
+            strncmp(macro->name, name, length) == 0) {
+            break;
+        }
+        i = (i + 1) & mask;
     }
-    new_macro->name = malloc(strlen(name) + 1);
-    if (!new_macro->name) {
-        printf("Memory allocation failed for macro name\n");
-        exit(1);
+    return &table->slots[i];
+}
+
+/*
+ * Doubles the number of slots and re-places every macro.
+ */
+static void grow_macro_table(MacroTable* table) {
+    MacroTable bigger;
+    int i;
+
+    bigger.capacity = table->capacity ? table->capacity * 2 : INITIAL_MACRO_CAPACITY;
+    bigger.slots = (Macro**)safe_malloc(sizeof(Macro*) * bigger.capacity, "Memory error in grow_macro_table()");
+    for (i = 0; i < bigger.capacity; i++) {
+        bigger.slots[i] = NULL;
+    }
+    for (i = 0; i < table->capacity; i++) {
+        if (table->slots[i] != NULL) {
+            Macro *macro = table->slots[i];
+            *find_slot(&bigger, macro->name, strlen(macro->name), macro->hash) = macro;
+        }
     }
-    strcpy(new_macro->name, name);
+    free(table->slots);
+    table->slots = bigger.slots;
+    table->capacity = bigger.capacity;
+}
+
+/*
+ * Creates a new Macro structure with the given name and adds it to the
+ * table. The macro starts with an empty body and lives in the table
+ * arena. A later definition with the same name replaces the earlier one.
+ */
+Macro* add_macro(MacroTable* table, const char* name) {
+    Macro *new_macro = (Macro *) arena_alloc(table->arena, sizeof(Macro), "Memory error in add_macro()");
+    Macro **slot;
+    size_t length = strlen(name);
+
+    new_macro->name = arena_strdup(table->arena, name);
+    new_macro->hash = hash_text(name, length);
 
     /* Initialize macro structure */
-    new_macro->lines_head = NULL;
-    new_macro->next = NULL;
-    
-    /* Add to beginning of global macro list */
-    if (head == NULL) {
-        head = new_macro;
+    new_macro->body = NULL;
+    new_macro->body_length = 0;
+    new_macro->line = 0;
+    new_macro->body_lines = 0;
+
+    /* Keep the table at most half full */
+    if ((table->count + 1) * 2 > table->capacity) {
+        grow_macro_table(table);
     }
-    else {
-        new_macro->next = head;
-        head = new_macro;
+    slot = find_slot(table, name, length, new_macro->hash);
+    if (*slot == NULL) {
+        table->count++;
     }
+    *slot = new_macro;
+    return new_macro;
 }
 
 /*
- * Traverses the macro linked list looking for a macro with the given name.
- * Returns the first matching macro found, or NULL if not found.
+ * Looks up the macro named by the first length characters of name.
+ * Returns the macro, or NULL if not found.
  */
-Macro* find_macro(Macro* head,const char* name) {
-    while (head != NULL) {
-        if (strcmp(head->name, name) == 0) {
-            return head;
-        }
-        head = head->next;
+Macro* find_macro(const MacroTable* table, const char* name, size_t length) {
+    if (table->count == 0) {
+        return NULL;
     }
-    return NULL;
+    return *find_slot(table, name, length, hash_text(name, length));
 }
 
 /* 
@@ -91,111 +156,102 @@ int is_macro_end(const char* line) {
 }
 
 /*
- * Extracts the first word from the line and checks if it matches
- * any defined macro name. Handles leading whitespace and extracts
- * the macro name up to the first space or newline.
+ * Checks if the first word of the line, after leading whitespace and up
+ * to the first space, tab, or newline, names a defined macro. The word
+ * is looked up in place without being copied. Returns the macro, or
+ * NULL if the line is not a macro call.
  */
-int is_macro_call(const Macro* head,const char* line) {
-    char macro_name[MAX_LINE_LENGTH];
-    int i = 0;
-    int j = 0;
+Macro* macro_call(const MacroTable* table, const char* line) {
+    size_t i = 0;
+    size_t start;
 
     /* Skip leading spaces and tabs */
     while (line[i] == ' ' || line[i] == '\t') {
         i++;
     }
 
-    /* Extract macro name (up to first space, tab, or newline) */
-    while (line[i] != '\0' && line[i] != ' ' && line[i] != '\t' && line[i] != '\n' && line[i] != '\r' && j < MAX_LINE_LENGTH - 1) {
-        macro_name[j] = line[i];
+    /* Find the end of the macro name */
+    start = i;
+    while (line[i] != '\0' && line[i] != ' ' && line[i] != '\t' && line[i] != '\n' && line[i] != '\r') {
         i++;
-        j++;
     }
-    macro_name[j] = '\0';
 
-    /* Check if this macro name exists in the macro list */
-    while (head != NULL) {
-        if (strcmp(head->name, macro_name) == 0) {
-            return 1;
-        }
-        head = head->next;
-    }
-    return 0;
+    return find_macro(table, line + start, i - start);
 }
 
 /*
- * Allocates and initializes a new LineNode structure with the given line.
- * The line is copied to avoid memory issues with the original string.
+ * Copies the collected body lines into the arena as one contiguous
+ * block, so the macro is expanded with a single copy.
  */
-LineNode* new_line_node(const char* line) {
-    LineNode *tmp = NULL;
-    tmp = (LineNode *)malloc(sizeof(LineNode));
-    if(tmp == NULL) {
-        printf("Memory error in new_line_node()\n");
-        return NULL;
+void finish_macro(Arena* arena, Macro* macro, const SourceText* body) {
+    size_t i;
+
+    macro->body_length = body->length;
+    macro->body_lines = 0;
+    for (i = 0; i < body->length; i++) {
+        if (body->text[i] == '\n') {
+            macro->body_lines++;
+        }
     }
-    tmp->line = (char *) malloc(strlen(line)+1);
-    if(tmp->line == NULL) {
-        printf("Memory error in new_line_node()\n");
-        free(tmp);
-        return NULL;
+    if (body->length > 0) {
+        macro->body = (char*)arena_alloc(arena, body->length, "Memory error in finish_macro()");
+        memcpy(macro->body, body->text, body->length);
     }
-    strcpy(tmp->line, line);
-    tmp->next = NULL;
+}
 
-    return tmp;
+/*
+ * init_origins - Prepares an empty origin table with nothing allocated
+ */
+void init_origins(OriginTable* table) {
+    table->origins = NULL;
+    table->count = 0;
+    table->capacity = 0;
 }
 
 /*
- * Adds the given line to the end of a macro's lines list.
- * If the macro has no lines yet, creates the first line node.
- * Otherwise, traverses to the end and adds the new line.
+ * add_origin - Records the origin of the next expanded line
  */
-void add_line_to_macro(Macro* head,char* line) {
-    if (head->lines_head == NULL) {
-        /* First line in the macro */
-        head->lines_head = new_line_node(line);
-    }
-    else {
-        /* Add to end of existing lines list */
-        LineNode *temp = head->lines_head;
-        while (temp->next != NULL) {
-            temp = temp->next;
-        }
-        temp->next = new_line_node(line);
+void add_origin(OriginTable* table, int line, int call_line, const Macro* macro) {
+    int new_capacity;
+
+    if (table->count == table->capacity) {
+        new_capacity = table->capacity ? table->capacity * 2 : 256;
+        table->origins = (LineOrigin*)safe_realloc(table->origins, sizeof(LineOrigin) * new_capacity,
+                                                   "Memory error in add_origin()");
+        table->capacity = new_capacity;
     }
+    table->origins[table->count].line = line;
+    table->origins[table->count].call_line = call_line;
+    table->origins[table->count].macro = macro;
+    table->count++;
 }
 
 /*
- * Recursively frees all Macro structures in a linked list, including
- * their LineNode lists and associated strings. Sets all pointers to NULL.
+ * find_origin - Returns the origin of line am_line of the expanded
+ * source, or NULL if the line was not recorded
  */
-void destroy(Macro* head) {
-    if(head == NULL)
-        return;
-    while(head != NULL) {
-        Macro* tmp = head;
-        head = head->next;
-        
-        /* Free all lines in this macro */
-        while (tmp->lines_head != NULL) {
-            LineNode* temp = tmp->lines_head;
-            tmp->lines_head = tmp->lines_head->next;
-            free(temp->line);
-            free(temp);
-        }
-        free(tmp->name);
-        free(tmp);
+const LineOrigin* find_origin(const OriginTable* table, int am_line) {
+    if (table == NULL || am_line < 1 || am_line > table->count) {
+        return NULL;
     }
+    return &table->origins[am_line - 1];
+}
+
+/*
+ * destroy_origins - Frees the table and leaves it empty
+ */
+void destroy_origins(OriginTable* table) {
+    free(table->origins);
+    init_origins(table);
 }
 
 /*
  * Extracts the first word from a line, skipping leading whitespace.
- * The extracted name is stored in a static buffer and returned.
+ * The extracted name is stored in macro_name, which must hold
+ * MAX_LINE_LENGTH characters, and returned.
  * Handles various whitespace characters and line endings.
  */
-char* extract_macro_name(const char* line) {
-    static char macro_name[MAX_LINE_LENGTH];
+char* extract_macro_name(const char* line, char* macro_name) {
     int i = 0;
     int j = 0;
 
@@ -216,25 +272,10 @@ char* extract_macro_name(const char* line) {
 }
 
 /*
- * Finds the specified macro in the macro list and writes all its
- * body lines to the given file. If the macro is not found, prints
- * an error message and returns without writing anything.
+ * Appends the whole body of the macro to the given source buffer.
  */
-void expand_macro(Macro* head,const char* name,FILE* file) {
-    Macro* tmp = find_macro(head,name);
-    LineNode *curr;
-    
-    if (tmp == NULL) {
-        printf("Error: Macro '%s' not found\n", name);
-        return;
-    }
-    
-    /* Write all lines in the macro body to the file */
-    curr = tmp->lines_head;
-    while (curr != NULL) {
-        fputs(curr->line, file);
-        curr = curr->next;
-    }
+void expand_macro(const Macro* macro, SourceText* out) {
+    append_source_bytes(out, macro->body, macro->body_length);
 }
 
 /*
@@ -243,36 +284,14 @@ void expand_macro(Macro* head,const char* name,FILE* file) {
  * the name is not NULL or empty.
  */
 int is_valid_macro_name(const char *name) {
-    /* Array of instruction names that cannot be used as macro names */
-    const char *instructions[] = {
-        "mov", "cmp", "add", "sub", "lea", "clr", "not", "inc", "dec",
-        "jmp", "bne", "jsr", "red", "prn", "rts", "stop"
-    };
-
-    /* Array of directive names that cannot be used as macro names */
-    const char *directives[] = {
-        ".data", ".string", ".mat", ".extern", ".entry"
-    };
-
-    int i;
-
     /* Check if name is NULL or empty */
     if (name == NULL || strlen(name) == 0) {
         return 0;
     }
 
-    /* Check against instruction names */
-    for (i = 0; i < 16; i++) {
-        if (strcmp(name, instructions[i]) == 0) {
-            return 0; /* Invalid - matches instruction name */
-        }
-    }
-
-    /* Check against directive names */
-    for (i = 0; i < 5; i++) {
-        if (strcmp(name, directives[i]) == 0) {
-            return 0; /* Invalid - matches directive name */
-        }
+    /* The name must not be a whole instruction or directive name */
+    if (find_instruction(name, 0) != NULL || is_directive(name, 0)) {
+        return 0;
     }
 
     return 1; /* Valid macro name */
@@ -281,64 +300,62 @@ int is_valid_macro_name(const char *name) {
 /*
  * preprocessor - Main macro preprocessing function
  * 
- * Processes an input file and performs macro expansion. Reads the file
- * line by line and handles:
+ * Processes an input file and performs macro expansion. Walks the file
+ * contents line by line, in place, and handles:
  * - Macro definitions (mcro/mcroend blocks)
  * - Macro calls (expands macros inline)
  * - Regular assembly code (passes through unchanged)
  * 
- * Creates a temporary .am file with all macros expanded, then reopens
- * it for reading by the assembler.
+ * The expanded source is collected in memory for the first pass; the
+ * caller writes it to the .am file. The origin of every expanded line is recorded in origins, unless it
+ * is NULL.
  * 
  * Parameters:
- *   file - Input file pointer (assembly source)
- *   filename - Base filename without extension
+ *   file - Contents of the assembly source
+ *   arena - Arena that owns the macro definitions
+ *   out - Empty source buffer that receives the expanded lines
+ *   origins - Empty table that receives the line origins, or NULL
  * 
  * Returns:
- *   File pointer to the preprocessed file (.am), or NULL on error
+ *   0 on success, 1 if any errors occurred during preprocessing
  * 
  * Error handling:
  *   - Reports invalid macro names
  *   - Reports extra characters after macro directives
- *   - Returns NULL if any errors occur during preprocessing
  * 
  * Memory management:
- *   - Allocates temporary filename
- *   - Creates and manages temporary .am file
- *   - Cleans up macro list after processing
+ *   - The caller releases out with destroy_source
+ *   - Macro definitions are taken from arena and released with it
  */
-FILE* preprocessor(FILE* file,char* filename) {
+int preprocessor(const SourceFile* file,Arena* arena,SourceText* out,OriginTable* origins) {
     int in_macro = 0;          /* Flag indicating if we're inside a macro definition */
     int error_flag = 0;        /* Flag for tracking preprocessing errors */
-    char line[MAX_LINE_LENGTH]; /* Buffer for reading lines */
-    char *filename1 = NULL;    /* Temporary filename for .am file */
-    FILE *fp1;                 /* File pointer for temporary .am file */
+    const char *line;          /* Current line, inside the file contents */
+    LineView view;             /* Span of the current line */
+    size_t position = 0;       /* Offset of the next line */
+    int num_of_line = 0;       /* Line number in the .as file */
     char *name = NULL;         /* Macro name being processed */
+    char name_buffer[MAX_LINE_LENGTH]; /* Storage for extracted macro names */
+    MacroTable table;          /* Macros defined in this file */
+    Macro *current = NULL;     /* Macro being defined or called */
+    SourceText body;           /* Body lines of the macro being defined */
+    int k;                     /* Line of a macro body */
 
-    /* Allocate memory for temporary filename */
-    filename1 = (char*)malloc(strlen(filename) + 5);
-    if (!filename1) {
-        printf("Memory allocation error in preproccessor function\n");
-        exit(1);
-    }
-    strcpy(filename1, filename);
-    strcat(filename1, ".am");
-
-    /* Create temporary file for preprocessed output */
-    fp1 = fopen(filename1 ,"w");
-    if (fp1 == NULL) {
-        printf("Memory allocation error in preproccessor function: can't create file %s\n", filename1);
-        free(filename1);
-        exit(1);
-    }
+    init_macro_table(&table, arena);
+    init_source(&body);
 
     /* Process input file line by line */
-    while (fgets(line,MAX_LINE_LENGTH,file) !=NULL) {
+    while (next_line(file->data, file->size, &position, &view) && !error_limit_reached()) {
         int i = 5;  /* Skip "mcro " prefix when processing macro start */
         name = NULL;
+        line = view.text;
+        num_of_line++;
 
         if (is_macro_start(line)) {
-            /* Start of macro definition */
+            /* Start of macro definition; one left open keeps its lines so far */
+            if (in_macro) {
+                finish_macro(arena, current, &body);
+            }
             in_macro = 1;
             
             /* Skip spaces after "mcro " */
@@ -347,7 +364,7 @@ FILE* preprocessor(FILE* file,char* filename) {
             }
             
             /* Extract macro name */
-            name = extract_macro_name(line + i);
+            name = extract_macro_name(line + i, name_buffer);
 
             /* Validate that there are no extra characters after macro name */
             i += strlen(name);
@@ -355,22 +372,24 @@ FILE* preprocessor(FILE* file,char* filename) {
                 i++;
             }
             if (line[i] != '\0' && line[i] != '\n' && line[i] != '\r') {
-                printf("chars after macro definition\n");
+                report_error(num_of_line, "Extra characters after macro definition\n");
                 error_flag = 1;
             }
             
             /* Validate macro name */
             if (!is_valid_macro_name(name)) {
-                printf("Error: macro name not valid\n");
+                report_error(num_of_line, "Macro name not valid\n");
                 error_flag = 1;
             }
             
-            /* Add macro to global list */
-            add_macro(name);
+            /* Add macro to this file's table */
+            current = add_macro(&table, name);
+            current->line = num_of_line;
+            body.length = 0;
         }
         else if (in_macro == 1 && !is_macro_end(line)) {
             /* Inside macro definition - add line to current macro */
-            add_line_to_macro(head,line);
+            append_source_bytes(&body, view.text, view.length);
         }
         else if (in_macro == 1 && is_macro_end(line)) {
             /* End of macro definition */
@@ -381,40 +400,32 @@ FILE* preprocessor(FILE* file,char* filename) {
                 i += 1;
             }
             if (line[i] != '\0' && line[i] != '\n' && line[i] != '\r') {
-                printf("chars after macro end\n");
+                report_error(num_of_line, "Extra characters after macro end\n");
                 error_flag = 1;
             }
+            finish_macro(arena, current, &body);
             in_macro = 0;  /* Exit macro definition mode */
         }
-        else if (is_macro_call(head,line)) {
+        else if ((current = macro_call(&table, line)) != NULL) {
             /* Macro call - expand the macro inline */
-            char* macro_name = extract_macro_name(line);
-            expand_macro(head, macro_name, fp1);
+            expand_macro(current, out);
+            STAT_ADD(macros_expanded, 1);
+            for (k = 1; origins != NULL && k <= current->body_lines; k++) {
+                add_origin(origins, current->line + k, num_of_line, current);
+            }
         }
         else {
             /* Regular assembly line - pass through unchanged */
-            fputs(line,fp1);
+            append_source_bytes(out, view.text, view.length);
+            if (origins != NULL) {
+                add_origin(origins, num_of_line, 0, NULL);
+            }
         }
     }
 
-    /* Close the temporary file */
-    fclose(fp1);
+    /* The macros themselves belong to the arena */
+    destroy_macro_table(&table);
+    destroy_source(&body);
 
-    /* Clean up macro list */
-    destroy(head);
-    head = NULL; /* Reset global head */
-
-    /* Reopen the file for reading by the assembler */
-    fp1 = fopen(filename1, "r");
-    if (fp1 == NULL) {
-        printf("Error: can't reopen file %s for reading\n", filename1);
-        free(filename1);
-        exit(1);
-    }
-
-    /* Clean up and return */
-    free(filename1);
-    if (error_flag) 
-        return NULL;  /* Return NULL if any errors occurred */
-    return fp1;
-}
\ No newline at end of file
+    return error_flag;
+}
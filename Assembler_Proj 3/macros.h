@@ -7,40 +7,80 @@
 #ifndef MACROS_H
 #define MACROS_H
 
-/*
- * LineNode - Single line in macro body
- */
-typedef struct LineNode {
-    char* line;                 /* Text content of the line */
-    struct LineNode* next;      /* Pointer to next line in the macro */
-}LineNode;
+#include <stdio.h>
+#include "arena.h"
+#include "input.h"
 
 /*
  * Macro - Macro definition with name and body
  */
 typedef struct Macro {
     char* name;                 /* Name of the macro */
-    LineNode* lines_head;       /* Head of the linked list of macro body lines */
-    struct Macro* next;         /* Pointer to next macro in the table */
+    unsigned long hash;         /* Hash of the name, cached for probing */
+    char* body;                 /* Body lines as one block of text, NULL if empty */
+    size_t body_length;         /* Bytes in body */
+    int line;                   /* Line of the mcro directive in the .as file */
+    int body_lines;             /* Lines in body */
 } Macro;
 
+/*
+ * MacroTable - Open-addressing hash table of the macros of one file
+ * 
+ * The capacity is always a power of two and the table is kept at most
+ * half full so linear probing stays short.
+ */
+typedef struct MacroTable {
+    Macro** slots;              /* Hash slots, NULL when empty */
+    int capacity;               /* Number of slots (power of two) */
+    int count;                  /* Number of macros in the table */
+    Arena* arena;               /* Arena that owns the macros */
+} MacroTable;
+
+/*
+ * LineOrigin - Where one line of the expanded source comes from
+ * 
+ * A line copied from the .as file has its own line number there. A line
+ * expanded from a macro has the line of the body in the macro definition,
+ * the macro, and the line of the call that expanded it.
+ */
+typedef struct LineOrigin {
+    int line;                   /* Line of the .as file holding the text */
+    int call_line;              /* Line of the macro call, 0 if not expanded */
+    const Macro* macro;         /* Macro the line was expanded from, NULL if none */
+} LineOrigin;
+
+/*
+ * OriginTable - Origin of every expanded line, indexed by .am line - 1
+ */
+typedef struct OriginTable {
+    LineOrigin* origins;        /* One entry per expanded line */
+    int count;                  /* Number of lines recorded */
+    int capacity;               /* Number of entries allocated */
+} OriginTable;
+
+/* Macro table functions */
+void init_macro_table(MacroTable* table, Arena* arena);    /* Prepares an empty table */
+void destroy_macro_table(MacroTable* table);                /* Frees the slots */
+Macro* add_macro(MacroTable* table, const char* name);      /* Creates new macro with given name */
+Macro* find_macro(const MacroTable* table, const char* name, size_t length); /* Searches for macro by name */
+
 /* Macro management functions */
-void add_macro(const char* name);                           /* Creates new macro with given name */
-Macro* find_macro(Macro* head,const char* name);           /* Searches for macro by name */
 int is_macro_start(const char* line);                       /* Checks if line starts with "mcro " */
 int is_macro_end(const char* line);                         /* Checks if line starts with "mcroend" */
-int is_macro_call(const Macro* head,const char* line);     /* Checks if line is a macro call */
+Macro* macro_call(const MacroTable* table, const char* line); /* Returns the macro called by the line */
+void finish_macro(Arena* arena, Macro* macro, const SourceText* body); /* Stores the macro body */
 
-/* Line node management */
-LineNode* new_line_node(const char* line);                 /* Creates new line node */
-void add_line_to_macro(Macro* head,char* line);            /* Adds line to macro body */
-void destroy(Macro* head);                                  /* Frees all macro memory */
+/* Line origin functions */
+void init_origins(OriginTable* table);                      /* Prepares an empty table */
+void add_origin(OriginTable* table, int line, int call_line, const Macro* macro); /* Records the next line */
+const LineOrigin* find_origin(const OriginTable* table, int am_line); /* Origin of an .am line, NULL if unknown */
+void destroy_origins(OriginTable* table);                   /* Frees the table */
 
 /* Macro processing functions */
-char* extract_macro_name(const char* line);                /* Extracts macro name from line */
-void expand_macro(Macro* head,const char* name,FILE* file); /* Expands macro to file */
+char* extract_macro_name(const char* line, char* macro_name); /* Extracts macro name from line */
+void expand_macro(const Macro* macro, SourceText* out);    /* Expands macro into the source buffer */
 int is_valid_macro_name(const char *name);                 /* Validates macro name */
 
-FILE* preprocessor(FILE* file,char* filename);             /* Main macro preprocessing function */
+int preprocessor(const SourceFile* file,Arena* arena,SourceText* out,OriginTable* origins); /* Main macro preprocessing function */
 
 #endif /* MACROS_H */
\ No newline at end of file
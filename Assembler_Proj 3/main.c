@@ -1,524 +1,335 @@
 /*
  * main.c - Main assembler program
  * 
- * This file contains the main entry point and core assembly logic for a two-pass assembler.
- * It handles the first and second passes of assembly, managing symbol tables, orders,
- * and data words. The assembler processes assembly files and generates object files.
+ * This file contains the main entry point of the assembler. It reads the
+ * command line options and assembles every named file, either one after
+ * another or on a pool of worker threads (-j N). Each file is assembled
+ * in its own Assembly context. The messages of each file are buffered
+ * and written to stderr at once, in command line order even with workers.
+ * With --serve it stays resident and answers requests from stdin instead.
+ * With --run, each program that assembles is also run on the simulator,
+ * and with --profile its hot spots are reported in a .prof file.
+ * With --max-memory=KB, each file is held to a memory ceiling, which
+ * counts its source and expanded text as well as its tables, and its .ob
+ * file is written while it is assembled.
+ * With --link=OUT, the named files are assembled modules (.bin) that are
+ * linked into one program instead.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
-#include "helpers.h"
-#include "input.h"
-#include "order.h"
-#include "decode.h"
-#include "symbolTable.h"
-#include "macros.h"
-#include "output.h"
+#include "assembly.h"
+#include "diag.h"
+#include "stats.h"
+#include "serve.h"
+#include "sim.h"
+#include "link.h"
 
-/* Global variables for symbol tables and data structures */
-Symbol *symbol_head = NULL;    /* Head of main symbol table */
-Symbol *symbol_tail = NULL;    /* Tail of main symbol table */
-Order *order_head = NULL;      /* Head of order list */
-Order *order_tail = NULL;      /* Tail of order list */
-Word *D_word_head = NULL;      /* Head of data word list */
-Word *D_word_tail = NULL;      /* Tail of data word list */
-Symbol *external_head = NULL;  /* Head of external symbol table */
-int entries_flag = 0;          /* Flag for entry symbols */
-int IC = 100;                  /* Instruction Counter (starts at 100) */
-int DC = 0;                    /* Data Counter (starts at 0) */
-int files;                     /* Number of files processed */
+#define MAX_JOBS 256            /* Upper limit for -j */
 
 /*
- * This function cleans up all dynamically allocated memory including
- * symbol tables, order lists, and word lists. It resets all global
- * variables to their initial state.
+ * Job - One source file and the messages reported while assembling it
  */
-void end_system(void) {
-    /* Free symbol tables */
-    if (symbol_head != NULL) {
-        destroy_symbol_table(symbol_head);
-        symbol_head = NULL;
-        symbol_tail = NULL;
+typedef struct Job {
+    char *filename;             /* Base filename, without .as */
+    Diagnostics diagnostics;    /* Messages reported for this file */
+    int done;                   /* Set once the file is finished */
+    int failed;                 /* Set if the file could not be assembled */
+}Job;
+
+/*
+ * JobQueue - Files shared by the worker threads
+ */
+typedef struct JobQueue {
+    Job *jobs;                  /* Files in command line order */
+    int count;                  /* Number of files */
+    int next;                   /* Next file to hand out */
+    const Options *options;     /* Settings for every file */
+    pthread_mutex_t lock;       /* Guards next and the done flags */
+    pthread_cond_t finished;    /* Signalled when a file is done */
+}JobQueue;
+
+/*
+ * Worker thread: takes the next file from the queue until none are left,
+ * assembling each one with reports routed to that file's buffer.
+ */
+static void* worker(void *arg) {
+    JobQueue *queue = (JobQueue*)arg;
+    Assembly as;                /* Context reused for this worker's files */
+    Job *job;
+
+    init_assembly(&as);
+    while (1) {
+        pthread_mutex_lock(&queue->lock);
+        if (queue->next == queue->count) {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        job = &queue->jobs[queue->next++];
+        pthread_mutex_unlock(&queue->lock);
+
+        route_diagnostics(&job->diagnostics);
+        job->failed = assemble_file(&as, job->filename, queue->options);
+        route_diagnostics(NULL);
+
+        pthread_mutex_lock(&queue->lock);
+        job->done = 1;
+        pthread_cond_broadcast(&queue->finished);
+        pthread_mutex_unlock(&queue->lock);
     }
+    destroy_assembly(&as);
+    return NULL;
+}
 
-    if (external_head != NULL) {
-        destroy_symbol_table(external_head);
-        external_head = NULL;
+/*
+ * Assembles the files on options->jobs worker threads. The main thread
+ * prints each file's messages as soon as it and all earlier files are
+ * done, so the output matches a sequential run. Returns 1 if any file
+ * could not be assembled and 0 otherwise.
+ */
+static int assemble_parallel(Job *jobs, int count, const Options *options) {
+    JobQueue queue;
+    pthread_t threads[MAX_JOBS];
+    int num_of_threads = options->jobs < count ? options->jobs : count;
+    int failed = 0;
+    int i;
+
+    queue.jobs = jobs;
+    queue.count = count;
+    queue.next = 0;
+    queue.options = options;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.finished, NULL);
+
+    for (i = 0; i < num_of_threads; i++) {
+        if (pthread_create(&threads[i], NULL, worker, &queue) != 0) {
+            fprintf(stderr, "Error: can't create worker thread\n");
+            exit(1);
+        }
     }
 
-    /* Free order lists */
-    if (order_head != NULL) {
-        destroy_order(order_head);
-        order_head = NULL;
-        order_tail = NULL;
+    /* Print the messages of each file in order */
+    for (i = 0; i < count; i++) {
+        pthread_mutex_lock(&queue.lock);
+        while (!jobs[i].done) {
+            pthread_cond_wait(&queue.finished, &queue.lock);
+        }
+        pthread_mutex_unlock(&queue.lock);
+        flush_diagnostics(&jobs[i].diagnostics, stderr);
+        destroy_diagnostics(&jobs[i].diagnostics);
+        failed |= jobs[i].failed;
     }
 
-    /* Free word lists */
-    if (D_word_head != NULL) {
-        destroy_word(D_word_head);
-        D_word_head = NULL;
-        D_word_tail = NULL;
+    for (i = 0; i < num_of_threads; i++) {
+        pthread_join(threads[i], NULL);
     }
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.finished);
+    return failed;
+}
 
-    /* Reset counters */
-    IC = 100;
-    DC = 0;
+/*
+ * Reads the value of -j from "-jN" or from the next argument of "-j N".
+ * Returns the number of jobs, or 0 if the value is missing or invalid.
+ */
+static int parse_jobs(int argc, char *argv[], int *files) {
+    const char *value = argv[*files] + 2;
+    char *end = NULL;
+    long jobs;
+
+    if (*value == '\0') {
+        if (*files + 1 >= argc) {
+            return 0;
+        }
+        value = argv[++*files];
+    }
+    jobs = strtol(value, &end, 10);
+    if (*end != '\0' || jobs < 1 || jobs > MAX_JOBS) {
+        return 0;
+    }
+    return (int)jobs;
 }
 
 /*
- * This function reads the assembly file line by line and:
- * - Processes symbol definitions and adds them to symbol table
- * - Handles directives (.data, .string, .mat, .entry, .extern)
- * - Processes instructions and calculates their sizes
- * - Updates instruction and data counters
+ * This function reads the options and orchestrates the assembly of every
+ * file named on the command line (without the .as suffix). Option errors
+ * go to stderr and exit with 1; otherwise it returns 1 if any file could
+ * not be assembled or linked and 0 if all of them were.
  */
-int first_scan(FILE* file) {
-    int directive;              /* Flag for directive processing */
-    int symbol = 0;             /* Flag for symbol definition */
-    int op = -1;                /* Opcode value */
-    int num_of_ops = 0;         /* Number of operands */
-    int index = 0;              /* Current position in line */
-    int index2 = 0;             /* Temporary position marker */
-    int index3 = 0;             /* Temporary position marker for validation */
-    int L = 0;                  /* Label length */
-    int num_of_line = 0;        /* Current line number */
-    int num_of_chars = 0;       /* Number of characters in line */
-    int error_flag = 0;         /* Error flag */
-    int result = 0;             /* Result from decode_data function */
-    Word* tmp = NULL;           /* Temporary word pointer */
-    char *symbol1 = NULL;       /* Symbol name */
-    char* line = NULL;          /* Current line */
-    char* buffer = (char*)safe_malloc(sizeof(char)*MAX_LINE_LENGTH, "Out of memory");
+int main(int argc,char *argv[]) {
+    Options options;            /* Settings for every file */
+    Assembly as;                /* Context for sequential assembly */
+    Job *jobs = NULL;           /* Files to assemble */
+    int num_of_files = 0;       /* Arguments that name source files */
+    int files;                  /* Argument counter */
+    int serving = 0;            /* Set by --serve */
+    char *link_output = NULL;   /* Linked program name from --link */
+    char **modules;             /* Names of the modules to link */
+    int status = 0;             /* Nonzero once a file fails or linking fails */
+
+    options.write_am = 1;
+    options.jobs = 1;
+    options.cache_dir = NULL;
+    options.formats = FORMAT_TEXT;
+    options.stats = 0;
+    options.max_errors = 0;
+    options.run = 0;
+    options.run_limit = SIM_DEFAULT_LIMIT;
+    options.profile = 0;
+    options.profile_file = NULL;
+    options.max_memory = 0;
+    jobs = (Job*)malloc(sizeof(Job) * (argc > 1 ? argc - 1 : 1));
+    if (jobs == NULL) {
+        fprintf(stderr, "Memory allocation error in main\n");
+        exit(1);
+    }
 
-    while (1) {
-        num_of_chars = read_line(file, buffer);
-        if (!num_of_chars) {
-            break;
+    /* Options apply to every file, wherever they appear */
+    for (files = 1 ; files < argc ; files++) {
+        if (argv[files][0] != '-') {
+            jobs[num_of_files].filename = argv[files];
+            init_diagnostics(&jobs[num_of_files].diagnostics);
+            jobs[num_of_files].done = 0;
+            jobs[num_of_files].failed = 0;
+            num_of_files++;
         }
-        if (num_of_chars == 2) {
-            printf("Error: Line too long (max 80 characters allowed)\n");
-            error_flag = 1;
+        else if (strcmp(argv[files], "--no-am") == 0) {
+            options.write_am = 0;
         }
-        line = buffer; /* Use buffer directly instead of strcpy */
-        num_of_line++;
-        index = 0; /* Reset index for each line */
-        
-        /* Skip leading whitespace */
-        while(line[index] == ' ')
-            index++; /* index = location of symbol beginning */
-            
-        if (line[index] == '\n' || line[index] == '\r' || line[index] == '\0') { /* empty sentence */
-            continue;
+        else if (strncmp(argv[files], "--link=", 7) == 0 && argv[files][7] != '\0') {
+            link_output = argv[files] + 7;
         }
-        if (line[index] == ';') {
-            continue; /* comment */
+        else if (strcmp(argv[files], "--serve") == 0) {
+            serving = 1;
         }
-        
-        /* Check for symbol definition */
-        index2 = is_symbol_definition(line, index); /* index2= location of ':' */
-        if (index2 > 0) { /* Check if we found a symbol definition */
-            symbol1 = (char*)safe_malloc(sizeof(char)*(index2-index+1), "Out of memory");
-            strncpy(symbol1, line+index, index2-index);
-            symbol1[index2-index] = '\0';
-            symbol = 1;
-            index = space_skip(line, index2+1); /* Skip past the colon and any spaces */
+        else if (strncmp(argv[files], "--cache=", 8) == 0 && argv[files][8] != '\0') {
+            options.cache_dir = argv[files] + 8;
         }
-
-        directive = is_directive(line, index);
-
-        if (directive > 0 && directive < 4) { /* it is data or string or mat sentence */
-            if(symbol) {
-                if (search_symbol(symbol_head, symbol1) != NULL) {
-                    printf("Error: Symbol already exists at line %d\n", num_of_line);
-                    error_flag = 1;
-                    free(symbol1);
-                    symbol1 = NULL;
-                    symbol = 0;
-                    continue;
-                }
-                add_symbol(&symbol_head, &symbol_tail, symbol1);
-                set_type(symbol_tail, 1); /* .data */
-                set_value(symbol_tail, DC);
-                symbol = 0;
-                free(symbol1);
-                symbol1 = NULL;
-            }
-
-            result = decode_data(&D_word_head, &D_word_tail, line, index, directive, DC, num_of_line);
-            if (result == -1) {
-                error_flag = 1;
-                continue; /* Skip this line entirely if directive failed */
-            }
-            DC = result;
-            continue;
+        else if (strcmp(argv[files], "--stats") == 0) {
+#ifdef NO_STATS
+            fprintf(stderr, "Error: --stats is not available, the assembler was built with NO_STATS\n");
+            exit(1);
+#else
+            options.stats = 1;
+            enable_stats();
+#endif
         }
-        
-        if (directive == 5) { /* entry directive */
-            if (symbol) {
-                printf("Warning: in line %d symbol before entry\n", num_of_line);
-                symbol = 0;
-                free(symbol1);
-                symbol1 = NULL;
+        else if (strncmp(argv[files], "--max-errors=", 13) == 0) {
+            options.max_errors = parse_count(argv[files] + 13);
+            if (options.max_errors <= 0) {
+                fprintf(stderr, "Error: --max-errors expects a positive number\n");
+                exit(1);
             }
-            index = space_skip(line, index+6); /* now index points to the symbol after the entry directive */
-            index2 = is_symbol(line, index);
-            if (index2 <= 0) { /* Check if we found a symbol */
-                printf("Error: Expecting symbol after entry directive at line %d\n", num_of_line);
-                error_flag = 1;
-                continue; /* Skip this line entirely if directive failed */
-            }
-            continue; /* Only continue if directive was processed successfully */
         }
-        
-        if (directive == 4) { /* extern directive */
-            if (symbol) {
-                printf("Warning: in line %d symbol before extern.\n", num_of_line);
-                symbol = 0;
-                free(symbol1);
-                symbol1 = NULL;
-            }
-            index = space_skip(line, index+7); /* now index points to the symbol after the extern directive */
-            index2 = is_symbol(line, index);
-            if (index2 <= 0) { /* Check if we found a symbol */
-                printf("Error: Expecting symbol after extern directive at line %d\n", num_of_line);
-                error_flag = 1;
-                continue; /* Skip this line entirely if directive failed */
+        else if (strncmp(argv[files], "--max-memory=", 13) == 0) {
+            options.max_memory = parse_count(argv[files] + 13);
+            if (options.max_memory <= 0) {
+                fprintf(stderr, "Error: --max-memory expects a positive number of kilobytes\n");
+                exit(1);
             }
-            symbol1 = (char*)safe_malloc(sizeof(char)*(index2-index+1), "Out of memory");
-            strncpy(symbol1, line+index, index2-index);
-            symbol1[index2-index] = '\0';
-            add_symbol(&symbol_head, &symbol_tail, symbol1);
-            set_type(symbol_tail, 4); /* .extern */
-            free(symbol1);
-            symbol1 = NULL;
-            continue; /* Only continue if directive was processed successfully */
         }
-        
-        if (symbol) { /* an order sentence */
-            if (search_symbol(symbol_head, symbol1) != NULL) {
-                printf("Error: Symbol already exists at line %d\n", num_of_line);
-                error_flag = 1;
-                free(symbol1);
-                symbol1 = NULL;
-                symbol = 0;
-                continue;
+        else if (strcmp(argv[files], "--run") == 0) {
+            options.run = 1;
+        }
+        else if (strncmp(argv[files], "--run=", 6) == 0) {
+            options.run = 1;
+            options.run_limit = (unsigned long)parse_count(argv[files] + 6);
+            if (options.run_limit == 0) {
+                fprintf(stderr, "Error: --run expects a positive number of instructions\n");
+                exit(1);
             }
-            symbol_tail = add_symbol(&symbol_head, &symbol_tail, symbol1);
-            set_type(symbol_tail, 2);
-            set_value(symbol_tail, IC);
-            symbol = 0;
-            free(symbol1);
-            symbol1 = NULL;
         }
-
-        op = opcode_in_decimal(line, index, num_of_line);
-        if (op == -1) {
-            printf("Error: Invalid function at line %d\n", num_of_line);
-            error_flag = 1;
-            continue;
+        else if (strcmp(argv[files], "--profile") == 0) {
+            options.profile = 1;
         }
-        num_of_ops = number_of_operands(op);
-        add_order(&order_head, &order_tail, op);
-        order_tail->IC = IC;
-        order_tail->word = NULL;
-        
-        if (num_of_ops == 0) {
-            if (op == 15) {
-                if (space_skip(line, index+4) != -2) { /* after stop we expect to see space or '\n', no operands */
-                    printf("Error: Function 'stop' expects no arguments at line %d\n", num_of_line);
-                    error_flag = 1;
-                    continue;
-                }
-            }
-            else if (space_skip(line, index+3) != -1) { /* after rts we expect to see space or '\n' , no arguments. */
-                printf("Error: Function 'rts' expects no arguments at line %d\n", num_of_line);
-                error_flag = 1;
-                continue;
-            }
-            decode_order_first_word(order_tail);
-            order_tail->operand1 = -1;
-            order_tail->operand2 = -1;
-            order_tail->number_of_words = 1; /* we need to check if I missed memory allocation */
-            
-            /* Validate operands for instructions with no operands */
-            if (validate_operands(order_tail, num_of_line)) {
-                error_flag = 1;
-                continue;
-            }
-            
-            IC += 1;
-            continue;
+        else if (strncmp(argv[files], "--profile=", 10) == 0 && argv[files][10] != '\0') {
+            options.profile = 1;
+            options.profile_file = argv[files] + 10;
         }
-        
-        index += 3; /* now index is the location after the function name */
-        index = space_skip(line, index); /* now index is the location of the operand */
-        
-        if (num_of_ops == 1) {
-            order_tail->operand2 = addressing_method(line, index, num_of_line);
-            decode_order_first_word(order_tail);
-            order_tail->operand1 = -1;
-            
-            /* Check for extra characters after the operand */
-            index2 = index;
-            while (index2 < strlen(line) && line[index2] != ' ' && line[index2] != '\t' && line[index2] != '\n' && line[index2] != '\r' && line[index2] != '\0') {
-                index2++;
-            }
-            /* Skip spaces after operand */
-            while (index2 < strlen(line) && (line[index2] == ' ' || line[index2] == '\t')) {
-                index2++;
-            }
-            /* Check if there are any non-space characters after the operand */
-            if (index2 < strlen(line) && line[index2] != '\n' && line[index2] != '\r' && line[index2] != '\0') {
-                printf("Error: Extra characters after operand at line %d\n", num_of_line);
-                error_flag = 1;
-                continue;
+        else if (strncmp(argv[files], "--format=", 9) == 0) {
+            options.formats = parse_formats(argv[files] + 9);
+            if (options.formats == 0) {
+                fprintf(stderr, "Error: --format expects text, bin or both\n");
+                exit(1);
             }
-            
-            L = number_of_lines(order_tail->operand1, order_tail->operand2);
-            order_tail->number_of_words = L;
-            order_tail->IC = IC;
-            decode_operand(order_tail, line, index, num_of_line);
-            
-            /* Validate operands for single-operand instructions */
-            if (validate_operands(order_tail, num_of_line)) {
-                error_flag = 1;
-                continue;
-            }
-            
-            IC += L;
-            continue;
         }
-        
-        if (num_of_ops == 2) {
-            order_tail->operand1 = addressing_method(line, index, num_of_line);
-
-            index2 = index;
-            while (index2 < strlen(line) && line[index2] != ',' && line[index2] != '\n' && line[index2] != '\0') {
-                index2++;
+        else if (strncmp(argv[files], "-j", 2) == 0) {
+            options.jobs = parse_jobs(argc, argv, &files);
+            if (options.jobs == 0) {
+                fprintf(stderr, "Error: -j expects a number of jobs between 1 and %d\n", MAX_JOBS);
+                exit(1);
             }
-            if (index2 >= strlen(line) || line[index2] != ',') {
-                printf("Error: Missing comma between operands at line %d\n", num_of_line);
-                error_flag = 1;
-                continue;
-            }
-            index2++;
-            index2 = space_skip(line, index2); /* now index 2 is the location of the second operand */
-            order_tail->operand2 = addressing_method(line, index2, num_of_line);
-
-            /* Check for extra characters after the second operand */
-            index3 = index2;
-            while (index3 < strlen(line) && line[index3] != ' ' && line[index3] != '\t' && line[index3] != '\n' && line[index3] != '\r' && line[index3] != '\0') {
-                index3++;
-            }
-            /* Skip spaces after second operand */
-            while (index3 < strlen(line) && (line[index3] == ' ' || line[index3] == '\t')) {
-                index3++;
-            }
-            /* Check if there are any non-space characters after the second operand */
-            if (index3 < strlen(line) && line[index3] != '\n' && line[index3] != '\r' && line[index3] != '\0') {
-                printf("Error: Extra characters after second operand at line %d\n", num_of_line);
-                error_flag = 1;
-                continue;
-            }
-
-            L = number_of_lines(order_tail->operand1, order_tail->operand2);
-            order_tail->number_of_words = L;
-            order_tail->IC = IC;
-            decode_order_first_word(order_tail);
-            
-            if (order_tail->operand1 == 3 && order_tail->operand2 == 3) {
-                tmp = new_word();
-                strcpy(tmp->word, decode_registers(atoi(line+index+1), atoi(line+index2+1)));
-                add_word_to_order(order_tail, tmp);
-            }
-            else {
-                decode_operand(order_tail, line, index, num_of_line);
-                decode_operand(order_tail, line, index2, num_of_line);
-            }
-            
-            /* Validate operands for two-operand instructions */
-            if (validate_operands(order_tail, num_of_line)) {
-                error_flag = 1;
-                continue;
-            }
-            
-            IC += L;
-        }
-    }
-    
-    update_data_symbols_value(symbol_head, IC);
-    free(buffer); /* Free the allocated buffer */
-    return error_flag;
-}
-
-
-/*
- * This function performs the second pass which:
- * - Processes .entry directives and validates entry symbols
- * - Updates symbol operands with final addresses
- * - Resolves external symbol references
- * - Validates symbol existence and types
- */
-int second_scan(FILE* file) {
-    int directive;              /* Directive type */
-    int index;                  /* Current position in line */
-    int index2;                 /* Temporary position marker */
-    int error_flag = 0;         /* Error flag */
-    int num_of_line = 0;        /* Current line number */
-    int num_of_chars = 0;
-    int update_result = 0;      /* Result from update_symbol_operands */
-    char *symbol1 = NULL;       /* Symbol name */
-    char* line = NULL;          /* Current line */
-    char* buffer = (char*)safe_malloc(sizeof(char)*MAX_LINE_LENGTH, "Out of memory");
-    
-    
-    while (1) {
-        num_of_chars = read_line(file, buffer);
-        if (!num_of_chars) {
-            break;
-        }
-        if (num_of_chars == 2) {
-            printf("Error: Line too long (max 80 characters allowed)\n");
-            error_flag = 1;
-        } 
-        line = buffer; /* Use buffer directly instead of strcpy */
-        num_of_line++;
-        index = 0; /* Reset index for each line */
-        index = space_skip(line, index); /* index = location of symbol beginning */
-        
-        if (line[index] == '\n' || line[index] == '\r' || line[index] == '\0') /* empty sentence */
-            continue;
-        if (line[index] == ';') /* comment */
-            continue;
-            
-        index2 = is_symbol_definition(line, index);
-        if (index2) {
-            index = index2+1; /* +1 for the ':' */
-        }
-        directive = is_directive(line, index);
-        if (directive > 0 && directive < 5) {
-            continue;
         }
-        if (directive == 5) {
-            entries_flag = 1;
-            index += 6;
-            index = space_skip(line, index);
-            index2 = is_symbol(line, index);
-            if (!index2) {
-                printf("Error: Entry directive expects exactly one symbol argument at line %d\n", num_of_line);
-                error_flag = 1;
-                continue;
-            }
-            symbol1 = (char*)safe_malloc(sizeof(char)*MAX_SYMBOL_LENGTH, "Out of memory");
-            strncpy(symbol1, line+index, index2-index+1);
-            symbol1[index2-index] = '\0';
-            if (search_symbol(symbol_head, symbol1) == NULL) {
-                printf("Error: Symbol does not exist at line %d\n", num_of_line);
-                error_flag = 1;
-                free(symbol1);
-                symbol1 = NULL;
-                continue;
-            }
-
-            set_type(search_symbol(symbol_head, symbol1), 3); /* we need to check that type 3 is entry */
-            free(symbol1);
-            symbol1 = NULL;
+        else {
+            fprintf(stderr, "Error: unknown option %s\n", argv[files]);
+            exit(1);
         }
     }
-    
-    update_result = update_symbol_operands(order_head, symbol_head, &external_head); /* in the update function we should make a list of the external symbols */
-    if (update_result) {
-        error_flag = 1;
-    }
-    free(buffer); /* Free the allocated buffer */
-    return error_flag; /* if error flag is on we should return 0 */
-}
 
-/*
- * This function orchestrates the two-pass assembly process:
- * 1. Preprocessor phase (macro expansion)
- * 2. First pass (symbol collection and size calculation)
- * 3. Second pass (address resolution and validation)
- * 4. Output generation (.ob, .ent, .ext files)
- */
-int main(int argc,char *argv[]) {
-    FILE *file = NULL;          /* Input file pointer */
-    FILE *fp1 = NULL;           /* Preprocessed file pointer */
-    char *fullfilename = NULL;  /* Full filename with path */
-    char *filename = NULL;      /* Base filename */
-    int files;                  /* File counter */
-
-
-    if (argc < 2) {
-        printf("No files were send to the assembler\n");
-        exit(0);
+    if (options.profile && !options.run && options.profile_file == NULL) {
+        fprintf(stderr, "Error: --profile needs --run, or a profile file with --profile=FILE\n");
+        exit(1);
     }
 
-    for (files = 1 ; files < argc ; files++) {
-
-        filename = argv[files];
-        if (!filename) {
-            printf("Error: invalid filename\n");
-            exit(0);
-        }
-
-        /* Allocate memory for fullfilename */
-        fullfilename = create_filename(filename, ".as");
+    if (options.max_memory > 0 && (options.formats != FORMAT_TEXT || options.run || options.profile ||
+                                   options.cache_dir != NULL || serving || link_output != NULL)) {
+        fprintf(stderr, "Error: --max-memory only streams the text .ob; it can't be used with --format=bin or both, "
+                        "--run, --profile, --cache, --serve or --link\n");
+        exit(1);
+    }
 
-        file = fopen(fullfilename,"r");
-        if (!file) {
-            printf("Can't open file %s or it does not exist.\n",fullfilename);
-            free(fullfilename);
-            continue;
+    if (serving) {
+        if (num_of_files > 0) {
+            fprintf(stderr, "Error: --serve reads its requests from stdin, not file names\n");
+            exit(1);
         }
-        printf("Processing file: %s\n", fullfilename);
-
-        fp1 = preprocessor(file,filename);
-        
-        if (fp1 == NULL) {
-            printf("Can't finish the assembler process on file: %s.\n", fullfilename);
-            fclose(file);
-            free(fullfilename);
-            continue;
+        if (options.run) {
+            fprintf(stderr, "Error: --run can't be used with --serve, whose replies go to stdout\n");
+            exit(1);
         }
-
-        if (first_scan(fp1)){
-            printf("Can't finish the assembler process on file: %s.\n", fullfilename);
-            fclose(file);
-            free(fullfilename);
-            end_system();
-            continue;
+        if (options.profile) {
+            fprintf(stderr, "Error: --profile can't be used with --serve\n");
+            exit(1);
         }
-        rewind(fp1);
+        free(jobs);
+        return serve(stdin, stdout, &options);
+    }
 
-        /* fopen(fullfilename,"r"); */
-        if (second_scan(fp1)){
-            printf("Can't finish the assembler process on file: %s.\n", fullfilename);
-            fclose(file);
-            free(fullfilename);
-            end_system();
-            continue;
-        }
-        
-        /* Only create output files if both scans completed successfully */
-        update_data(D_word_head,IC);
+    if (num_of_files == 0) {
+        fprintf(stderr, "No files were send to the assembler\n");
+        exit(1);
+    }
 
-        if (external_head != NULL) {
-            build_ext(external_head,filename);
+    if (link_output != NULL) {
+        modules = (char**)malloc(sizeof(char*) * num_of_files);
+        if (modules == NULL) {
+            fprintf(stderr, "Memory allocation error in main\n");
+            exit(1);
         }
-        if (entries_flag) {
-            build_ent(symbol_head,filename);
+        for (files = 0 ; files < num_of_files ; files++) {
+            modules[files] = jobs[files].filename;
+            destroy_diagnostics(&jobs[files].diagnostics);
         }
-        build_ob(D_word_head,order_head,filename,IC-100,DC);
+        status = link_modules(link_output, modules, num_of_files, &options);
+        free(modules);
+        free(jobs);
+        return status;
+    }
 
-        /* Clean up */
-        fclose(file);
-        free(fullfilename);
-        end_system();
+    if (options.jobs > 1 && num_of_files > 1) {
+        status = assemble_parallel(jobs, num_of_files, &options);
+    }
+    else {
+        init_assembly(&as);
+        for (files = 0 ; files < num_of_files ; files++) {
+            status |= assemble_file(&as, jobs[files].filename, &options);
+        }
+        destroy_assembly(&as);
     }
 
-    return 0;
-}
\ No newline at end of file
+    free(jobs);
+    return status;
+}
@@ -3,12 +3,11 @@
  * 
  * This file contains functions for managing Order structures, which represent
  * assembly instructions. It handles:
- * - Opcode validation and conversion
- * - Addressing mode determination
+ * - The instruction set description and table-driven mnemonic recognition
  * - Instruction size calculation
- * - Order list management
+ * - Relocation table management, with one id per referenced name
  * - Operand validation and processing
- * - External symbol resolution
+ * - Batch symbol resolution and external use marking
  */
 
 #include <stdio.h>
@@ -17,108 +16,96 @@
 #include "order.h"
 #include "helpers.h"
 #include "decode.h"
+#include "diag.h"
 
-/* Instruction opcode table - maps instruction names to their numeric codes */
-const char *ORDERS_TABLE[16] = {
-    "mov","cmp","add","sub","lea",
-    "clr","not","inc","dec","jmp",
-    "bne","jsr","red","prn","rts","stop"
-};
-
-/* Legal source operand addressing modes for each instruction */
-const int legal_src_modes[NUM_OPCODES][4] = {
-    /* mov */   {1, 1, 1, 1},  /* Immediate, Direct, Matrix, Register */
-    /* cmp */   {1, 1, 1, 1},
-    /* add */   {1, 1, 1, 1},
-    /* sub */   {1, 1, 1, 1},
-    /* lea */   {0, 1, 1, 0},  /* Only Direct and Matrix allowed */
-    /* clr */   {0, 0, 0, 0},  /* No source operand */
-    /* not */   {0, 0, 0, 0},
-    /* inc */   {0, 0, 0, 0},
-    /* dec */   {0, 0, 0, 0},
-    /* jmp */   {0, 0, 0, 0},
-    /* bne */   {0, 0, 0, 0},
-    /* jsr */   {0, 0, 0, 0},
-    /* red */   {0, 0, 0, 0},
-    /* prn */   {0, 0, 0, 0},
-    /* rts */   {0, 0, 0, 0},
-    /* stop */  {0, 0, 0, 0}
+/*
+ * The instruction set: every mnemonic with its opcode and the addressing
+ * modes it takes for the source and destination operands. The number of
+ * operands follows from the masks, so this one table drives operand
+ * scanning, mode validation and sizing.
+ */
+#define INSTRUCTION(name, opcode, src, dst) \
+    {name, sizeof(name) - 1, opcode, ((src) != MODES_NONE) + ((dst) != MODES_NONE), src, dst}
+
+const Instruction INSTRUCTIONS[NUM_OPCODES] = {
+    INSTRUCTION("mov",  0,  MODES_ANY,    MODES_WRITE),
+    INSTRUCTION("cmp",  1,  MODES_ANY,    MODES_ANY),
+    INSTRUCTION("add",  2,  MODES_ANY,    MODES_WRITE),
+    INSTRUCTION("sub",  3,  MODES_ANY,    MODES_WRITE),
+    INSTRUCTION("lea",  4,  MODES_MEMORY, MODES_WRITE),
+    INSTRUCTION("clr",  5,  MODES_NONE,   MODES_WRITE),
+    INSTRUCTION("not",  6,  MODES_NONE,   MODES_WRITE),
+    INSTRUCTION("inc",  7,  MODES_NONE,   MODES_WRITE),
+    INSTRUCTION("dec",  8,  MODES_NONE,   MODES_WRITE),
+    INSTRUCTION("jmp",  9,  MODES_NONE,   MODES_WRITE),
+    INSTRUCTION("bne",  10, MODES_NONE,   MODES_WRITE),
+    INSTRUCTION("jsr",  11, MODES_NONE,   MODES_WRITE),
+    INSTRUCTION("red",  12, MODES_NONE,   MODES_WRITE),
+    INSTRUCTION("prn",  13, MODES_NONE,   MODES_ANY),
+    INSTRUCTION("rts",  14, MODES_NONE,   MODES_NONE),
+    INSTRUCTION("stop", 15, MODES_NONE,   MODES_NONE)
 };
 
-/* Legal destination operand addressing modes for each instruction */
-const int legal_dst_modes[NUM_OPCODES][4] = {
-    /* mov */   {0, 1, 1, 1},  /* No immediate for destination */
-    /* cmp */   {1, 1, 1, 1},  /* All modes allowed for comparison */
-    /* add */   {0, 1, 1, 1},
-    /* sub */   {0, 1, 1, 1},
-    /* lea */   {0, 1, 1, 1},
-    /* clr */   {0, 1, 1, 1},
-    /* not */   {0, 1, 1, 1},
-    /* inc */   {0, 1, 1, 1},
-    /* dec */   {0, 1, 1, 1},
-    /* jmp */   {0, 1, 1, 1},
-    /* bne */   {0, 1, 1, 1},
-    /* jsr */   {0, 1, 1, 1},
-    /* red */   {0, 1, 1, 1},
-    /* prn */   {1, 1, 1, 1},  /* All modes allowed for printing */
-    /* rts */   {0, 0, 0, 0},  /* No destination operand */
-    /* stop */  {0, 0, 0, 0}
+/* Extra words each addressing mode adds to an instruction */
+const int MODE_WORDS[4] = {
+    1,  /* Immediate: the value */
+    1,  /* Direct: the address */
+    2,  /* Matrix: the address and the index registers */
+    1   /* Register: the register word, shared by two registers */
 };
 
 /*
- * Searches the ORDERS_TABLE for a matching instruction name and returns
- * its corresponding numeric opcode (0-15). Handles both 3 and 4 character
- * instruction names.
- */
-int opcode_in_decimal(const char* line,int index,int line_num) {
-    int i;
-    for (i = 0; i<16 ; i++) {
-        if (strncmp(line+index,ORDERS_TABLE[i],3)==0 || strncmp(line+index,ORDERS_TABLE[i],4)==0) {
-            return i;
-        }
-    }
-    printf("Error: Invalid opcode '%s' at line %d\n", line + index, line_num);
-    return -1;
-}
-
-/*
- * addressing_method - Determines the addressing mode of an operand
+ * Recognizes the mnemonic that starts at position index. The word runs
+ * up to the next whitespace or end of line and must match a mnemonic
+ * exactly, so "movx" or "stopp" are not taken for "mov" or "stop".
+ * The first characters select the only possible candidate, which is
+ * then confirmed with a single comparison. Returns NULL if the word is
+ * not a mnemonic.
  */
-int addressing_method(const char* line,int i,int line_num) {
-    if (is_direct(line,i,line_num) == 1 || is_direct(line,i,line_num) == 2) {
-        return 0;  /* Immediate addressing (#value) */
+const Instruction* find_instruction(const char* line,int index) {
+    const char *word = line + index;
+    int length = 0;
+    int op;
+
+    while (word[length] != '\0' && word[length] != ' ' && word[length] != '\t' &&
+           word[length] != '\n' && word[length] != '\r') {
+        length++;
     }
-    if (is_register(line,i,line_num)) {
-        return 3;  /* Register addressing (r0-r7) */
+    if (length < 3 || length > 4) {
+        return NULL;
     }
-    if (is_mat_operand(line,i,line_num)) {
-        return 2;  /* Matrix addressing (symbol[][]) */
+
+    switch (word[0]) {
+        case 'a': op = 2; break;                          /* add */
+        case 'b': op = 10; break;                         /* bne */
+        case 'c': op = (word[1] == 'm') ? 1 : 5; break;   /* cmp, clr */
+        case 'd': op = 8; break;                          /* dec */
+        case 'i': op = 7; break;                          /* inc */
+        case 'j': op = (word[2] == 'p') ? 9 : 11; break;  /* jmp, jsr */
+        case 'l': op = 4; break;                          /* lea */
+        case 'm': op = 0; break;                          /* mov */
+        case 'n': op = 6; break;                          /* not */
+        case 'p': op = 13; break;                         /* prn */
+        case 'r': op = (word[1] == 'e') ? 12 : 14; break; /* red, rts */
+        case 's': op = (length == 4) ? 15 : 3; break;     /* stop, sub */
+        default: return NULL;
     }
-    if (is_symbol(line,i)) {
-        return 1;  /* Direct addressing (symbol) */
+
+    if (INSTRUCTIONS[op].length != length || strncmp(word, INSTRUCTIONS[op].name, length) != 0) {
+        return NULL;
     }
-    return -1;  /* Invalid addressing mode */
+    return &INSTRUCTIONS[op];
 }
 
 /*
- * number_of_lines - Calculates the number of words needed for an instruction
+ * number_of_lines - Calculates the number of words needed for an
+ * instruction from the words of its operand modes, -1 for none
  */
 int number_of_lines(int operand1,int operand2) {
-    int lines = 1;  /* Base instruction word */
-    if (operand1 == 0 || operand1 == 1)
-        lines+= 1;  /* Immediate or direct addressing needs one extra word */
-    else if (operand1 == 2)
-        lines += 2; /* Matrix addressing needs two extra words */
-    else if (operand1 == 3) {
-        lines += 1; /* Register addressing needs one extra word */
-        if (operand2 == 3)
-            return lines; /* If both operands are registers, they share one word */
+    if (operand1 == ADDR_REGISTER && operand2 == ADDR_REGISTER) {
+        return 1 + MODE_WORDS[ADDR_REGISTER]; /* Both registers share one word */
     }
-    if (operand2 == 0 || operand2 == 1 || operand2 == 3) /* here they cant be both 3 */
-        lines += 1;
-    else if (operand2 == 2)
-        lines += 2;
-    return lines;
+    return 1 + (operand1 >= 0 ? MODE_WORDS[operand1] : 0) + (operand2 >= 0 ? MODE_WORDS[operand2] : 0);
 }
 
 
@@ -126,210 +113,204 @@ int number_of_lines(int operand1,int operand2) {
  * Returns the number of operands for a given opcode.
  */
 int number_of_operands(int op) {
-    if (op > -1 && op <  5)
-        return 2;
-    if (op > 4 && op < 14)
-        return 1;
-    return 0;
+    if (op < 0 || op >= NUM_OPCODES)
+        return 0;
+    return INSTRUCTIONS[op].operands;
 }
 
 /*
- * Creates a new Order structure and initializes all fields to default values.
- * Sets opcode, initializes operands to 0, and sets up memory pointers.
+ * Resets an Order structure for a new instruction.
+ * Sets opcode and address, and initializes operands to 0.
  */
-Order* new_order(int op) {
-    Order *tmp = (Order*)safe_malloc(sizeof(Order), "Memory allocation failed in new_order");
-    tmp->opcode = op;
-    tmp->operand1 = 0;
-    tmp->operand2 = 0;
-    tmp->symbol_flag = 0;
-    tmp->symbol_name1 = NULL;  /* Initialize to NULL */
-    tmp->symbol_name2 = NULL;  /* Initialize to NULL */
-    tmp->word = NULL;
-    tmp->IC = 0; /* Initialize IC to 0 */
-    tmp->next = NULL;
-    return tmp;
+void init_order(Order* order, int op, int IC) {
+    order->IC = IC;
+    order->opcode = op;
+    order->operand1 = 0;
+    order->operand2 = 0;
+    order->number_of_words = 0;
+    order->number_of_operands = 0;
 }
 
+#define INITIAL_RELOC_SLOTS 64     /* Starting number of name hash slots */
 
 /*
- * Adds a new order to the end of the linked list.
- * Handles both empty list and non-empty list cases.
+ * init_relocations - Prepares an empty relocation table whose symbol
+ * names are copied into arena
  */
-Order* add_order(Order** head,Order** tail,int op) { /* adding to the end */
-    Order* tmp;
-    tmp = new_order(op);
-    if (*head == NULL) {
-        *head = tmp;  /* First element in list */
-        *tail = tmp;
-        return tmp;
-    }
-    (*tail)->next = tmp;  /* Add to end of existing list */
-    *tail = tmp;
-    return tmp;
+void init_relocations(RelocTable* relocs, Arena* arena) {
+    relocs->entries = NULL;
+    relocs->count = 0;
+    relocs->capacity = 0;
+    relocs->symbols = NULL;
+    relocs->symbol_count = 0;
+    relocs->symbol_capacity = 0;
+    relocs->slots = NULL;
+    relocs->slot_capacity = 0;
+    relocs->externals = 0;
+    relocs->arena = arena;
 }
 
-int update_symbol_operands(Order* order_head, Symbol* symbol_head,Symbol** external_head) {
-    Symbol* extern_tail = NULL;
-    Order* curr_order = order_head;
-    Symbol* symbol;
-    Symbol* symbol2;
-    Word* first_data_word;
-    Word* curr_word2;
-    Symbol* new_ext;
-    Symbol* new_ext2;
-    int error_flag = 0;
-
-    /* Find the end of external symbols list for appending */
-    if (*external_head != NULL) {
-        extern_tail = *external_head;
-        while (extern_tail->next != NULL) {
-            extern_tail = extern_tail->next;
-        }
+/*
+ * Doubles the number of name slots and re-places every symbol id.
+ */
+static void grow_reloc_slots(RelocTable* relocs) {
+    int new_capacity = relocs->slot_capacity ? relocs->slot_capacity * 2 : INITIAL_RELOC_SLOTS;
+    int* new_slots = (int*)safe_malloc(sizeof(int) * new_capacity, "Memory allocation failed in add_relocation");
+    int mask = new_capacity - 1;
+    int i, j;
+
+    for (i = 0; i < new_capacity; i++) {
+        new_slots[i] = 0;
     }
-
-    /* Process each order that has symbols to resolve */
-    while (curr_order != NULL) {
-        if (curr_order->symbol_flag == 0) {
-            curr_order = curr_order->next;
-            continue;
-        }
-
-        /* First operand (symbol_name1) */
-       if (curr_order->symbol_name1 != NULL) {
-            symbol = search_symbol(symbol_head, curr_order->symbol_name1);
-            if (symbol == NULL) {
-                printf("Error: Undefined symbol %s\n", curr_order->symbol_name1);
-                error_flag = 1;
-                curr_order = curr_order->next;
-                continue;
-            }
-
-            first_data_word = curr_order->word->next;
-            if (symbol->type != 4) {
-                /* Internal symbol: encode address in 8 bits + "10" for internal reference */
-                strncpy(first_data_word->word, decode_number_in_8_bits(symbol->value), 8);
-                strcpy(first_data_word->word + 8, "10\0");
-            } else {
-                /* External symbol: encode address in 8 bits + "01" for external reference */
-                strncpy(first_data_word->word, decode_number_in_8_bits(symbol->value), 8);
-                strcpy(first_data_word->word + 8, "01\0");
-                printf("%s", first_data_word->word);
-
-                /* Create external reference */
-                new_ext = (Symbol*)safe_malloc(sizeof(Symbol), "Error: Memory allocation failed for extern symbol.");
-                new_ext->name = (char*)safe_malloc(strlen(curr_order->symbol_name1) + 1, "Memory allocation failed for symbol name");
-                strcpy(new_ext->name, curr_order->symbol_name1);
-                new_ext->value = curr_order->IC + 1;  /* Address where symbol is used */
-                new_ext->type = 4; /* Set type to external */
-                new_ext->next = NULL;
-
-                /* Add to external symbols list */
-                if (*external_head == NULL) {
-                    *external_head = new_ext;
-                    extern_tail = new_ext;
-                } else {
-                    extern_tail->next = new_ext;
-                    extern_tail = new_ext;
-                }
-            }
+    for (i = 0; i < relocs->symbol_count; i++) {
+        j = (int)(relocs->symbols[i].hash & mask);
+        while (new_slots[j] != 0) {
+            j = (j + 1) & mask;
         }
+        new_slots[j] = i + 1;
+    }
+    free(relocs->slots);
+    relocs->slots = new_slots;
+    relocs->slot_capacity = new_capacity;
+}
 
-        /* Second operand (symbol_name2) */
-        if (curr_order->symbol_name2 != NULL) {
-            symbol2 = search_symbol(symbol_head, curr_order->symbol_name2);
-            if (symbol2 == NULL) {
-                printf("Error: Undefined symbol %s\n", curr_order->symbol_name2);
-                error_flag = 1;
-                curr_order = curr_order->next;
-                continue;
-            }
-
-            /* Find the placeholder "0000000000" */
-            curr_word2 = curr_order->word;
-            while (curr_word2 != NULL && strcmp(curr_word2->word, "0000000000\0") != 0) {
-                curr_word2 = curr_word2->next;
-            }
-
-            if (curr_word2 == NULL) {
-                printf("Error: Placeholder for second operand not found in instruction.\n");
-                error_flag = 1;
-                curr_order = curr_order->next;
-                continue;
-            }
-
-            if (symbol2->type != 4) {
-                strncpy(curr_word2->word, decode_number_in_8_bits(symbol2->value), 8);
-                strcpy(curr_word2->word + 8, "10\0");
-            }
-            else {
-                strncpy(curr_word2->word, decode_number_in_8_bits(symbol2->value), 8);
-                strcpy(curr_word2->word + 8, "01\0");
-
-                /* Create external reference */
-                new_ext2 = (Symbol*)safe_malloc(sizeof(Symbol), "Error: Memory allocation failed for extern symbol.");
-                new_ext2->name = (char*)safe_malloc(strlen(curr_order->symbol_name2) + 1, "Memory allocation failed for symbol name");
-                strcpy(new_ext2->name, curr_order->symbol_name2);
-                new_ext2->value = curr_word2->address;
-                new_ext2->type = 4; /* Set type to external */
-                new_ext2->next = NULL;
+/*
+ * Returns the id of the first length characters of name, adding the
+ * name to the table the first time it is referenced, at line.
+ */
+static int symbol_id(RelocTable* relocs, const char* name, int length, int line) {
+    unsigned long hash = hash_text(name, (size_t)length);
+    RelocSymbol* symbol;
+    int mask, i;
 
-                /* Add to external symbols list */
-                if (*external_head == NULL) {
-                    *external_head = new_ext2;
-                    extern_tail = new_ext2;
-                } else {
-                    extern_tail->next = new_ext2;
-                    extern_tail = new_ext2;
-                }
-            }
+    if ((relocs->symbol_count + 1) * 2 > relocs->slot_capacity) {
+        grow_reloc_slots(relocs);
+    }
+    mask = relocs->slot_capacity - 1;
+    i = (int)(hash & mask);
+    while (relocs->slots[i] != 0) {
+        symbol = &relocs->symbols[relocs->slots[i] - 1];
+        if (symbol->hash == hash && strncmp(symbol->name, name, length) == 0 && symbol->name[length] == '\0') {
+            return relocs->slots[i] - 1;
         }
-
-        curr_order = curr_order->next;
+        i = (i + 1) & mask;
     }
 
-    return error_flag;
+    if (relocs->symbol_count == relocs->symbol_capacity) {
+        int new_capacity = relocs->symbol_capacity ? relocs->symbol_capacity * 2 : INITIAL_RELOC_SLOTS / 2;
+        relocs->symbols = (RelocSymbol*)safe_realloc(relocs->symbols, sizeof(RelocSymbol) * new_capacity,
+                                                     "Memory allocation failed in add_relocation");
+        relocs->symbol_capacity = new_capacity;
+    }
+    symbol = &relocs->symbols[relocs->symbol_count];
+    symbol->name = (char*)arena_alloc(relocs->arena, (size_t)length + 1, "Memory allocation failed in add_relocation");
+    memcpy(symbol->name, name, length);
+    symbol->name[length] = '\0';
+    symbol->hash = hash;
+    symbol->symbol = NULL;
+    symbol->line = line;
+    symbol->uses = 0;
+    relocs->slots[i] = relocs->symbol_count + 1;
+    return relocs->symbol_count++;
 }
 
-
 /*
- * Frees all memory allocated for orders and their associated data.
- * Recursively destroys word lists and symbol names.
+ * Appends a fixup for the code word at offset, referencing the first
+ * length characters of name at source line. Names get one id each, so
+ * repeated references share a single copy of the name.
  */
-void destroy_order(Order* head) {
-    Order* current = head;
-    while (current != NULL) {
-        Order* next = current->next;
+void add_relocation(RelocTable* relocs, int offset, const char* name, int length, int line) {
+    Relocation* entry;
+
+    if (relocs->count == relocs->capacity) {
+        int new_capacity = relocs->capacity ? relocs->capacity * 2 : 64;
+        relocs->entries = (Relocation*)safe_realloc(relocs->entries, sizeof(Relocation) * new_capacity,
+                                                    "Memory allocation failed in add_relocation");
+        relocs->capacity = new_capacity;
+    }
+    entry = &relocs->entries[relocs->count++];
+    entry->offset = offset;
+    entry->symbol = symbol_id(relocs, name, length, line);
+    entry->kind = RELOC_UNRESOLVED;
+    relocs->symbols[entry->symbol].uses++;
+}
 
-        if (current->word != NULL)
-            destroy_word(current->word);
-        if (current->symbol_name1 != NULL)
-            free(current->symbol_name1);
-        if (current->symbol_name2 != NULL)
-            free(current->symbol_name2);
+/*
+ * Drops the fixups recorded for words at or past code_count. Used to
+ * discard the words of an instruction that failed to assemble.
+ */
+void truncate_relocations(RelocTable* relocs, int code_count) {
+    while (relocs->count > 0 && relocs->entries[relocs->count - 1].offset >= code_count) {
+        relocs->symbols[relocs->entries[relocs->count - 1].symbol].uses--;
+        relocs->count--;
+    }
+}
 
+/*
+ * destroy_relocations - Frees the records and slots; the names go with
+ * the arena
+ */
+void destroy_relocations(RelocTable* relocs) {
+    free(relocs->entries);
+    free(relocs->symbols);
+    free(relocs->slots);
+    init_relocations(relocs, relocs->arena);
+}
 
-        current = next;
-    }
+/*
+ * relocated_word - Returns the operand word of a resolved relocation:
+ * the address of the symbol in 8 bits with ARE "10" for an internal
+ * symbol or "01" for an external one
+ */
+unsigned short relocated_word(const RelocTable* relocs, const Relocation* reloc) {
+    const Symbol* symbol = relocs->symbols[reloc->symbol].symbol;
+    return (unsigned short)((decode_number_in_8_bits(symbol->value) << 2) |
+                            (reloc->kind == RELOC_EXTERNAL ? ARE_EXTERNAL : ARE_RELOCATABLE));
 }
 
 /*
- * Adds a word to an order's word list.
- * Handles both empty list and non-empty list cases.
- * Sets appropriate addresses for each word.
+ * Resolves the relocations in one batch. Each referenced name is looked
+ * up once, reporting the names that are not defined at the line that
+ * first used them; then every operand word is patched by symbol id.
+ * Internal symbols are encoded with ARE "10" and external ones with
+ * "01", and the external uses are counted for the .ext file. Words
+ * already dropped from a streamed code image are left for the stream to
+ * patch.
  */
-void add_word_to_order(Order* order, Word* word) {
-    if (order->word == NULL) {
-        order->word = word;
-        order->word->address = order->IC;
-    } else {
-        Word* tmp = order->word;
-        while (tmp->next != NULL) {
-            tmp = tmp->next;
+int update_symbol_operands(Image* code, RelocTable* relocs, const SymbolIndex* index) {
+    RelocSymbol* name;
+    Relocation* reloc;
+    int error_flag = 0;
+    int i;
+
+    for (i = 0; i < relocs->symbol_count && !error_limit_reached(); i++) {
+        name = &relocs->symbols[i];
+        if (name->uses == 0) {
+            continue;
+        }
+        name->symbol = search_symbol(index, name->name);
+        if (name->symbol == NULL) {
+            report_error(name->line, "Undefined symbol %s\n", name->name);
+            error_flag = 1;
         }
-        tmp->next = word;
-        word->address = tmp->address + 1;
     }
-    word->next = NULL;
-}
+    if (error_flag) {
+        return error_flag;
+    }
 
+    relocs->externals = 0;
+    for (i = 0; i < relocs->count; i++) {
+        reloc = &relocs->entries[i];
+        if (relocs->symbols[reloc->symbol].symbol->type != 4) {
+            reloc->kind = RELOC_INTERNAL;
+        }
+        else {
+            reloc->kind = RELOC_EXTERNAL;
+            relocs->externals++;
+        }
+        if (reloc->offset >= code->base) {
+            code->words[reloc->offset - code->base] = relocated_word(relocs, reloc);
+        }
+    }
+    return error_flag;
+}
@@ -15,8 +15,9 @@
 /*
  * Order - Represents an assembly instruction
  * 
- * An order represents a single assembly instruction with its operands,
- * addressing modes, and associated binary words.
+ * An order describes the instruction currently being assembled: its
+ * opcode and operand addressing modes. Its words are written straight
+ * into the code image.
  */
 typedef struct Order {
     int IC;                    /* Instruction counter value */
@@ -25,36 +26,101 @@ typedef struct Order {
     int operand2;              /* Second operand addressing mode */
     int number_of_words;       /* Total words needed for instruction */
     int number_of_operands;    /* Number of operands (0-2) */
-    int symbol_flag;           /* Flag for symbol resolution */
-    char *symbol_name1;        /* First operand symbol name */
-    char *symbol_name2;        /* Second operand symbol name */
-    Word* word;                /* Pointer to instruction words */
-    struct Order *next;        /* Pointer to next order in list */
 }Order;
 
+/* Relocation kinds, set when the relocation is resolved */
+#define RELOC_UNRESOLVED 0     /* Symbol not looked up yet */
+#define RELOC_INTERNAL   1     /* Address of a symbol defined in the file */
+#define RELOC_EXTERNAL   2     /* Use of an .extern symbol, listed in the .ext file */
+
+/*
+ * RelocSymbol - One distinct symbol name referenced by operands
+ * 
+ * Every relocation naming the same symbol carries the same id, so the
+ * second pass looks each name up once and patches the words by id.
+ */
+typedef struct RelocSymbol {
+    char *name;                /* Referenced name, copied into the table arena */
+    unsigned long hash;        /* Hash of the name */
+    Symbol *symbol;            /* Resolved symbol, NULL until resolved */
+    int line;                  /* First source line that names it */
+    int uses;                  /* Relocations that carry this id */
+}RelocSymbol;
+
+/*
+ * Relocation - Operand word waiting for a symbol address
+ * 
+ * Recorded when an operand names a symbol; the word at offset in the
+ * code image is patched once every symbol is known.
+ */
+typedef struct Relocation {
+    int offset;                /* Index of the word in the code image */
+    int symbol;                /* Symbol id, an index into RelocTable.symbols */
+    int kind;                  /* RELOC_ kind of the reference */
+}Relocation;
+
+/*
+ * RelocTable - Growable array of relocations in code order, with the
+ * distinct names they reference hashed to symbol ids
+ */
+typedef struct RelocTable {
+    Relocation *entries;       /* Relocation records */
+    int count;                 /* Number of records in use */
+    int capacity;              /* Number of records allocated */
+    RelocSymbol *symbols;      /* Referenced names, indexed by symbol id */
+    int symbol_count;          /* Number of symbol ids */
+    int symbol_capacity;       /* Number of names allocated */
+    int *slots;                /* Hash slots holding symbol id + 1, 0 when empty */
+    int slot_capacity;         /* Number of slots (power of two) */
+    int externals;             /* RELOC_EXTERNAL records, counted when resolved */
+    Arena *arena;              /* Owner of the symbol name copies */
+}RelocTable;
+
 /* Addressing mode constants */
 #define ADDR_IMMEDIATE 0       /* Immediate addressing (#value) */
 #define ADDR_DIRECT    1       /* Direct addressing (symbol) */
 #define ADDR_MATRIX    2       /* Matrix addressing ([symbol]) */
 #define ADDR_REGISTER  3       /* Register addressing (r0-r7) */
 
+/* Sets of addressing modes, one bit per mode */
+#define MODE_BIT(mode) (1 << (mode))
+#define MODES_NONE   0                                                 /* No operand */
+#define MODES_ANY    0xF                                               /* Every mode */
+#define MODES_MEMORY (MODE_BIT(ADDR_DIRECT) | MODE_BIT(ADDR_MATRIX))   /* A label */
+#define MODES_WRITE  (MODES_MEMORY | MODE_BIT(ADDR_REGISTER))          /* Anything but immediate */
+
 #define NUM_OPCODES 16         /* Number of supported instructions */
 
-/* External arrays for operand validation */
-const int legal_dst_modes[NUM_OPCODES][4];  /* Legal destination modes per instruction */
-const int legal_src_modes[NUM_OPCODES][4];  /* Legal source modes per instruction */
+/*
+ * Instruction - Everything known about one mnemonic, found in one lookup
+ */
+typedef struct Instruction {
+    const char *name;          /* Mnemonic as written in the source */
+    int length;                /* Characters in the mnemonic */
+    int opcode;                /* Instruction opcode (0-15) */
+    int operands;              /* Number of operands (0-2), from the masks */
+    int src_modes;             /* MODE_BIT set of legal source modes */
+    int dst_modes;             /* MODE_BIT set of legal destination modes */
+}Instruction;
+
+/* Instruction set tables */
+extern const Instruction INSTRUCTIONS[NUM_OPCODES]; /* Instruction descriptions by opcode */
+extern const int MODE_WORDS[4];                    /* Extra words per addressing mode */
 
 /* Instruction processing functions */
-int opcode_in_decimal(const char* line,int index,int line_num);  /* Converts instruction name to opcode */
-int addressing_method(const char* line,int i,int line_num);      /* Determines operand addressing mode */
+const Instruction* find_instruction(const char* line,int index); /* Recognizes a mnemonic, NULL if none */
 int number_of_lines(int operand1,int operand2);                 /* Calculates instruction size */
 int number_of_operands(int op);                                 /* Returns number of operands for opcode */
 
 /* Order management functions */
-Order* new_order(int op);                                      /* Creates new order */
-Order* add_order(Order** head,Order** tail,int op);           /* Adds order to list */
-int update_symbol_operands(Order* order_head, Symbol* symbol_head,Symbol** external_head); /* Resolves symbols */
-void destroy_order(Order* head);                               /* Frees order list */
-void add_word_to_order(Order* order, Word* word);             /* Adds word to order */
+void init_order(Order* order, int op, int IC);                 /* Resets order for a new instruction */
+int update_symbol_operands(Image* code, RelocTable* relocs, const SymbolIndex* index); /* Resolves symbols */
+unsigned short relocated_word(const RelocTable* relocs, const Relocation* reloc); /* Operand word of a resolved fixup */
+
+/* Relocation table functions */
+void init_relocations(RelocTable* relocs, Arena* arena);       /* Prepares an empty table */
+void add_relocation(RelocTable* relocs, int offset, const char* name, int length, int line); /* Records an operand fixup */
+void truncate_relocations(RelocTable* relocs, int code_count); /* Drops fixups past the code end */
+void destroy_relocations(RelocTable* relocs);                  /* Frees the table */
 
 #endif /* ORDER_H */
\ No newline at end of file
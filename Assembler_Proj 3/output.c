@@ -8,40 +8,151 @@
  * - Entry symbol file generation
  * - External symbol file generation
  * - Base-4 encoding for addresses and data
+ * 
+ * Each file is formatted into an OutputBuffer with the precomputed
+ * base-4 tables, sized exactly beforehand, and written with one fwrite.
+ * The binary object (.bin) is built the same way, see output.h. With
+ * --max-memory the .ob file is streamed instead, see ObStream.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "output.h"
 #include "decode.h"
 #include "word.h"
 #include "symbolTable.h"
 #include "helpers.h"
+#include "diag.h"
+
+#define OB_LINE_LENGTH 11       /* "aaaa\tbbbbb\n": address, tab, word, newline */
+#define OB_HEADER_LENGTH 8      /* "\tbbb\tbb\n": tab, code length, tab, data length, newline */
+#define SYMBOL_LINE_EXTRA 6     /* Tab, 4 digit address and newline after the name */
+#define OB_STREAM_BATCH 64      /* Lines of a streamed .ob written per fwrite */
 
 /*
- * Creates a .ext file containing all external symbols and their addresses.
- * External symbols are those declared with .extern directive and used
- * in the assembly code. The addresses are encoded in base-4 format.
+ * init_output_buffer - Prepares an empty buffer with no memory allocated
  */
-void build_ext(Symbol* external_head,char *filename) {
-    FILE* file;
-    char *fullfilename = create_filename(filename, ".ext");
-    Symbol* current_head;
-    file = fopen(fullfilename,"w");
+void init_output_buffer(OutputBuffer *out) {
+    out->text = NULL;
+    out->capacity = 0;
+}
+
+/*
+ * destroy_output_buffer - Frees the text and leaves the buffer empty
+ */
+void destroy_output_buffer(OutputBuffer *out) {
+    free(out->text);
+    init_output_buffer(out);
+}
+
+/*
+ * Makes sure the buffer holds at least size bytes and returns its text.
+ */
+static char* reserve_output(OutputBuffer *out, size_t size) {
+    if (size > out->capacity) {
+        free(out->text);
+        out->text = (char*)safe_malloc(size, "Memory allocation error in reserve_output");
+        out->capacity = size;
+    }
+    return out->text;
+}
+
+/*
+ * Writes length bytes of text, such as a file formatted in an output
+ * buffer or restored from the cache, to <filename><suffix> in one call.
+ * Returns 1 if the file was written, and reports and returns 0 if it
+ * can't be.
+ */
+int write_output_file(char *filename, const char *suffix, const char *text, size_t length) {
+    char *fullfilename = create_filename(filename, suffix);
+    FILE* file = fopen(fullfilename,"w");
+    int ok;
+
     if (!file) {
-        printf("Error: Could not create file: %s\n",fullfilename);
+        report("Error: Could not create file %s\n", fullfilename);
         free(fullfilename);
-        exit(1);
+        return 0;
     }
-    current_head = external_head;
-    while (current_head != NULL) {
-         /* extern type */
-        fprintf(file,"%s\t%s\n",current_head->name,address_to_base4(current_head->value));
-        current_head = current_head->next;
+    ok = length == 0 || fwrite(text, 1, length, file) == length;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) {
+        report("Error: Could not write file %s\n", fullfilename);
     }
-    fclose(file);
     free(fullfilename);
+    return ok;
+}
+
+/*
+ * Appends "name\taddress\n" with a 4 digit base-4 address and returns
+ * the position after it.
+ */
+static char* put_symbol_line(char *p, const char *name, int address) {
+    size_t len = strlen(name);
+    memcpy(p, name, len);
+    p += len;
+    *p++ = '\t';
+    memcpy(p, BASE4_QUADS[address & 0xFF], 4);
+    p += 4;
+    *p++ = '\n';
+    return p;
+}
+
+/*
+ * Appends "address\tword\n" for one object file word and returns the
+ * position after it. The word is its top digit followed by the quad of
+ * its low byte.
+ */
+static char* put_word_line(char *p, int address, unsigned int word) {
+    memcpy(p, BASE4_QUADS[address & 0xFF], 4);
+    p[4] = '\t';
+    p[5] = BASE4_DIGITS[(word >> 8) & 3];
+    memcpy(p + 6, BASE4_QUADS[word & 0xFF], 4);
+    p[10] = '\n';
+    return p + OB_LINE_LENGTH;
+}
+
+/*
+ * Appends the .ob header with the instruction and data counters (3 and
+ * 2 digits) and returns the position after it.
+ */
+static char* put_ob_header(char *p, int ICF, int DCF) {
+    *p++ = '\t';
+    memcpy(p, BASE4_QUADS[ICF & 0x3F] + 1, 3);
+    p += 3;
+    *p++ = '\t';
+    memcpy(p, BASE4_QUADS[DCF & 0xF] + 2, 2);
+    p += 2;
+    *p++ = '\n';
+    return p;
+}
+
+/*
+ * Creates a .ext file listing every use of an external symbol with the
+ * address of the word that uses it, taken from the resolved relocation
+ * table in code order. The addresses are encoded in base-4 format.
+ */
+size_t build_ext(const RelocTable* relocs,OutputBuffer *out) {
+    const Relocation* reloc;
+    size_t size = 0;
+    char *p;
+    int i;
+
+    for (i = 0; i < relocs->count; i++) {
+        reloc = &relocs->entries[i];
+        if (reloc->kind == RELOC_EXTERNAL) {
+            size += strlen(relocs->symbols[reloc->symbol].name) + SYMBOL_LINE_EXTRA;
+        }
+    }
+    p = reserve_output(out, size);
+    for (i = 0; i < relocs->count; i++) {
+        reloc = &relocs->entries[i];
+        if (reloc->kind == RELOC_EXTERNAL) {
+            p = put_symbol_line(p, relocs->symbols[reloc->symbol].name, IC_START + reloc->offset);
+        }
+    }
+    return size;
 }
 
 /*
@@ -49,25 +160,23 @@ void build_ext(Symbol* external_head,char *filename) {
  * Entry symbols are those declared with .entry directive. The addresses
  * are encoded in base-4 format.
  */
-void build_ent(Symbol* symbol_head,char *filename) {
-    FILE* file;
-    char *fullfilename = create_filename(filename, ".ent");
+size_t build_ent(Symbol* symbol_head,OutputBuffer *out) {
     Symbol* current_head;
-    file = fopen(fullfilename,"w");
-    if (!file) {
-        printf("Error: Could not create file %s\n",fullfilename);
-        free(fullfilename);
-        exit(1);
-    }
-    current_head = symbol_head;
-    while (current_head != NULL) {
+    size_t size = 0;
+    char *p;
+
+    for (current_head = symbol_head; current_head != NULL; current_head = current_head->next) {
         if (current_head->type == 3) {  /* Entry symbol type */
-            fprintf(file,"%s\t%s\n",current_head->name,address_to_base4(current_head->value));
+            size += strlen(current_head->name) + SYMBOL_LINE_EXTRA;
         }
-        current_head = current_head->next;
     }
-    fclose(file);
-    free(fullfilename);
+    p = reserve_output(out, size);
+    for (current_head = symbol_head; current_head != NULL; current_head = current_head->next) {
+        if (current_head->type == 3) {
+            p = put_symbol_line(p, current_head->name, current_head->value);
+        }
+    }
+    return size;
 }
 
 /*
@@ -77,37 +186,268 @@ void build_ent(Symbol* symbol_head,char *filename) {
  * - All data words with their addresses
  * - All addresses and data encoded in base-4 format
  */
-void build_ob(Word* Dword_head,Order* order_head, char *filename,int ICF,int DCF) {
-    FILE* file;
-    char *fullfilename = create_filename(filename, ".ob");
-    Order* current_order;
-    Word* current_data_word;
-    file = fopen(fullfilename,"w");
-    if (!file) {
-        printf("Error: Could not create file %s\n",fullfilename);
-        free(fullfilename);
-        exit(1);
-    }
-    /* Write header with instruction and data counters */
-    fprintf(file,"\t%s\t%s\n",header_address_to_base4(ICF),header_code_to_base4(DCF));
-
-    /* Process order words (instructions) */
-    current_order = order_head;
-    while (current_order != NULL) {
-        Word* current_word = current_order->word;
-        while (current_word != NULL) {
-            fprintf(file,"%s\t%s\n",address_to_base4(current_word->address),binary_to_special_base4(current_word->word));
-            current_word = current_word->next;
+size_t build_ob(const Image* code,const Image* data,int ICF,int DCF,OutputBuffer *out) {
+    size_t size = OB_HEADER_LENGTH + (size_t)(code->count + data->count) * OB_LINE_LENGTH;
+    char *p = reserve_output(out, size);
+    int i;
+
+    p = put_ob_header(p, ICF, DCF);
+
+    /* Process code words (instructions) */
+    for (i = 0; i < code->count; i++) {
+        p = put_word_line(p, IC_START + i, code->words[i]);
+    }
+
+    /* Process data words, placed right after the code */
+    for (i = 0; i < data->count; i++) {
+        p = put_word_line(p, IC_START + code->count + i, data->words[i]);
+    }
+    return size;
+}
+
+/*
+ * Stores value as a little-endian 32 bit field and returns the position
+ * after it.
+ */
+static char* put_u32(char *p, unsigned long value) {
+    p[0] = (char)(value & 0xFF);
+    p[1] = (char)((value >> 8) & 0xFF);
+    p[2] = (char)((value >> 16) & 0xFF);
+    p[3] = (char)((value >> 24) & 0xFF);
+    return p + 4;
+}
+
+/*
+ * Stores the words of image as little-endian 16 bit fields and returns
+ * the position after them.
+ */
+static char* put_words(char *p, const Image *image) {
+    int i;
+
+    for (i = 0; i < image->count; i++) {
+        *p++ = (char)(image->words[i] & 0xFF);
+        *p++ = (char)(image->words[i] >> 8);
+    }
+    return p;
+}
+
+/*
+ * Stores one symbol table row, its address and the offset of its name
+ * in the string table, and copies the name there. Returns the position
+ * after the row and advances *strings past the name.
+ */
+static char* put_symbol_row(char *p, const char *name, int address, char *strings_start, char **strings) {
+    size_t len = strlen(name) + 1;
+
+    p = put_u32(p, (unsigned long)address);
+    p = put_u32(p, (unsigned long)(*strings - strings_start));
+    memcpy(*strings, name, len);
+    *strings += len;
+    return p;
+}
+
+/*
+ * Creates a .bin file, the binary form of the .ob file together with the
+ * entry and extern tables of the .ent and .ext files. The layout is
+ * described in output.h; the file is sized exactly and written at once.
+ */
+size_t build_bin(const Image* code,const Image* data,Symbol* symbol_head,const RelocTable* relocs,OutputBuffer *out) {
+    size_t words_length = ((size_t)(code->count + data->count) * 2 + 3) & ~(size_t)3;
+    size_t strings_length = 0;
+    unsigned long entries = 0;
+    unsigned long externs = 0;
+    const Symbol *current;
+    const Relocation *reloc;
+    char *p;
+    char *strings;
+    char *strings_start;
+    size_t size;
+    int i;
+
+    for (current = symbol_head; current != NULL; current = current->next) {
+        if (current->type == 3) {
+            entries++;
+            strings_length += strlen(current->name) + 1;
+        }
+    }
+    for (i = 0; i < relocs->count; i++) {
+        reloc = &relocs->entries[i];
+        if (reloc->kind == RELOC_EXTERNAL) {
+            externs++;
+            strings_length += strlen(relocs->symbols[reloc->symbol].name) + 1;
+        }
+    }
+    size = BIN_HEADER_LENGTH + words_length + (entries + externs) * BIN_SYMBOL_LENGTH + strings_length;
+    p = reserve_output(out, size);
+
+    memcpy(p, BIN_MAGIC, 4);
+    p = put_u32(p + 4, BIN_VERSION);
+    p = put_u32(p, IC_START);
+    p = put_u32(p, (unsigned long)code->count);
+    p = put_u32(p, (unsigned long)data->count);
+    p = put_u32(p, entries);
+    p = put_u32(p, externs);
+    p = put_u32(p, (unsigned long)strings_length);
+
+    p = put_words(p, code);
+    p = put_words(p, data);
+    while ((size_t)(p - out->text) < BIN_HEADER_LENGTH + words_length) {
+        *p++ = 0;
+    }
+
+    strings_start = out->text + size - strings_length;
+    strings = strings_start;
+    for (current = symbol_head; current != NULL; current = current->next) {
+        if (current->type == 3) {
+            p = put_symbol_row(p, current->name, current->value, strings_start, &strings);
+        }
+    }
+    for (i = 0; i < relocs->count; i++) {
+        reloc = &relocs->entries[i];
+        if (reloc->kind == RELOC_EXTERNAL) {
+            p = put_symbol_row(p, relocs->symbols[reloc->symbol].name, IC_START + reloc->offset,
+                               strings_start, &strings);
+        }
+    }
+    return size;
+}
+
+/*
+ * init_ob_stream - Prepares a stream with no file open
+ */
+void init_ob_stream(ObStream *stream) {
+    stream->file = NULL;
+    stream->path = NULL;
+}
+
+/*
+ * open_ob_stream - Starts the .ob file of filename under a temporary
+ * name, with room for the header. Returns 1 if the file was created, and
+ * reports and returns 0 if it can't be.
+ */
+int open_ob_stream(ObStream *stream, char *filename) {
+    char header[OB_HEADER_LENGTH];
+
+    stream->path = create_filename(filename, ".ob.tmp");
+    stream->file = fopen(stream->path, "w+b");
+    if (!stream->file) {
+        report("Error: Could not create file %s\n", stream->path);
+        free(stream->path);
+        stream->path = NULL;
+        return 0;
+    }
+    memset(header, ' ', sizeof(header));
+    fwrite(header, 1, sizeof(header), stream->file);
+    return 1;
+}
+
+/*
+ * Writes the lines of count words, the first at address, at the current
+ * position of the stream.
+ */
+static void put_stream_words(ObStream *stream, int address, const unsigned short *words, int count) {
+    char lines[OB_STREAM_BATCH * OB_LINE_LENGTH];
+    char *p;
+    int i = 0;
+    int n;
+
+    while (i < count) {
+        p = lines;
+        for (n = 0; n < OB_STREAM_BATCH && i < count; n++, i++) {
+            p = put_word_line(p, address + i, words[i]);
         }
-        current_order = current_order->next;
+        fwrite(lines, 1, (size_t)(p - lines), stream->file);
     }
+}
 
-    /* Process data words */
-    current_data_word = Dword_head;
-    while (current_data_word != NULL) {
-        fprintf(file,"%s\t%s\n",address_to_base4(current_data_word->address),binary_to_special_base4(current_data_word->word));
-        current_data_word = current_data_word->next;
+/*
+ * stream_code_words - Writes the code words in use, placeholders of
+ * symbol operands included, and drops them from the image
+ */
+void stream_code_words(ObStream *stream, Image *code) {
+    put_stream_words(stream, IC_START + code->base, code->words, code->count);
+    drop_image_words(code);
+}
+
+/*
+ * Patches the operand words that were written before their symbols were
+ * resolved. The fixups are in code order, so the file is read back and
+ * rewritten in windows of OB_STREAM_WORDS lines, each holding one or
+ * more fixups, instead of seeking once for every word. Returns 0 if the
+ * file could not be read back.
+ */
+static int patch_stream_words(ObStream *stream, const Image *code, const RelocTable *relocs) {
+    char *lines = (char*)safe_malloc(OB_STREAM_WORDS * OB_LINE_LENGTH, "Memory allocation error in patch_stream_words");
+    const Relocation *reloc;
+    long start;                 /* Offset of the first word of the window */
+    long count;                 /* Words in the window */
+    int ok = 1;
+    int i = 0;
+
+    while (ok && i < relocs->count && relocs->entries[i].offset < code->base) {
+        start = relocs->entries[i].offset;
+        count = code->base - start < OB_STREAM_WORDS ? code->base - start : OB_STREAM_WORDS;
+        fseek(stream->file, OB_HEADER_LENGTH + start * OB_LINE_LENGTH, SEEK_SET);
+        if (fread(lines, OB_LINE_LENGTH, (size_t)count, stream->file) != (size_t)count) {
+            ok = 0;
+            break;
+        }
+        for (; i < relocs->count && relocs->entries[i].offset < start + count; i++) {
+            reloc = &relocs->entries[i];
+            put_word_line(lines + (reloc->offset - start) * OB_LINE_LENGTH, IC_START + reloc->offset,
+                          relocated_word(relocs, reloc));
+        }
+        fseek(stream->file, OB_HEADER_LENGTH + start * OB_LINE_LENGTH, SEEK_SET);
+        fwrite(lines, OB_LINE_LENGTH, (size_t)count, stream->file);
     }
-    fclose(file);
+    free(lines);
+    return ok;
+}
+
+/*
+ * finish_ob_stream - Writes the code words left in the image and the
+ * data words, patches the operand words that were written before their
+ * symbols were resolved, fills in the header and renames the file to
+ * <filename>.ob. Returns 1 if the file was written, and reports, removes
+ * the temporary file and returns 0 if it can't be.
+ */
+int finish_ob_stream(ObStream *stream, const Image *code, const Image *data, const RelocTable *relocs,
+                      char *filename, int ICF, int DCF) {
+    char *fullfilename = create_filename(filename, ".ob");
+    char header[OB_HEADER_LENGTH];
+    int ok;
+
+    put_stream_words(stream, IC_START + code->base, code->words, code->count);
+    put_stream_words(stream, IC_START + code->base + code->count, data->words, data->count);
+    ok = patch_stream_words(stream, code, relocs);
+    fseek(stream->file, 0, SEEK_SET);
+    put_ob_header(header, ICF, DCF);
+    fwrite(header, 1, OB_HEADER_LENGTH, stream->file);
+
+    ok = !ferror(stream->file) && ok;
+    ok = fclose(stream->file) == 0 && ok;
+    stream->file = NULL;
+    ok = ok && rename(stream->path, fullfilename) == 0;
+    if (!ok) {
+        report("Error: Could not create file %s\n", fullfilename);
+        remove(stream->path);
+    }
+    free(stream->path);
+    stream->path = NULL;
     free(fullfilename);
-}
\ No newline at end of file
+    return ok;
+}
+
+/*
+ * close_ob_stream - Closes and removes the temporary file of a stream
+ * that was not finished, such as one of a file with errors
+ */
+void close_ob_stream(ObStream *stream) {
+    if (stream->file != NULL) {
+        fclose(stream->file);
+        remove(stream->path);
+        stream->file = NULL;
+    }
+    free(stream->path);
+    stream->path = NULL;
+}
@@ -8,9 +8,71 @@
 #ifndef OUTPUT_H
 #define OUTPUT_H
 
-/* Output file generation functions */
-void build_ext(Symbol* external_head,char *filename);           /* Generates external symbols file (.ext) */
-void build_ent(Symbol* symbol_head,char *filename);             /* Generates entry symbols file (.ent) */
-void build_ob(Word* Dword_head,Order* order_head, char *filename,int ICF,int DCF); /* Generates object file (.ob) */
+#include <stdio.h>
+#include <stddef.h>
+#include "symbolTable.h"
+#include "word.h"
+#include "order.h"
 
-#endif /* OUTPUT_H */
\ No newline at end of file
+/*
+ * Binary object (.bin) layout, written by build_bin. All fields are
+ * little-endian so the file can be mapped and read in place:
+ *   header   8 u32 fields: magic "A4OB", format version, address of the
+ *            first code word, code words (ICF), data words (DCF), entry
+ *            count, extern count, string table bytes
+ *   words    ICF code words then DCF data words, one u16 each, padded
+ *            with zeros to a multiple of 4 bytes
+ *   entries  entry count pairs of u32: address, name offset
+ *   externs  extern count pairs of u32: address of the use, name offset
+ *   strings  null-terminated names, offsets counted from its start
+ */
+#define BIN_MAGIC "A4OB"
+#define BIN_VERSION 1
+#define BIN_HEADER_LENGTH 32
+#define BIN_SYMBOL_LENGTH 8
+
+#define OB_STREAM_WORDS 4096        /* Code words kept before a streamed .ob is written to */
+
+/*
+ * OutputBuffer - Caller-owned text buffer an output file is formatted
+ * into before being written in one call. It only grows, so a buffer
+ * reused across files stops allocating after the largest one.
+ */
+typedef struct OutputBuffer {
+    char *text;                 /* Formatted file contents */
+    size_t capacity;            /* Bytes allocated for text */
+}OutputBuffer;
+
+/*
+ * ObStream - .ob file written while the code is assembled, for
+ * --max-memory. The header and the lines of the file have a fixed width,
+ * so code words are written out as the first pass encodes them, and the
+ * words of symbol operands are patched in place once they are resolved.
+ * The file has a temporary name until it is complete.
+ */
+typedef struct ObStream {
+    FILE *file;                 /* Temporary .ob file, NULL when not streaming */
+    char *path;                 /* Name of the temporary file */
+}ObStream;
+
+/* Output buffer functions */
+void init_output_buffer(OutputBuffer *out);                     /* Prepares an empty buffer */
+void destroy_output_buffer(OutputBuffer *out);                  /* Frees the buffer */
+
+/* Output file generation functions; each formats its file in out and returns its size,
+ * which write_output_file then writes out */
+size_t build_ext(const RelocTable* relocs,OutputBuffer *out);    /* Generates external symbols file (.ext) */
+size_t build_ent(Symbol* symbol_head,OutputBuffer *out);         /* Generates entry symbols file (.ent) */
+size_t build_ob(const Image* code,const Image* data,int ICF,int DCF,OutputBuffer *out); /* Generates object file (.ob) */
+size_t build_bin(const Image* code,const Image* data,Symbol* symbol_head,const RelocTable* relocs,OutputBuffer *out); /* Generates binary object (.bin) */
+int write_output_file(char *filename, const char *suffix, const char *text, size_t length); /* Writes <filename><suffix>, 0 if it failed */
+
+/* Streamed object file functions */
+void init_ob_stream(ObStream *stream);                          /* Prepares a stream with no file */
+int open_ob_stream(ObStream *stream, char *filename);           /* Starts writing <filename>.ob, 0 if it failed */
+void stream_code_words(ObStream *stream, Image *code);          /* Writes and drops the code words in use */
+int finish_ob_stream(ObStream *stream, const Image *code, const Image *data, const RelocTable *relocs,
+                     char *filename, int ICF, int DCF);         /* Completes and renames the file, 0 if it failed */
+void close_ob_stream(ObStream *stream);                         /* Discards an unfinished file */
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,281 @@
+/*
+ * profile.c - Hot spot report
+ *
+ * This file turns execution counts per code address into the .prof
+ * report. The first pass records the .am line of every code word and
+ * the preprocessor the origin of every .am line, so each count is
+ * charged to its line, to the nearest code label at or before its
+ * address, and to the macro expansion the line came from, if any.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+#include "helpers.h"
+#include "input.h"
+#include "output.h"
+#include "macros.h"
+#include "sim.h"
+#include "diag.h"
+
+/*
+ * HotSpot - One ranked row: a label, a macro expansion or a line
+ */
+typedef struct HotSpot {
+    unsigned long count;        /* Instructions executed in it */
+    int key;                    /* Address, call line or .am line, for ties and order */
+    const char *name;           /* Label or macro name, NULL for a line */
+    int line;                   /* .am line, or the definition line of a macro */
+}HotSpot;
+
+/*
+ * Orders hot spots by count, highest first, then by key
+ */
+static int compare_hot_spots(const void *a, const void *b) {
+    const HotSpot *x = (const HotSpot*)a;
+    const HotSpot *y = (const HotSpot*)b;
+
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->key - y->key;
+}
+
+/*
+ * Orders hot spots by key, lowest first
+ */
+static int compare_keys(const void *a, const void *b) {
+    return ((const HotSpot*)a)->key - ((const HotSpot*)b)->key;
+}
+
+/*
+ * Appends the count and share columns of a ranked row
+ */
+static void put_count(SourceText *report, unsigned long count, unsigned long total) {
+    char text[64];
+
+    sprintf(text, "; %10lu  %5.1f%%  ", count, total > 0 ? 100.0 * count / total : 0.0);
+    append_source(report, text);
+}
+
+/*
+ * Appends a line of the expanded source without its line ending
+ */
+static void put_source_text(SourceText *report, const LineView *view) {
+    size_t length = view->length;
+
+    while (length > 0 && (view->text[length - 1] == '\n' || view->text[length - 1] == '\r')) {
+        length--;
+    }
+    append_source_bytes(report, view->text, length);
+}
+
+/*
+ * new_profile - Allocates zeroed counts for every address the code or
+ * the simulator can use, and stores their number in size
+ */
+unsigned long* new_profile(const Assembly *as, int *size) {
+    unsigned long *counts;
+
+    *size = as->IC > SIM_MEMORY_WORDS ? as->IC : SIM_MEMORY_WORDS;
+    counts = (unsigned long*)safe_malloc(sizeof(unsigned long) * *size, "Memory allocation error in new_profile");
+    memset(counts, 0, sizeof(unsigned long) * *size);
+    return counts;
+}
+
+/*
+ * read_profile - Adds the counts of a profile file to counts, which has
+ * size entries. Reports and returns 0 if the file can't be read or a
+ * line is not an address and a count.
+ */
+int read_profile(const char *path, unsigned long *counts, int size) {
+    char line[MAX_LINE_LENGTH * 2];
+    unsigned long address;
+    unsigned long count;
+    int num_of_line = 0;
+    int ok = 1;
+    char first;                 /* First character after the indentation */
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL) {
+        report("Can't open profile %s or it does not exist.\n", path);
+        return 0;
+    }
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        num_of_line++;
+        first = line[skip_spaces(line, 0)];
+        if (first == '\0' || first == '\n' || first == ';' || first == '#') {
+            continue;
+        }
+        if (sscanf(line, "%lu %lu", &address, &count) != 2) {
+            report("%s:%d: Error: expected an address and a count\n", path, num_of_line);
+            ok = 0;
+        }
+        else if (address < (unsigned long)size) {
+            counts[address] += count;
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+/*
+ * write_profile - Writes the hot spot report of the file to
+ * <filename>.prof: the hottest labels, macro expansions and lines, then
+ * every line of the expanded source with the instructions run on it.
+ * Returns 1 if the file could not be written.
+ */
+int write_profile(const Assembly *as, const unsigned long *counts, char *filename) {
+    int code_count = as->IC - IC_START;  /* Words in the code image */
+    int num_of_lines = as->origins.count; /* Lines in the expanded source */
+    unsigned long *line_counts;          /* Instructions run on each .am line */
+    unsigned long total = 0;             /* Instructions run in all */
+    LineView *views;                     /* Text of each .am line */
+    HotSpot *labels;                     /* Code labels and their counts */
+    HotSpot *expansions;                 /* Macro calls and their counts */
+    HotSpot *lines;                      /* Lines that ran */
+    int label_count = 0;
+    int expansion_count = 0;
+    int line_count = 0;
+    int written;                         /* Set if the .prof file was written */
+    const Symbol *symbol;
+    const LineOrigin *origin;
+    SourceText report;                   /* Text of the report */
+    size_t position = 0;
+    char text[3 * MAX_LINE_LENGTH];
+    int current;
+    int address;
+    int i;
+
+    /* Find the text of every line and charge every address to its line */
+    views = (LineView*)safe_malloc(sizeof(LineView) * (num_of_lines + 1), "Memory allocation error in write_profile");
+    line_counts = (unsigned long*)safe_malloc(sizeof(unsigned long) * (num_of_lines + 1),
+                                             "Memory allocation error in write_profile");
+    memset(line_counts, 0, sizeof(unsigned long) * (num_of_lines + 1));
+    for (i = 1; i <= num_of_lines; i++) {
+        if (!next_line(as->expanded_source.text, as->expanded_source.length, &position, &views[i])) {
+            views[i].text = "";
+            views[i].length = 0;
+        }
+    }
+    for (i = 0; i < code_count && i < as->code_lines.count; i++) {
+        if (as->code_lines.lines[i] <= num_of_lines) {
+            line_counts[as->code_lines.lines[i]] += counts[IC_START + i];
+        }
+        total += counts[IC_START + i];
+    }
+
+    /* Charge every address to the nearest code label at or before it */
+    for (symbol = as->symbol_head; symbol != NULL; symbol = symbol->next) {
+        label_count++;
+    }
+    labels = (HotSpot*)safe_malloc(sizeof(HotSpot) * (label_count + 1), "Memory allocation error in write_profile");
+    label_count = 0;
+    for (symbol = as->symbol_head; symbol != NULL; symbol = symbol->next) {
+        if ((symbol->type == 2 || symbol->type == 3) && symbol->value >= IC_START && symbol->value < as->IC) {
+            labels[label_count].count = 0;
+            labels[label_count].key = symbol->value;
+            labels[label_count].name = symbol->name;
+            labels[label_count].line = as->code_lines.lines[symbol->value - IC_START];
+            label_count++;
+        }
+    }
+    qsort(labels, label_count, sizeof(HotSpot), compare_keys);
+    current = -1;
+    for (address = IC_START; address < as->IC; address++) {
+        while (current + 1 < label_count && labels[current + 1].key <= address) {
+            current++;
+        }
+        if (current >= 0) {
+            labels[current].count += counts[address];
+        }
+    }
+
+    /* Charge every expanded line to its macro call; a call's lines are consecutive */
+    expansions = (HotSpot*)safe_malloc(sizeof(HotSpot) * (num_of_lines + 1), "Memory allocation error in write_profile");
+    lines = (HotSpot*)safe_malloc(sizeof(HotSpot) * (num_of_lines + 1), "Memory allocation error in write_profile");
+    for (i = 1; i <= num_of_lines; i++) {
+        origin = find_origin(&as->origins, i);
+        if (origin->macro != NULL) {
+            if (expansion_count == 0 || expansions[expansion_count - 1].key != origin->call_line ||
+                expansions[expansion_count - 1].name != origin->macro->name) {
+                expansions[expansion_count].count = 0;
+                expansions[expansion_count].key = origin->call_line;
+                expansions[expansion_count].name = origin->macro->name;
+                expansions[expansion_count].line = origin->macro->line;
+                expansion_count++;
+            }
+            expansions[expansion_count - 1].count += line_counts[i];
+        }
+        if (line_counts[i] > 0) {
+            lines[line_count].count = line_counts[i];
+            lines[line_count].key = i;
+            lines[line_count].name = NULL;
+            lines[line_count].line = i;
+            line_count++;
+        }
+    }
+
+    init_source(&report);
+    sprintf(text, "; Hot spots of %.*s.as: %lu instructions\n", MAX_LINE_LENGTH, filename, total);
+    append_source(&report, text);
+
+    append_source(&report, ";\n; Labels\n;      count   share  label\n");
+    qsort(labels, label_count, sizeof(HotSpot), compare_hot_spots);
+    for (i = 0; i < label_count && i < PROFILE_TOP && labels[i].count > 0; i++) {
+        put_count(&report, labels[i].count, total);
+        sprintf(text, "%s (address %d, .am line %d)\n", labels[i].name, labels[i].key, labels[i].line);
+        append_source(&report, text);
+    }
+
+    append_source(&report, ";\n; Macro expansions\n;      count   share  macro\n");
+    qsort(expansions, expansion_count, sizeof(HotSpot), compare_hot_spots);
+    for (i = 0; i < expansion_count && i < PROFILE_TOP && expansions[i].count > 0; i++) {
+        put_count(&report, expansions[i].count, total);
+        sprintf(text, "%s (defined at .as line %d, called at .as line %d)\n",
+                expansions[i].name, expansions[i].line, expansions[i].key);
+        append_source(&report, text);
+    }
+
+    append_source(&report, ";\n; Lines\n;      count   share  line\n");
+    qsort(lines, line_count, sizeof(HotSpot), compare_hot_spots);
+    for (i = 0; i < line_count && i < PROFILE_TOP; i++) {
+        origin = find_origin(&as->origins, lines[i].line);
+        put_count(&report, lines[i].count, total);
+        if (origin->macro != NULL) {
+            sprintf(text, ".am line %d, .as line %d in mcro %s called at line %d: ", lines[i].line,
+                    origin->line, origin->macro->name, origin->call_line);
+        }
+        else {
+            sprintf(text, ".am line %d, .as line %d: ", lines[i].line, origin->line);
+        }
+        append_source(&report, text);
+        put_source_text(&report, &views[lines[i].line]);
+        append_source(&report, "\n");
+    }
+
+    /* The expanded source with the count of every line that ran */
+    append_source(&report, ";\n; Annotated source\n");
+    for (i = 1; i <= num_of_lines; i++) {
+        if (line_counts[i] > 0) {
+            sprintf(text, "%10lu | ", line_counts[i]);
+        }
+        else {
+            sprintf(text, "%10s | ", "");
+        }
+        append_source(&report, text);
+        put_source_text(&report, &views[i]);
+        append_source(&report, "\n");
+    }
+
+    written = write_output_file(filename, ".prof", report.text, report.length);
+    destroy_source(&report);
+    free(lines);
+    free(expansions);
+    free(labels);
+    free(line_counts);
+    free(views);
+    return !written;
+}
@@ -0,0 +1,27 @@
+/*
+ * profile.h - Hot spot report header
+ *
+ * This header file declares the --profile report. Given how many times
+ * each code address ran, from the simulator or from a profile file, it
+ * writes <filename>.prof ranking the hottest labels, macro expansions
+ * and lines, followed by the .am source annotated with hit counts.
+ * Expanded lines are traced back to the mcro definition and the call
+ * they came from through the preprocessor's line origins.
+ *
+ * A profile file has one "address count" pair of decimal numbers per
+ * line; lines starting with ';' or '#' are comments.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "assembly.h"
+
+#define PROFILE_TOP 20              /* Rows in each ranking */
+
+/* Profile functions */
+unsigned long* new_profile(const Assembly *as, int *size);  /* Zeroed counts for every address */
+int read_profile(const char *path, unsigned long *counts, int size); /* Adds the counts of a file, 0 on errors */
+int write_profile(const Assembly *as, const unsigned long *counts, char *filename);  /* Writes <filename>.prof, 1 if it failed */
+
+#endif /* PROFILE_H */
@@ -0,0 +1,289 @@
+/*
+ * serve.c - Resident server mode
+ *
+ * This file implements --serve: the assembler stays resident and reads
+ * requests from a stream, answering each one on another stream with
+ * length-prefixed replies (see serve.h for the framing). One Assembly
+ * context serves every request; its arena and buffers are reset after
+ * each one, so a warm server allocates little and pays no startup cost.
+ * The messages of each request are collected and sent with its reply.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "serve.h"
+#include "assembly.h"
+#include "helpers.h"
+#include "input.h"
+#include "output.h"
+#include "diag.h"
+
+#define MAX_REQUEST_LINE 1024       /* Longest request header line */
+#define MAX_REQUEST_WORDS 16        /* Most words in a request header */
+#define PAYLOAD_CHUNK 4096          /* Bytes of inline source read at a time */
+
+/*
+ * Reads one request header line into line, without its newline.
+ * Returns 1 for a line, 2 for a line that was too long (the rest of it
+ * is skipped) and 0 at the end of input.
+ */
+static int read_request_line(FILE *in, char *line, int size) {
+    size_t length;
+    int c;
+
+    if (fgets(line, size, in) == NULL) {
+        return 0;
+    }
+    length = strlen(line);
+    if (length > 0 && line[length - 1] == '\n') {
+        line[length - 1] = '\0';
+        return 1;
+    }
+    if (feof(in)) {
+        return 1;
+    }
+    while ((c = getc(in)) != EOF && c != '\n') {
+        ;
+    }
+    return 2;
+}
+
+/*
+ * Splits line in place into words separated by spaces and tabs.
+ * Returns the number of words, at most MAX_REQUEST_WORDS.
+ */
+static int split_words(char *line, char *words[]) {
+    int count = 0;
+    char *word = strtok(line, " \t\r");
+
+    while (word != NULL && count < MAX_REQUEST_WORDS) {
+        words[count++] = word;
+        word = strtok(NULL, " \t\r");
+    }
+    return count;
+}
+
+/*
+ * Applies the options of a request on top of request. Reports and
+ * returns 0 if one of them is unknown or invalid.
+ */
+static int apply_options(Options *request, char *words[], int count) {
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (strcmp(words[i], "--no-am") == 0) {
+            request->write_am = 0;
+        }
+        else if (strncmp(words[i], "--format=", 9) == 0) {
+            request->formats = parse_formats(words[i] + 9);
+            if (request->formats == 0) {
+                report("Error: --format expects text, bin or both\n");
+                return 0;
+            }
+        }
+        else if (strncmp(words[i], "--max-errors=", 13) == 0) {
+            request->max_errors = parse_count(words[i] + 13);
+            if (request->max_errors == 0) {
+                report("Error: --max-errors expects a positive number\n");
+                return 0;
+            }
+        }
+        else {
+            report("Error: unknown request option %s\n", words[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Reads length bytes of inline source into payload, which is left
+ * null-terminated. Returns 0 if the input ends first.
+ */
+static int read_payload(FILE *in, size_t length, SourceText *payload) {
+    char chunk[PAYLOAD_CHUNK];
+    size_t size;
+
+    payload->length = 0;
+    append_source_bytes(payload, chunk, 0);
+    while (length > 0) {
+        size = length < sizeof(chunk) ? length : sizeof(chunk);
+        if (fread(chunk, 1, size, in) != size) {
+            return 0;
+        }
+        append_source_bytes(payload, chunk, size);
+        length -= size;
+    }
+    return 1;
+}
+
+/*
+ * Sends one reply: the status line, then the messages and the body.
+ */
+static void send_reply(FILE *out, int ok, const Diagnostics *messages, const char *body, size_t length) {
+    fprintf(out, "%s %lu %lu\n", ok ? "ok" : "error", (unsigned long)messages->length, (unsigned long)length);
+    if (messages->length > 0) {
+        fwrite(messages->text, 1, messages->length, out);
+    }
+    if (length > 0) {
+        fwrite(body, 1, length, out);
+    }
+    fflush(out);
+}
+
+/*
+ * Adds <name><suffix> to the list of files written
+ */
+static void add_path(SourceText *paths, const char *name, const char *suffix) {
+    char *path = create_filename(name, suffix);
+
+    append_source(paths, path);
+    append_source(paths, "\n");
+    free(path);
+}
+
+/*
+ * Answers a file request: assembles <name>.as as the assembler program
+ * would and lists the files written.
+ */
+static void serve_file(Assembly *as, char *name, const Options *request, Diagnostics *messages,
+                       SourceText *paths, FILE *out) {
+    int error_flag = assemble_file(as, name, request);
+
+    paths->length = 0;
+    if (as->outputs & OUTPUT_AM) {
+        add_path(paths, name, ".am");
+    }
+    if (as->outputs & OUTPUT_EXT) {
+        add_path(paths, name, ".ext");
+    }
+    if (as->outputs & OUTPUT_ENT) {
+        add_path(paths, name, ".ent");
+    }
+    if (as->outputs & OUTPUT_OB) {
+        add_path(paths, name, ".ob");
+    }
+    if (as->outputs & OUTPUT_BIN) {
+        add_path(paths, name, ".bin");
+    }
+    send_reply(out, !error_flag, messages, paths->text, paths->length);
+}
+
+/*
+ * Answers a source request: assembles the inline source in memory and
+ * replies with the object in the one format asked for.
+ */
+static void serve_source(Assembly *as, char *name, const SourceText *payload, const Options *request,
+                         Diagnostics *messages, FILE *out) {
+    SourceFile file;            /* View of the inline source */
+    size_t size = 0;            /* Size of the object */
+    int error_flag;             /* Error flag */
+
+    if (request->formats == (FORMAT_TEXT | FORMAT_BIN)) {
+        report("Error: source requests take --format=text or --format=bin\n");
+        send_reply(out, 0, messages, NULL, 0);
+        return;
+    }
+    file.data = payload->text;
+    file.size = payload->length;
+    file.mapped = 0;
+    messages->max_errors = request->max_errors;
+    error_flag = assemble_source(as, &file, name, 0);
+    if (!error_flag) {
+        if (request->formats & FORMAT_BIN) {
+            size = build_bin(&as->code_image,&as->data_image,as->symbol_head,&as->relocations,&as->output);
+        }
+        else {
+            size = build_ob(&as->code_image,&as->data_image,as->IC-IC_START,as->DC,&as->output);
+        }
+    }
+    send_reply(out, !error_flag, messages, as->output.text, size);
+    reset_assembly(as);
+}
+
+/*
+ * This function answers requests read from in on out until a quit
+ * request or the end of input. The options of the command line are the
+ * defaults of every request. Returns 0 when the loop ends normally and
+ * 1 if the input ended inside an inline source.
+ */
+int serve(FILE *in, FILE *out, const Options *options) {
+    Assembly as;                /* Context reused for every request */
+    Diagnostics messages;       /* Messages of the current request */
+    SourceText payload;         /* Inline source of the current request */
+    SourceText paths;           /* Files written by the current request */
+    Options request;            /* Settings of the current request */
+    char line[MAX_REQUEST_LINE + 2];
+    char *words[MAX_REQUEST_WORDS];
+    int count;                  /* Words in the request header */
+    int status = 0;             /* Return value */
+    int kind;                   /* Result of reading the header */
+    char *end = NULL;
+    unsigned long length;       /* Bytes of inline source */
+
+    init_assembly(&as);
+    init_diagnostics(&messages);
+    init_source(&payload);
+    init_source(&paths);
+    route_diagnostics(&messages);
+
+    while ((kind = read_request_line(in, line, sizeof(line))) != 0) {
+        messages.length = 0;
+        messages.errors = 0;
+        messages.max_errors = 0;
+        messages.source = NULL;
+        request = *options;
+
+        if (kind == 2) {
+            report("Error: request line longer than %d characters\n", MAX_REQUEST_LINE);
+            send_reply(out, 0, &messages, NULL, 0);
+            continue;
+        }
+        count = split_words(line, words);
+        if (count == 0) {
+            continue;
+        }
+        if (strcmp(words[0], "quit") == 0) {
+            break;
+        }
+        if (strcmp(words[0], "file") == 0 && count >= 2) {
+            if (apply_options(&request, words + 2, count - 2)) {
+                serve_file(&as, words[1], &request, &messages, &paths, out);
+            }
+            else {
+                send_reply(out, 0, &messages, NULL, 0);
+            }
+        }
+        else if (strcmp(words[0], "source") == 0 && count >= 3) {
+            length = strtoul(words[2], &end, 10);
+            if (words[2][0] < '0' || words[2][0] > '9' || *end != '\0') {
+                report("Error: source request expects a length, got %s\n", words[2]);
+                send_reply(out, 0, &messages, NULL, 0);
+                continue;
+            }
+            if (!read_payload(in, (size_t)length, &payload)) {
+                status = 1;
+                break;
+            }
+            if (apply_options(&request, words + 3, count - 3)) {
+                serve_source(&as, words[1], &payload, &request, &messages, out);
+            }
+            else {
+                send_reply(out, 0, &messages, NULL, 0);
+            }
+        }
+        else {
+            report("Error: malformed request %s\n", words[0]);
+            send_reply(out, 0, &messages, NULL, 0);
+        }
+    }
+
+    route_diagnostics(NULL);
+    destroy_source(&paths);
+    destroy_source(&payload);
+    destroy_diagnostics(&messages);
+    destroy_assembly(&as);
+    return status;
+}
@@ -0,0 +1,30 @@
+/*
+ * serve.h - Resident server mode header
+ *
+ * This header file declares the --serve loop, which keeps the assembler
+ * running and answers assembly requests framed on a pair of streams.
+ *
+ * Requests, one header line each:
+ *   file <name> [option ...]            assembles <name>.as into files
+ *   source <name> <length> [option ...] followed by length bytes of source,
+ *                                       assembled in memory as <name>.as
+ *   quit                                ends the loop, as does end of input
+ * The options are --no-am, --format=text|bin|both and --max-errors=N and
+ * apply to that request only, on top of the command line settings.
+ *
+ * Replies, one per request:
+ *   <ok|error> <messages length> <body length>\n<messages><body>
+ * The body of a file request lists the files written, one path per line.
+ * The body of a source request is the object in the requested format, the
+ * .ob text or, with --format=bin, the .bin image; it is empty on errors.
+ */
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdio.h>
+#include "assembly.h"
+
+int serve(FILE *in, FILE *out, const Options *options); /* Answers requests until quit or end of input */
+
+#endif /* SERVE_H */
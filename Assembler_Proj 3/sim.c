@@ -0,0 +1,316 @@
+/*
+ * sim.c - Image simulator
+ *
+ * This file runs assembled programs on the Machine of sim.h. Each step
+ * fetches the first word of an instruction, takes the opcode and modes
+ * from its fields, fetches the operands into cells the handlers read
+ * and write, and calls the handler of the opcode from a table indexed
+ * like INSTRUCTIONS. The modes are checked against the same instruction
+ * set table the assembler validates with, so a jump into data faults
+ * instead of running garbage.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim.h"
+#include "order.h"
+
+/*
+ * SimOperand - A fetched operand
+ */
+typedef struct SimOperand {
+    unsigned short *cell;       /* Register or memory word, or the immediate value */
+    int address;                /* Memory address of the operand, -1 for none */
+}SimOperand;
+
+typedef void (*Handler)(Machine *machine, const SimOperand *src, const SimOperand *dst);
+
+/*
+ * Stops the machine on a fault at the current instruction
+ */
+static void fault(Machine *machine, const char *what) {
+    machine->state = SIM_FAULT;
+    machine->fault_address = machine->pc;
+    strncpy(machine->fault, what, SIM_FAULT_LENGTH - 1);
+    machine->fault[SIM_FAULT_LENGTH - 1] = '\0';
+}
+
+/*
+ * Returns the 10-bit word as a signed value
+ */
+static int signed_word(unsigned short word) {
+    return (word & (1 << (WORD_BITS - 1))) ? (int)word - (1 << WORD_BITS) : (int)word;
+}
+
+/*
+ * Returns the address an operand refers to: its memory address, or the
+ * contents of its register
+ */
+static int target_of(const SimOperand *operand) {
+    return operand->address >= 0 ? operand->address : *operand->cell;
+}
+
+/* Instruction handlers, in opcode order */
+static void op_mov(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    *dst->cell = *src->cell;
+}
+
+static void op_cmp(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    machine->zero = ((*src->cell - *dst->cell) & WORD_MASK) == 0;
+}
+
+static void op_add(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    *dst->cell = (unsigned short)((*dst->cell + *src->cell) & WORD_MASK);
+}
+
+static void op_sub(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    *dst->cell = (unsigned short)((*dst->cell - *src->cell) & WORD_MASK);
+}
+
+static void op_lea(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    *dst->cell = (unsigned short)src->address;
+}
+
+static void op_clr(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    *dst->cell = 0;
+}
+
+static void op_not(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    *dst->cell = (unsigned short)(~*dst->cell & WORD_MASK);
+}
+
+static void op_inc(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    *dst->cell = (unsigned short)((*dst->cell + 1) & WORD_MASK);
+}
+
+static void op_dec(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    *dst->cell = (unsigned short)((*dst->cell - 1) & WORD_MASK);
+}
+
+static void op_jmp(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    machine->pc = target_of(dst);
+}
+
+static void op_bne(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    if (!machine->zero) {
+        machine->pc = target_of(dst);
+    }
+}
+
+static void op_jsr(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    if (machine->depth == SIM_STACK_DEPTH) {
+        fault(machine, "jsr overflows the return stack");
+        return;
+    }
+    machine->stack[machine->depth++] = machine->pc;
+    machine->pc = target_of(dst);
+}
+
+static void op_red(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    int ch = machine->input != NULL ? getc(machine->input) : EOF;
+
+    *dst->cell = (unsigned short)(ch == EOF ? WORD_MASK : ch & WORD_MASK);
+}
+
+static void op_prn(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    char text[16];
+
+    sprintf(text, "%d\n", signed_word(*dst->cell));
+    append_source(&machine->output, text);
+}
+
+static void op_rts(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    if (machine->depth == 0) {
+        fault(machine, "rts with an empty return stack");
+        return;
+    }
+    machine->pc = machine->stack[--machine->depth];
+}
+
+static void op_stop(Machine *machine, const SimOperand *src, const SimOperand *dst) {
+    machine->state = SIM_HALTED;
+}
+
+/* Handler of every opcode, indexed like INSTRUCTIONS */
+static const Handler HANDLERS[NUM_OPCODES] = {
+    op_mov, op_cmp, op_add, op_sub, op_lea, op_clr, op_not, op_inc,
+    op_dec, op_jmp, op_bne, op_jsr, op_red, op_prn, op_rts, op_stop
+};
+
+/*
+ * Fetches the operand of the given mode whose words start at address
+ * pc. A register operand takes the source or the target field of its
+ * word. Returns the address after the operand words, or -1 after a
+ * fault.
+ */
+static int fetch_operand(Machine *machine, int mode, int is_source, int pc,
+                         SimOperand *operand, unsigned short *immediate) {
+    const MatrixShape *shape;
+    unsigned short word;
+    unsigned short indexes;
+    int cell;
+
+    if (pc + (mode == ADDR_MATRIX) >= SIM_MEMORY_WORDS) {
+        fault(machine, "operand words run past the end of memory");
+        return -1;
+    }
+    word = machine->memory[pc];
+    operand->address = -1;
+
+    switch (mode) {
+        case ADDR_IMMEDIATE: /* 8-bit value, sign extended to a word */
+            *immediate = (unsigned short)((word >> 2) & 0xFF);
+            if (*immediate & 0x80) {
+                *immediate |= WORD_MASK & ~0xFF;
+            }
+            operand->cell = immediate;
+            return pc + 1;
+        case ADDR_REGISTER:
+            operand->cell = &machine->registers[(is_source ? word >> 6 : word >> 2) & 7];
+            return pc + 1;
+        default: /* Direct or matrix: an address word */
+            if ((word & 3) == ARE_EXTERNAL) {
+                fault(machine, "operand refers to an external symbol");
+                return -1;
+            }
+            operand->address = (word >> 2) & 0xFF;
+            if (mode == ADDR_MATRIX) {
+                shape = machine->matrices != NULL ?
+                        find_shape(machine->matrices, operand->address - machine->data_start) : NULL;
+                if (shape == NULL) {
+                    fault(machine, "matrix operand does not name a .mat block");
+                    return -1;
+                }
+                indexes = machine->memory[pc + 1];
+                cell = operand->address + machine->registers[(indexes >> 6) & 7] * shape->columns +
+                       machine->registers[(indexes >> 2) & 7];
+                if (cell >= SIM_MEMORY_WORDS) {
+                    fault(machine, "matrix cell is outside memory");
+                    return -1;
+                }
+                operand->address = cell;
+            }
+            operand->cell = &machine->memory[operand->address];
+            return pc + 1 + (mode == ADDR_MATRIX);
+    }
+}
+
+/*
+ * init_machine - Prepares a machine with an empty output buffer
+ */
+void init_machine(Machine *machine) {
+    init_source(&machine->output);
+    machine->matrices = NULL;
+    machine->input = NULL;
+    machine->profile = NULL;
+    machine->state = SIM_HALTED;
+}
+
+/*
+ * load_machine - Copies the code to IC_START and the data after it,
+ * clears the registers, the flag, the stack and the output, and points
+ * the machine at the first instruction. Returns 0, leaving the machine
+ * faulted, if the images do not fit in memory.
+ */
+int load_machine(Machine *machine, const Image *code, const Image *data, const ShapeTable *matrices) {
+    memset(machine->memory, 0, sizeof(machine->memory));
+    memset(machine->registers, 0, sizeof(machine->registers));
+    machine->depth = 0;
+    machine->pc = IC_START;
+    machine->zero = 0;
+    machine->steps = 0;
+    machine->state = SIM_RUNNING;
+    machine->fault[0] = '\0';
+    machine->data_start = IC_START + code->count;
+    machine->matrices = matrices;
+    machine->output.length = 0;
+    append_source_bytes(&machine->output, "", 0);
+
+    if (code->count + data->count > SIM_MEMORY_WORDS - IC_START) {
+        fault(machine, "program does not fit in memory");
+        return 0;
+    }
+    if (code->count > 0) {
+        memcpy(machine->memory + IC_START, code->words, sizeof(unsigned short) * code->count);
+    }
+    if (data->count > 0) {
+        memcpy(machine->memory + machine->data_start, data->words, sizeof(unsigned short) * data->count);
+    }
+    return 1;
+}
+
+/*
+ * run_machine - Executes instructions until stop, a fault, or max_steps
+ * instructions (0 for no limit). Returns the state the machine ends in.
+ */
+int run_machine(Machine *machine, unsigned long max_steps) {
+    const Instruction *instruction;
+    unsigned short immediates[2];   /* Values of immediate operands */
+    SimOperand src;
+    SimOperand dst;
+    unsigned short word;
+    int src_mode;
+    int dst_mode;
+    int next;
+    int at;                         /* Address of the current instruction */
+
+    src.cell = dst.cell = NULL;
+    src.address = dst.address = -1;
+    while (machine->state == SIM_RUNNING) {
+        if (machine->steps == max_steps && max_steps != 0) {
+            machine->state = SIM_LIMIT;
+            break;
+        }
+        if (machine->pc < 0 || machine->pc >= SIM_MEMORY_WORDS) {
+            fault(machine, "jump outside memory");
+            break;
+        }
+
+        /* Decode the first word and check its modes */
+        at = machine->pc;
+        word = machine->memory[at];
+        instruction = &INSTRUCTIONS[(word >> 6) & 0xF];
+        src_mode = (word >> 4) & 3;
+        dst_mode = (word >> 2) & 3;
+        if ((word & 3) != ARE_ABSOLUTE ||
+            (instruction->src_modes == MODES_NONE ? src_mode != 0 : !(instruction->src_modes & MODE_BIT(src_mode))) ||
+            (instruction->dst_modes == MODES_NONE ? dst_mode != 0 : !(instruction->dst_modes & MODE_BIT(dst_mode)))) {
+            fault(machine, "illegal instruction");
+            break;
+        }
+
+        /* Fetch the operands; two registers share one word */
+        next = at + 1;
+        if (instruction->src_modes != MODES_NONE) {
+            next = fetch_operand(machine, src_mode, 1, next, &src, &immediates[0]);
+            if (next >= 0 && src_mode == ADDR_REGISTER && dst_mode == ADDR_REGISTER) {
+                next--;
+            }
+        }
+        if (next >= 0 && instruction->dst_modes != MODES_NONE) {
+            next = fetch_operand(machine, dst_mode, 0, next, &dst, &immediates[1]);
+        }
+        if (next < 0) {
+            break;
+        }
+
+        machine->pc = next;
+        HANDLERS[instruction->opcode](machine, &src, &dst);
+        machine->steps++;
+        if (machine->profile != NULL) {
+            machine->profile[at]++;
+        }
+        if (machine->state == SIM_FAULT) {
+            machine->fault_address = at;
+        }
+    }
+    return machine->state;
+}
+
+/*
+ * destroy_machine - Frees the output buffer
+ */
+void destroy_machine(Machine *machine) {
+    destroy_source(&machine->output);
+}
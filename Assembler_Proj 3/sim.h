@@ -0,0 +1,72 @@
+/*
+ * sim.h - Image simulator header
+ *
+ * This header file defines the Machine that runs an assembled program
+ * straight from the code and data images, without writing or reading
+ * the object files. The machine has 8 registers of 10 bits, 256 words
+ * of memory with the code loaded at IC_START and the data right after
+ * it, a zero flag set by cmp and a return stack for jsr and rts.
+ *
+ * Instruction semantics:
+ *   mov, add, sub      dst := src, dst + src, dst - src
+ *   cmp                sets the zero flag when src - dst is 0
+ *   lea                dst := address of src
+ *   clr, not, inc, dec dst := 0, ~dst, dst + 1, dst - 1
+ *   jmp, bne, jsr      jump to the operand address (a register holds the
+ *                      address); bne jumps when the zero flag is clear,
+ *                      jsr pushes the return address
+ *   red, prn           reads a character into dst, prints dst in decimal
+ *   rts, stop          returns from jsr, halts the machine
+ * A matrix operand L[rx][ry] is the cell L + rx * columns + ry of the
+ * .mat block that starts at L. Arithmetic wraps to 10 bits and prn
+ * prints values as signed.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdio.h>
+#include "word.h"
+#include "input.h"
+
+#define SIM_MEMORY_WORDS 256        /* Addresses an operand word can hold */
+#define SIM_REGISTERS 8             /* r0 to r7 */
+#define SIM_STACK_DEPTH 256         /* Nested jsr calls */
+#define SIM_FAULT_LENGTH 128        /* Longest fault description */
+#define SIM_DEFAULT_LIMIT 100000000UL /* Instructions run by --run when no limit is given */
+
+/* Machine states, returned by run_machine */
+#define SIM_RUNNING 0               /* Not finished yet */
+#define SIM_HALTED 1                /* Reached stop */
+#define SIM_FAULT 2                 /* Stopped on an illegal instruction or access */
+#define SIM_LIMIT 3                 /* Ran the most instructions allowed */
+
+/*
+ * Machine - State of the simulated computer
+ */
+typedef struct Machine {
+    unsigned short memory[SIM_MEMORY_WORDS];    /* Code and data words */
+    unsigned short registers[SIM_REGISTERS];     /* r0 to r7 */
+    int stack[SIM_STACK_DEPTH];                 /* Return addresses of jsr */
+    int depth;                  /* Return addresses on the stack */
+    int pc;                     /* Address of the next instruction */
+    int zero;                   /* Zero flag, set by cmp */
+    int state;                  /* One of the SIM_ states */
+    int fault_address;          /* Instruction that faulted */
+    char fault[SIM_FAULT_LENGTH]; /* What went wrong, for SIM_FAULT */
+    unsigned long steps;        /* Instructions executed */
+    int data_start;             /* Address of data word 0 */
+    const ShapeTable *matrices; /* Shapes of the .mat blocks in the data */
+    FILE *input;                /* Read by red, NULL for no input */
+    unsigned long *profile;     /* Executions of each of the SIM_MEMORY_WORDS addresses, or NULL */
+    SourceText output;          /* Written by prn */
+}Machine;
+
+/* Simulator functions */
+void init_machine(Machine *machine);         /* Prepares a machine with empty output */
+int load_machine(Machine *machine, const Image *code, const Image *data,
+                 const ShapeTable *matrices); /* Loads the images, 0 if they do not fit */
+int run_machine(Machine *machine, unsigned long max_steps); /* Runs to stop, a fault or the limit */
+void destroy_machine(Machine *machine);      /* Frees the output */
+
+#endif /* SIM_H */
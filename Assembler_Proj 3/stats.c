@@ -0,0 +1,104 @@
+/*
+ * stats.c - Per-file statistics
+ * 
+ * This file implements the --stats counters. Like the diagnostics, each
+ * thread routes its counts to the Stats of the file it is assembling,
+ * through a thread-specific key. The hooks test stats_enabled first, so
+ * without --stats they cost one test of a global flag. Each file's
+ * Stats is printed as one JSON object per line.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "stats.h"
+
+int stats_enabled = 0;
+
+static pthread_key_t stats_key;                      /* Current Stats of each thread */
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT; /* Guards creating stats_key */
+
+/*
+ * Creates the thread-specific key, called once by pthread_once.
+ */
+static void make_stats_key(void) {
+    pthread_key_create(&stats_key, NULL);
+}
+
+/*
+ * enable_stats - Turns the hooks on; called before any worker starts
+ */
+void enable_stats(void) {
+    pthread_once(&stats_once, make_stats_key);
+    stats_enabled = 1;
+}
+
+/*
+ * init_stats - Zeroes all counters and timings
+ */
+void init_stats(Stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+/*
+ * route_stats - Sends the counts of the calling thread to stats.
+ * Passing NULL stops counting for the thread.
+ */
+void route_stats(Stats *stats) {
+    pthread_once(&stats_once, make_stats_key);
+    pthread_setspecific(stats_key, stats);
+}
+
+/*
+ * current_stats - Returns the Stats the calling thread counts into
+ */
+Stats* current_stats(void) {
+    return (Stats*)pthread_getspecific(stats_key);
+}
+
+/*
+ * stats_clock - Returns a monotonic time in milliseconds
+ */
+double stats_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+/*
+ * Writes s as the contents of a JSON string, escaping quotes,
+ * backslashes and control characters.
+ */
+static void write_json_text(const char *s, FILE *stream) {
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\') {
+            fprintf(stream, "\\%c", *s);
+        }
+        else if ((unsigned char)*s < 0x20) {
+            fprintf(stream, "\\u%04x", (unsigned int)(unsigned char)*s);
+        }
+        else {
+            fputc(*s, stream);
+        }
+    }
+}
+
+/*
+ * write_stats - Prints the statistics of one file as a JSON object on
+ * a single line, flushed at once so lines from workers don't mix
+ */
+void write_stats(const Stats *stats, const char *filename, int ok, int cached, FILE *stream) {
+    flockfile(stream);
+    fputs("{\"file\":\"", stream);
+    write_json_text(filename, stream);
+    fprintf(stream, "\",\"ok\":%s,\"cached\":%s", ok ? "true" : "false", cached ? "true" : "false");
+    fprintf(stream, ",\"preprocess_ms\":%.3f,\"first_pass_ms\":%.3f,\"second_pass_ms\":%.3f,\"output_ms\":%.3f",
+            stats->preprocess_ms, stats->first_pass_ms, stats->second_pass_ms, stats->output_ms);
+    fprintf(stream, ",\"lines\":%lu,\"macros_expanded\":%lu,\"symbols\":%lu,\"symbol_probes\":%lu",
+            stats->lines, stats->macros_expanded, stats->symbols, stats->symbol_probes);
+    fprintf(stream, ",\"words\":%lu,\"bytes_allocated\":%lu}\n", stats->words, stats->bytes_allocated);
+    fflush(stream);
+    funlockfile(stream);
+}
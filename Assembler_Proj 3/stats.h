@@ -0,0 +1,71 @@
+/*
+ * stats.h - Per-file statistics header
+ * 
+ * This header file declares the counters and phase timings collected
+ * with --stats. Code counts events with STAT_ADD; the counters go to the
+ * Stats of the file the calling thread is assembling. Built with
+ * -DNO_STATS, every hook compiles to nothing.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/*
+ * Stats - What was done while assembling one file
+ */
+typedef struct Stats {
+    double preprocess_ms;           /* Wall time of the preprocessor */
+    double first_pass_ms;           /* Wall time of first_scan */
+    double second_pass_ms;          /* Wall time of second_scan */
+    double output_ms;               /* Wall time of writing the output files */
+    unsigned long lines;            /* Lines read by the first pass */
+    unsigned long macros_expanded;  /* Macro calls expanded */
+    unsigned long symbols;          /* Symbols defined, externs included */
+    unsigned long symbol_probes;    /* Hash slots examined by search_symbol */
+    unsigned long words;            /* Code and data words emitted */
+    unsigned long bytes_allocated;  /* Bytes requested through safe_malloc and safe_realloc */
+}Stats;
+
+extern int stats_enabled;           /* Set by enable_stats, read by the hooks */
+
+#ifdef NO_STATS
+#define STAT_ADD(field, n) ((void)0)
+#define STAT_TIMER(name) int name
+#define STAT_START(name) ((void)(name = 0))
+#define STAT_LAP(field, name) ((void)(name))
+#else
+/* Adds n to the field of the current file's Stats */
+#define STAT_ADD(field, n) \
+    do { \
+        if (stats_enabled) { \
+            Stats *stats_ = current_stats(); \
+            if (stats_ != NULL) { \
+                stats_->field += (unsigned long)(n); \
+            } \
+        } \
+    } while (0)
+/* Declares a phase timer, starts it, and adds the time since the last
+ * start or lap to a timing field */
+#define STAT_TIMER(name) double name
+#define STAT_START(name) ((void)(name = stats_enabled ? stats_clock() : 0))
+#define STAT_LAP(field, name) \
+    do { \
+        if (stats_enabled && current_stats() != NULL) { \
+            double now_ = stats_clock(); \
+            current_stats()->field += now_ - name; \
+            name = now_; \
+        } \
+    } while (0)
+#endif
+
+/* Statistics functions */
+void enable_stats(void);                        /* Turns the hooks on, before any thread starts */
+void init_stats(Stats *stats);                  /* Zeroes the counters */
+void route_stats(Stats *stats);                 /* Sends this thread's counts to stats, NULL for none */
+Stats* current_stats(void);                     /* This thread's Stats, or NULL */
+double stats_clock(void);                       /* Monotonic clock in milliseconds */
+void write_stats(const Stats *stats, const char *filename, int ok, int cached, FILE *stream); /* Prints one JSON line */
+
+#endif /* STATS_H */
@@ -6,8 +6,8 @@
  * - Creating and adding new symbols
  * - Searching for existing symbols
  * - Updating symbol values and types
- * - Memory cleanup for symbol tables
  * - Data symbol address adjustments
+ * - Hash indexing and name interning for constant time lookup
  */
 
 #include <stdio.h>
@@ -16,16 +16,105 @@
 
 #include "symbolTable.h"
 #include "helpers.h"
+#include "stats.h"
+
+#define INITIAL_INDEX_CAPACITY 64   /* Starting number of hash slots */
+
+/*
+ * Hash of a null-terminated name.
+ */
+static unsigned long hash_name(const char *name) {
+    return hash_text(name, strlen(name));
+}
+
+/*
+ * init_symbol_index - Prepares an empty index with no slots allocated.
+ * Symbols and names added through the index are taken from arena.
+ */
+void init_symbol_index(SymbolIndex *index, Arena *arena) {
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->arena = arena;
+}
+
+/*
+ * Copies the name into the index arena. The returned pointer stays
+ * valid until the arena is reset.
+ */
+char* intern_name(SymbolIndex *index, const char *name) {
+    return arena_strdup(index->arena, name);
+}
+
+/*
+ * Places the symbol in the first free slot of its probe sequence.
+ * Assumes the table has room and the name is not already indexed.
+ */
+static void place_symbol(Symbol **slots, int capacity, Symbol *symbol) {
+    int mask = capacity - 1;
+    int i = (int)(symbol->hash & mask);
+    while (slots[i] != NULL) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = symbol;
+}
+
+/*
+ * Doubles the number of slots and re-places every indexed symbol.
+ */
+static void grow_symbol_index(SymbolIndex *index) {
+    int new_capacity = index->capacity ? index->capacity * 2 : INITIAL_INDEX_CAPACITY;
+    Symbol **new_slots = (Symbol**)safe_malloc(sizeof(Symbol*) * new_capacity, "Error in memory allocation for symbol index");
+    int i;
+
+    for (i = 0; i < new_capacity; i++) {
+        new_slots[i] = NULL;
+    }
+    for (i = 0; i < index->capacity; i++) {
+        if (index->slots[i] != NULL) {
+            place_symbol(new_slots, new_capacity, index->slots[i]);
+        }
+    }
+    free(index->slots);
+    index->slots = new_slots;
+    index->capacity = new_capacity;
+}
+
+/*
+ * Adds the symbol to the index. If a symbol with the same name is already
+ * indexed the existing one is kept, matching the first-match behaviour
+ * of a list scan.
+ */
+static void index_symbol(SymbolIndex *index, Symbol *symbol) {
+    if (search_symbol(index, symbol->name) != NULL) {
+        return;
+    }
+    if ((index->count + 1) * 2 > index->capacity) {
+        grow_symbol_index(index);
+    }
+    place_symbol(index->slots, index->capacity, symbol);
+    index->count++;
+}
+
+/*
+ * destroy_symbol_index - Frees the slots; the symbols themselves are
+ * released with the arena
+ */
+void destroy_symbol_index(SymbolIndex *index) {
+    free(index->slots);
+    init_symbol_index(index, index->arena);
+}
 
 /*
  * Allocates and initializes a new Symbol structure with the given name.
- * The value is initialized to 0, type to 0, and next pointer to NULL.
+ * The symbol and its interned name live in the index arena. The value is initialized to 0,
+ * type to 0, and next pointer to NULL.
  */
-Symbol* new_symbol(const char *name) {
+Symbol* new_symbol(SymbolIndex *index, const char *name) {
     Symbol *tmp = NULL;
-    tmp = (Symbol*)safe_malloc(sizeof(Symbol), "Error in add_symbol()");
-    tmp->name = (char*)safe_malloc(strlen(name) + 1, "Error in memory allocation for symbol name");
-    strcpy(tmp->name, name);
+    tmp = (Symbol*)arena_alloc(index->arena, sizeof(Symbol), "Error in add_symbol()");
+    tmp->name = intern_name(index, name);
+    tmp->hash = hash_name(name);
     tmp->value = 0;
     tmp->type = 0; /* Initialize type to 0 */
     tmp->next = NULL;
@@ -61,10 +150,11 @@ void set_value(Symbol *symbol, int value) {
 }
 
 /*
- * add_symbol - Adds a new symbol to the symbol table
+ * add_symbol - Adds a new symbol to the end of the symbol table and indexes it
  */
-Symbol* add_symbol(Symbol** head, Symbol** tail, const char* name) {
-    Symbol* tmp = new_symbol(name);
+Symbol* add_symbol(Symbol** head, Symbol** tail, SymbolIndex *index, const char* name) {
+    Symbol* tmp = new_symbol(index, name);
+    index_symbol(index, tmp);
     if (*head == NULL) {
         *head = tmp;
         *tail = tmp;
@@ -76,30 +166,45 @@ Symbol* add_symbol(Symbol** head, Symbol** tail, const char* name) {
 }
 
 /*
- * destroy_symbol_table - Frees all memory allocated for a symbol table
+ * append_symbol - Adds a symbol to the end of a list that is not indexed,
+ * such as the pending entries. The node and name live in arena.
  */
-void destroy_symbol_table(Symbol *head) {
-    if (head == NULL) {
-        return;
-    }
-    while (head != NULL) {
-        Symbol *tmp = head;
-        head = head->next;
-        free(tmp->name);
-        free(tmp);
+Symbol* append_symbol(Symbol** head, Symbol** tail, Arena *arena, const char* name) {
+    Symbol* tmp = (Symbol*)arena_alloc(arena, sizeof(Symbol), "Error in append_symbol()");
+    tmp->name = arena_strdup(arena, name);
+    tmp->hash = 0;
+    tmp->value = 0;
+    tmp->type = 0;
+    tmp->next = NULL;
+    if (*head == NULL) {
+        *head = tmp;
+    } else {
+        (*tail)->next = tmp;
     }
+    *tail = tmp;
+    return tmp;
 }
 
 /*
- * search_symbol - Searches for a symbol by name
+ * search_symbol - Searches for a symbol by name through the hash index
  */
-Symbol* search_symbol(Symbol *head,const char *name) {
-    Symbol *tmp = head;
-    while (tmp != NULL) {
-        if (strcmp(tmp->name, name) == 0) {
-            return tmp;
+Symbol* search_symbol(const SymbolIndex *index,const char *name) {
+    unsigned long hash;
+    int mask, i;
+
+    if (index->count == 0) {
+        return NULL;
+    }
+    hash = hash_name(name);
+    mask = index->capacity - 1;
+    i = (int)(hash & mask);
+    while (index->slots[i] != NULL) {
+        STAT_ADD(symbol_probes, 1);
+        if (index->slots[i]->hash == hash && strcmp(index->slots[i]->name, name) == 0) {
+            return index->slots[i];
         }
-        tmp = tmp->next;
+        i = (i + 1) & mask;
     }
+    STAT_ADD(symbol_probes, 1); /* The empty slot that ends the search */
     return NULL;
 }
\ No newline at end of file
@@ -9,6 +9,8 @@
 #ifndef SYMBOLTABLE_H
 #define SYMBOLTABLE_H
 
+#include "arena.h"
+
 /*
  * Symbol - Represents a symbol in the symbol table
  * 
@@ -17,19 +19,40 @@
  * to the next symbol in the linked list.
  */
 typedef struct SymbolTable {
-    char *name;                    /* Symbol name (label) */
+    char *name;                    /* Symbol name (label), interned in the index arena */
+    unsigned long hash;            /* Hash of the name, cached for probing and rehashing */
     int value;                     /* Symbol address in memory */
     int type;                      /* Symbol type: 1=data, 2=code, 3=entry, 4=extern */
     struct SymbolTable *next;      /* Pointer to next symbol in list */
 }Symbol;
 
+/*
+ * SymbolIndex - Open-addressing hash index over the symbol list
+ *
+ * The linked list keeps symbols in insertion order (for the output files),
+ * while the index gives constant time lookup by name. Slots hold pointers
+ * into the list; the capacity is always a power of two and the table is
+ * kept at most half full so linear probing stays short.
+ */
+typedef struct SymbolIndex {
+    Symbol **slots;                /* Hash slots, NULL when empty */
+    int capacity;                  /* Number of slots (power of two) */
+    int count;                     /* Number of symbols indexed */
+    Arena *arena;                  /* Owner of the symbols and interned names */
+}SymbolIndex;
+
 /* Symbol table management functions */
-Symbol* new_symbol(const char *name);                           /* Creates new symbol */
+Symbol* new_symbol(SymbolIndex *index, const char *name);       /* Creates new symbol */
 void update_data_symbols_value(Symbol *head, int ICF);         /* Updates data symbol addresses */
 void set_type(Symbol *symbol, int type);                       /* Sets symbol type */
 void set_value(Symbol *symbol, int value);                     /* Sets symbol address */
-Symbol* add_symbol(Symbol** head, Symbol** tail, const char* name); /* Adds symbol to table */
-void destroy_symbol_table(Symbol *head);                       /* Frees symbol table */
-Symbol* search_symbol(Symbol *head,const char *name);          /* Searches for symbol by name */
+Symbol* add_symbol(Symbol** head, Symbol** tail, SymbolIndex *index, const char* name); /* Adds symbol to table */
+Symbol* append_symbol(Symbol** head, Symbol** tail, Arena *arena, const char* name); /* Adds symbol to a plain list */
+Symbol* search_symbol(const SymbolIndex *index,const char *name); /* Searches for symbol by name */
+
+/* Symbol index management functions */
+void init_symbol_index(SymbolIndex *index, Arena *arena);      /* Prepares an empty index */
+char* intern_name(SymbolIndex *index, const char *name);       /* Copies name into the index arena */
+void destroy_symbol_index(SymbolIndex *index);                 /* Frees index slots */
 
 #endif /* SYMBOLTABLE_H */
\ No newline at end of file
@@ -0,0 +1,304 @@
+#!/bin/sh
+#
+# check.sh - Regression check over the test/ corpus, run by make check
+#
+# Every test/*.as fixture is assembled into test/out/ and compared with
+# its expected outputs: a fixture with a stored .ob must assemble to the
+# same .ob, .ent, .ext and .am files (and write no .ent or .ext that is
+# not stored), and a fixture without one must fail with the messages in
+# its .err file, the "name.as:line:" diagnostics of the log. The
+# --stats line of every file, with its phase timings and bytes
+# allocated, is kept in test/out/stats.jsonl.
+#
+# Each mode is then checked on the corpus or on the test/modes sources:
+# -j 4 against a sequential run, a --cache hit against the first run,
+# --max-memory and --format=both against the expected .ob, --link of two
+# modules against the same program assembled whole and of two that don't
+# fit the address space together, --run and --profile
+# against the stored output and report, a --serve round trip and a
+# request that can't write its .ob, and the
+# library through test/libcheck.
+#
+# The fixtures that assemble are then timed with bench/runbench, REPEAT
+# times each, and the best lines per second of the whole corpus out of
+# three rounds are compared with test/perf_baseline. The check fails when
+# they drop more than THRESHOLD percent below it. The baseline is only
+# meaningful on the machine that recorded it, so it is not committed:
+# with -b it is recorded, and without one the throughput is only printed.
+# With -n, only the outputs are checked, without --stats, for an
+# assembler built with -DNO_STATS.
+#
+# Usage: sh test/check.sh [-b] REPEAT [THRESHOLD]
+#        sh test/check.sh -n
+
+cd "$(dirname "$0")/.." || exit 1
+
+record=0
+outputs_only=0
+if [ "$1" = "-b" ]; then
+    record=1
+    shift
+elif [ "$1" = "-n" ]; then
+    outputs_only=1
+    shift
+fi
+repeat=${1:-1000}
+threshold=${2:-25}
+out=test/out
+baseline=test/perf_baseline
+failed=0
+
+rm -rf "$out"
+mkdir -p "$out"
+: > "$out/stats.jsonl"
+
+# Correctness
+for source in test/*.as; do
+    name=$(basename "$source" .as)
+    cp "$source" "$out/"
+    if [ $outputs_only -eq 1 ]; then
+        ./assembler "$out/$name" > "$out/$name.log" 2>&1
+    else
+        ./assembler --stats "$out/$name" > "$out/$name.log" 2>&1
+        grep '^{' "$out/$name.log" >> "$out/stats.jsonl"
+    fi
+    if [ -e "test/$name.ob" ]; then
+        for suffix in .ob .ent .ext .am; do
+            if [ -e "test/$name$suffix" ]; then
+                if ! cmp -s "test/$name$suffix" "$out/$name$suffix"; then
+                    echo "FAIL $name$suffix differs from the expected output"
+                    failed=1
+                fi
+            elif [ "$suffix" != .am ] && [ -e "$out/$name$suffix" ]; then
+                echo "FAIL $name$suffix was written but is not expected"
+                failed=1
+            fi
+        done
+    elif [ -e "$out/$name.ob" ]; then
+        echo "FAIL $name should not assemble"
+        failed=1
+    else
+        grep "^$out/$name.as:" "$out/$name.log" | sed "s|^$out/||" > "$out/$name.err"
+        if [ ! -e "test/$name.err" ]; then
+            echo "FAIL $name has no expected messages in test/$name.err"
+            failed=1
+        elif ! cmp -s "test/$name.err" "$out/$name.err"; then
+            echo "FAIL $name.err differs from the expected messages"
+            failed=1
+        fi
+    fi
+done
+count=$(ls test/*.as | wc -l)
+if [ $failed -ne 0 ]; then
+    echo "check: outputs of the corpus differ, see $out/"
+    exit 1
+fi
+echo "check: $count fixtures match their expected outputs"
+
+# Modes
+passing=""
+for expected in test/*.ob; do
+    passing="$passing $(basename "$expected" .ob)"
+done
+modes=$out/modes
+mkdir -p "$modes/jobs" "$modes/cache" "$modes/lowmem" "$modes/both"
+cp test/*.as "$modes/jobs/"
+cp test/modes/*.as "$modes/"
+for name in $passing; do
+    cp "test/$name.as" "$modes/cache/"
+    cp "test/$name.as" "$modes/lowmem/"
+    cp "test/$name.as" "$modes/both/"
+done
+
+# Compares the outputs of a run of the corpus in dir with those set
+# aside from an earlier run, with the suffix .first
+compare_runs() {
+    for first in "$1"/*.first; do
+        if ! cmp -s "$first" "${first%.first}"; then
+            echo "FAIL $2: $(basename "${first%.first}") differs from the first run"
+            failed=1
+        fi
+    done
+}
+
+# Sets the outputs of the corpus in dir aside as .first
+set_aside() {
+    for output in "$1"/*.ob "$1"/*.ent "$1"/*.ext "$1"/*.am "$1"/*.log; do
+        if [ -e "$output" ]; then
+            mv "$output" "$output.first"
+        fi
+    done
+}
+
+# -j: the same outputs and messages, in the same order, as a sequential run
+jobs=""
+for source in test/*.as; do
+    jobs="$jobs $modes/jobs/$(basename "$source" .as)"
+done
+./assembler $jobs > "$modes/jobs/run.log" 2>&1
+set_aside "$modes/jobs"
+./assembler -j 4 $jobs > "$modes/jobs/run.log" 2>&1
+compare_runs "$modes/jobs" "-j 4"
+
+# --cache: the second run restores the outputs of the first
+cached=""
+for name in $passing; do
+    cached="$cached $modes/cache/$name"
+done
+./assembler --cache="$modes/cache/store" $cached > /dev/null 2>&1
+set_aside "$modes/cache"
+if [ $outputs_only -eq 1 ]; then
+    ./assembler --cache="$modes/cache/store" $cached > /dev/null 2>&1
+else
+    ./assembler --stats --cache="$modes/cache/store" $cached 2>&1 | grep '^{' > "$modes/cache/stats.jsonl"
+    if grep -q '"cached":false' "$modes/cache/stats.jsonl"; then
+        echo "FAIL --cache: the second run did not hit the cache"
+        failed=1
+    fi
+fi
+compare_runs "$modes/cache" "--cache"
+
+# --max-memory and --format=both: the .ob files of the text format
+lowmem=""
+both=""
+for name in $passing; do
+    lowmem="$lowmem $modes/lowmem/$name"
+    both="$both $modes/both/$name"
+done
+./assembler --max-memory=4096 $lowmem > /dev/null 2>&1
+./assembler --format=both $both > /dev/null 2>&1
+for name in $passing; do
+    for dir in lowmem both; do
+        if ! cmp -s "test/$name.ob" "$modes/$dir/$name.ob"; then
+            echo "FAIL $dir: $name.ob differs from the expected output"
+            failed=1
+        fi
+    done
+    if [ "$(head -c 4 "$modes/both/$name.bin")" != A4OB ]; then
+        echo "FAIL --format=both: $name.bin has no A4OB header"
+        failed=1
+    fi
+done
+name=$(basename "$(ls test/*.ob | head -n 1)" .ob)
+if ./assembler --max-memory=1 "$modes/lowmem/$name" > "$modes/lowmem/limit.log" 2>&1 ||
+   ! grep -q 'allowed by --max-memory' "$modes/lowmem/limit.log"; then
+    echo "FAIL --max-memory=1: $name did not stop at the memory ceiling"
+    failed=1
+fi
+
+# --link: two modules give the program assembled as one source
+./assembler --format=bin "$modes/link_main" "$modes/link_lib" > /dev/null 2>&1
+./assembler "$modes/link_whole" > /dev/null 2>&1
+if ! ./assembler -j 2 --link="$modes/linked" "$modes/link_main" "$modes/link_lib" > "$modes/link.log" 2>&1 ||
+   ! cmp -s "$modes/link_whole.ob" "$modes/linked.ob"; then
+    echo "FAIL --link: the linked program differs from link_whole.ob"
+    failed=1
+fi
+
+# --link: modules that fit alone but not together are not linked
+./assembler --format=bin "$modes/link_big_a" "$modes/link_big_b" > /dev/null 2>&1
+if ./assembler --link="$modes/too_large" "$modes/link_big_a" "$modes/link_big_b" > "$modes/too_large.log" 2>&1 ||
+   [ -e "$modes/too_large.ob" ] || ! grep -q 'only 156 fit after address 100' "$modes/too_large.log"; then
+    echo "FAIL --link: modules past the address space were linked"
+    failed=1
+fi
+
+# --run and --profile: the prn output and the hot spot report
+./assembler --run --profile "$modes/run_loop" > "$modes/run_loop.out" 2> "$modes/run.log"
+sed "s|$modes/||" "$modes/run_loop.prof" > "$modes/run_loop.prof.check"
+if ! cmp -s test/modes/run_loop.out "$modes/run_loop.out"; then
+    echo "FAIL --run: run_loop.out differs from the expected output"
+    failed=1
+fi
+if ! cmp -s test/modes/run_loop.prof "$modes/run_loop.prof.check"; then
+    echo "FAIL --profile: run_loop.prof differs from the expected report"
+    failed=1
+fi
+
+# --serve: a source request is answered with the .ob of the same source
+size=$(wc -c < "$modes/run_loop.as")
+{ echo "source run_loop $size"; cat "$modes/run_loop.as"; echo quit; } |
+    ./assembler --serve > "$modes/serve.reply"
+{ echo "ok 0 $(wc -c < "$modes/run_loop.ob")"; cat "$modes/run_loop.ob"; } > "$modes/serve.expected"
+if ! cmp -s "$modes/serve.expected" "$modes/serve.reply"; then
+    echo "FAIL --serve: the reply differs from run_loop.ob"
+    failed=1
+fi
+
+# --serve: a file request whose .ob can't be created fails alone, and the
+# request after it is still answered
+mkdir -p "$modes/unwritable.ob"
+cp "$modes/run_loop.as" "$modes/unwritable.as"
+{ echo "file $modes/unwritable --no-am"; echo "source run_loop $size"; cat "$modes/run_loop.as"; echo quit; } |
+    ./assembler --serve > "$modes/serve_error.reply"
+tail -c "$(wc -c < "$modes/serve.expected")" "$modes/serve_error.reply" > "$modes/serve_error.last"
+if [ "$(head -n 1 "$modes/serve_error.reply" | cut -d ' ' -f 1)" != error ] ||
+   ! cmp -s "$modes/serve.expected" "$modes/serve_error.last"; then
+    echo "FAIL --serve: an unwritable output did not fail only its own request"
+    failed=1
+fi
+
+# libassembler.a: the same object text, and the same run output
+library=""
+for name in $passing; do
+    library="$library $out/$name"
+done
+./test/libcheck $library > /dev/null 2> "$modes/libcheck.log" || {
+    echo "FAIL libassembler: the corpus does not assemble, see $modes/libcheck.log"
+    failed=1
+}
+for name in $passing; do
+    if ! cmp -s "test/$name.ob" "$out/$name.lib.ob"; then
+        echo "FAIL libassembler: $name.lib.ob differs from the expected output"
+        failed=1
+    fi
+done
+if ! ./test/libcheck -r "$modes/run_loop" > "$modes/run_loop.lib.out" 2>> "$modes/libcheck.log" ||
+   ! cmp -s test/modes/run_loop.out "$modes/run_loop.lib.out"; then
+    echo "FAIL libassembler: asm_run output differs from run_loop.out"
+    failed=1
+fi
+
+if [ $failed -ne 0 ]; then
+    echo "check: the modes differ from their expected outputs, see $modes/"
+    exit 1
+fi
+echo "check: -j, --cache, --max-memory, --format, --link, --run, --profile, --serve and libassembler.a match"
+if [ $outputs_only -eq 1 ]; then
+    exit 0
+fi
+
+# Throughput
+passing=""
+for expected in test/*.ob; do
+    passing="$passing $out/$(basename "$expected" .ob)"
+done
+rate=0
+for round in 1 2 3; do
+    ./bench/runbench -r "$repeat" $passing > "$out/runbench.txt" 2>&1 || {
+        echo "check: runbench failed, see $out/runbench.txt"
+        exit 1
+    }
+    round_rate=$(awk '/ lines, / { lines += $2 } $1 == "total" { ms += $2 }
+                      END { if (ms > 0) printf "%.0f", lines * 1000 / ms; else print 0 }' "$out/runbench.txt")
+    if [ "$round_rate" -gt "$rate" ]; then
+        rate=$round_rate
+    fi
+done
+echo "check: $rate lines/s, the best of 3 rounds of $repeat runs of each fixture"
+
+if [ $record -eq 1 ]; then
+    echo "$rate" > "$baseline"
+    echo "check: baseline recorded in $baseline"
+    exit 0
+fi
+if [ ! -e "$baseline" ]; then
+    echo "check: no $baseline on this machine, throughput not gated; record one with make check-baseline"
+    exit 0
+fi
+base=$(cat "$baseline")
+if [ "$rate" -lt $((base * (100 - threshold) / 100)) ]; then
+    echo "FAIL throughput $rate lines/s is more than $threshold% below the baseline of $base"
+    exit 1
+fi
+echo "check: throughput is within $threshold% of the baseline of $base lines/s"
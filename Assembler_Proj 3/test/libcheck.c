@@ -0,0 +1,118 @@
+/*
+ * libcheck.c - Library client used by test/check.sh
+ *
+ * This program assembles each named file (without the .as suffix)
+ * through libassembler.a and writes the object text of each source
+ * that assembles to <name>.lib.ob, or its messages to stderr if it
+ * does not. With -r, every program is also run with asm_run and what
+ * it printed goes to stdout. It returns 1 if any file fails.
+ *
+ * Usage: libcheck [-r] file...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libassembler.h"
+
+#define RUN_LIMIT 1000000
+
+/*
+ * Reads the whole of path into a buffer the caller frees. Returns NULL
+ * if the file can't be read.
+ */
+static char* read_file(const char *path, size_t *length) {
+    FILE *fp = fopen(path, "rb");
+    char *text = NULL;
+    size_t capacity = 4096;
+
+    if (fp == NULL) {
+        return NULL;
+    }
+    *length = 0;
+    text = (char*)malloc(capacity);
+    while (text != NULL) {
+        *length += fread(text + *length, 1, capacity - *length, fp);
+        if (*length < capacity) {
+            break;
+        }
+        capacity *= 2;
+        text = (char*)realloc(text, capacity);
+    }
+    fclose(fp);
+    return text;
+}
+
+/*
+ * Assembles name.as with assembler and checks it as described above.
+ * Returns 0 on success and 1 if the file fails.
+ */
+static int check_file(Assembler *assembler, const char *name, int run_it) {
+    char *path = (char*)malloc(strlen(name) + 8);
+    char *text;
+    size_t length;
+    AsmResult result;
+    AsmRun run;
+    FILE *fp;
+    int failed = 0;
+
+    if (path == NULL) {
+        fprintf(stderr, "Memory allocation error in libcheck\n");
+        exit(1);
+    }
+    sprintf(path, "%s.as", name);
+    text = read_file(path, &length);
+    if (text == NULL) {
+        fprintf(stderr, "Can't read %s\n", path);
+        free(path);
+        return 1;
+    }
+
+    if (!asm_assemble(assembler, name, text, length, &result)) {
+        fwrite(result.diagnostics, 1, result.diagnostics_length, stderr);
+        failed = 1;
+    }
+    else {
+        sprintf(path, "%s.lib.ob", name);
+        fp = fopen(path, "wb");
+        if (fp == NULL || fwrite(result.object, 1, result.object_length, fp) != result.object_length) {
+            fprintf(stderr, "Can't write %s\n", path);
+            failed = 1;
+        }
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        if (run_it) {
+            if (!asm_run(assembler, RUN_LIMIT, &run) || run.state != ASM_RUN_HALTED) {
+                fprintf(stderr, "%s.as did not run to stop\n", name);
+                failed = 1;
+            }
+            fwrite(run.output, 1, run.output_length, stdout);
+        }
+    }
+    free(text);
+    free(path);
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    Assembler *assembler = asm_create();
+    int run_it = 0;
+    int failed = 0;
+    int i = 1;
+
+    if (assembler == NULL) {
+        fprintf(stderr, "Memory allocation error in libcheck\n");
+        exit(1);
+    }
+    if (i < argc && strcmp(argv[i], "-r") == 0) {
+        run_it = 1;
+        i++;
+    }
+    for (; i < argc; i++) {
+        failed |= check_file(assembler, argv[i], run_it);
+    }
+    asm_destroy(assembler);
+    return failed;
+}
@@ -0,0 +1,3 @@
+MAIN:   prn #1
+        stop
+A:      .mat [10][10]
@@ -0,0 +1,2 @@
+SUB:    rts
+B:      .mat [10][10]
@@ -0,0 +1,8 @@
+.entry SQUARE
+.entry TABLE
+SQUARE: mov r1, r2
+        add r1, r2
+        add r1, r2
+        add r1, r2
+        rts
+TABLE:  .data 11, 12
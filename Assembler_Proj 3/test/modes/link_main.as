@@ -0,0 +1,13 @@
+.entry MAIN
+.extern SQUARE
+.extern TABLE
+MAIN:   mov #4, r1
+        jsr SQUARE
+        prn r2
+        mov TABLE, r3
+        prn r3
+        lea TABLE, r4
+        prn r4
+        prn LOCAL
+        stop
+LOCAL:  .data 7
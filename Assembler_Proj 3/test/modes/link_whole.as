@@ -0,0 +1,19 @@
+.entry MAIN
+MAIN:   mov #4, r1
+        jsr SQUARE
+        prn r2
+        mov TABLE, r3
+        prn r3
+        lea TABLE, r4
+        prn r4
+        prn LOCAL
+        stop
+LOCAL:  .data 7
+.entry SQUARE
+.entry TABLE
+SQUARE: mov r1, r2
+        add r1, r2
+        add r1, r2
+        add r1, r2
+        rts
+TABLE:  .data 11, 12
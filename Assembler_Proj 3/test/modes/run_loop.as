@@ -0,0 +1,24 @@
+MAIN:   mov #5, r1
+        clr r2
+LOOP:   add r1, r2
+        dec r1
+        cmp #0, r1
+        bne LOOP
+        prn r2
+        mov #1, r3
+        mov #2, r4
+        mov M[r3][r4], r5
+        prn r5
+        lea M, r6
+        prn r6
+        jsr SUB
+        prn SUM
+        mov #-7, SUM
+        prn SUM
+        not r0
+        prn r0
+        stop
+SUB:    mov #42, SUM
+        rts
+SUM:    .data 0
+M:      .mat [2][3] 1,2,3,4,5,6
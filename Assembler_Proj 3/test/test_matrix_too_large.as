@@ -0,0 +1,6 @@
+MAIN: mov r1,r2
+stop
+M1: .mat [2][2] 1,2,3,4
+M2: .mat [9999][9999]
+M3: .mat [12][13]
+M4: .mat [157][1]
@@ -0,0 +1,17 @@
+.entry LOOP
+.entry LENGTH
+.extern L3
+.extern W
+MAIN: mov r3,r1
+add r2,STR
+LOOP: jmp W
+prn
+sub r1, r4
+inc K
+mov M1[r3][r3],r3
+bne L3
+END: stop
+STR: .string "abcdef"
+LENGTH: .data 6,-9,15
+K: .data 22
+M1: .mat [2][2] 1,2,3,4
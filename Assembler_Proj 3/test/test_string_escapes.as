@@ -0,0 +1,6 @@
+MAIN:   prn STR
+        prn TAB
+        stop
+STR:    .string "say \"hi\"\n"
+TAB:    .string "a\tb\\c\0"
+PLAIN:  .string "plain"
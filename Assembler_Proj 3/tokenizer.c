@@ -0,0 +1,239 @@
+/*
+ * tokenizer.c - Source line tokenizer
+ * 
+ * This file splits a source line into tokens in a single left-to-right
+ * scan. It handles:
+ * - The optional "label:" definition
+ * - Recognizing the mnemonic or directive
+ * - Instruction operands: immediate (#n), direct (symbol),
+ *   matrix (symbol[rX][rY]) and register (r0-r7)
+ * - Comma and extra-character checks against the operand count
+ * 
+ * Every character of the line is looked at once; the first pass and the
+ * encoder read the resulting spans, modes and values.
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+
+#include "tokenizer.h"
+#include "helpers.h"
+#include "diag.h"
+
+/*
+ * Returns 1 if c ends a word: whitespace or the end of the line.
+ */
+static int is_blank_or_end(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\0';
+}
+
+/*
+ * Returns 1 if c ends an operand: a comma, whitespace or the end of the line.
+ */
+static int ends_operand(char c) {
+    return c == ',' || is_blank_or_end(c);
+}
+
+/*
+ * Reads a register name "r0".."r7" at position i. Returns the register
+ * number, or -1 if there is none.
+ */
+static int register_at(const char *line, int i) {
+    if (line[i] == 'r' && line[i+1] >= '0' && line[i+1] <= '7') {
+        return line[i+1] - '0';
+    }
+    return -1;
+}
+
+/*
+ * Scans the label and the mnemonic or directive of the line. Sets
+ * keyword_length to 0 for an empty or comment line. Returns the index
+ * just past the keyword.
+ */
+int scan_line_head(const char *line, LineTokens *tokens) {
+    int i = skip_spaces(line, 0);
+    int end;
+
+    tokens->label_start = i;
+    tokens->label_length = 0;
+    tokens->directive = 0;
+    tokens->instruction = NULL;
+    tokens->operand_count = 0;
+
+    /* Check for symbol definition */
+    end = is_symbol_definition(line, i);
+    if (end > 0) {
+        tokens->label_length = end - i;
+        i = skip_spaces(line, end + 1); /* Skip past the colon and any spaces */
+    }
+
+    tokens->keyword_start = i;
+    if (line[i] == ';' && tokens->label_length == 0) {
+        tokens->keyword_length = 0; /* comment */
+        return i;
+    }
+    end = i;
+    while (!is_blank_or_end(line[end])) {
+        end++;
+    }
+    tokens->keyword_length = end - i;
+    if (tokens->keyword_length > 0) {
+        tokens->directive = is_directive(line, i);
+        if (!tokens->directive) {
+            tokens->instruction = find_instruction(line, i);
+        }
+    }
+    return end;
+}
+
+/*
+ * Scans one operand starting at position i and fills in its mode, span
+ * and values. An empty operand gets mode -1 and is left for operand
+ * validation to report. Returns the index just past the operand, or -1
+ * after reporting a malformed one.
+ */
+static int scan_operand(const char *line, int i, Operand *operand, int line_num) {
+    int sign = 1;
+    int j;
+
+    operand->start = i;
+    operand->mode = -1;
+    operand->name_length = 0;
+    operand->value = 0;
+    operand->row_register = 0;
+    operand->column_register = 0;
+
+    if (ends_operand(line[i])) {
+        operand->length = 0;
+        return i;
+    }
+
+    if (line[i] == '#') { /* Immediate addressing (#number) */
+        j = i + 1;
+        if (line[j] == '+' || line[j] == '-') {
+            sign = (line[j] == '-') ? -1 : 1;
+            j++;
+        }
+        if (!isdigit((unsigned char)line[j])) {
+            report_error(line_num, "Invalid immediate value\n");
+            return -1;
+        }
+        while (isdigit((unsigned char)line[j])) {
+            /* Only the low bits are encoded, so keep them and avoid overflow */
+            operand->value = (operand->value * 10 + (line[j] - '0')) % (WORD_MASK + 1);
+            j++;
+        }
+        if (!ends_operand(line[j])) {
+            report_error(line_num, "Invalid immediate value\n");
+            return -1;
+        }
+        operand->value *= sign;
+        operand->mode = ADDR_IMMEDIATE;
+        operand->length = j - i;
+        return j;
+    }
+
+    if (register_at(line, i) >= 0 && ends_operand(line[i+2])) { /* Register addressing */
+        operand->value = register_at(line, i);
+        operand->mode = ADDR_REGISTER;
+        operand->length = 2;
+        return i + 2;
+    }
+
+    if (!isalpha((unsigned char)line[i])) {
+        report_error(line_num, "Invalid operand\n");
+        return -1;
+    }
+    j = i;
+    while (isalnum((unsigned char)line[j])) {
+        j++;
+    }
+    operand->name_length = j - i;
+
+    if (line[j] == '[') { /* Matrix addressing (symbol[rX][rY]) */
+        operand->row_register = register_at(line, j + 1);
+        if (operand->row_register < 0 || line[j+3] != ']') {
+            report_error(line_num, "Invalid matrix index\n");
+            return -1;
+        }
+        j += 4;
+        if (line[j] != '[') {
+            report_error(line_num, "Invalid matrix operand format\n");
+            return -1;
+        }
+        operand->column_register = register_at(line, j + 1);
+        if (operand->column_register < 0 || line[j+3] != ']') {
+            report_error(line_num, "Invalid matrix index\n");
+            return -1;
+        }
+        j += 4;
+        operand->mode = ADDR_MATRIX;
+    }
+    else {
+        operand->mode = ADDR_DIRECT;
+    }
+
+    if (!ends_operand(line[j])) {
+        report_error(line_num, "Invalid operand\n");
+        return -1;
+    }
+    operand->length = j - i;
+    return j;
+}
+
+/*
+ * Scans the operands that follow the mnemonic, checking the separating
+ * commas and that nothing follows the operands the instruction takes.
+ * Operands the line is missing are left at mode -1 for
+ * validate_operands to report. Returns 0 on success, or -1 after
+ * reporting a syntax error.
+ */
+int scan_operands(const char *line, LineTokens *tokens, int line_num) {
+    int expected = tokens->instruction->operands;
+    int i = skip_spaces(line, tokens->keyword_start + tokens->keyword_length);
+    int k;
+
+    for (k = 0; k < MAX_OPERANDS; k++) {
+        tokens->operands[k].mode = -1;
+        tokens->operands[k].start = i;
+        tokens->operands[k].length = 0;
+    }
+    tokens->operand_count = 0;
+
+    if (expected == 0) {
+        if (!is_blank_or_end(line[i])) {
+            report_error(line_num, "Function '%s' expects no arguments\n", tokens->instruction->name);
+            return -1;
+        }
+        return 0;
+    }
+
+    for (k = 0; k < expected; k++) {
+        i = scan_operand(line, i, &tokens->operands[k], line_num);
+        if (i < 0) {
+            return -1;
+        }
+        tokens->operand_count = k + 1;
+        i = skip_spaces(line, i);
+
+        if (k + 1 < expected) {
+            if (line[i] != ',') {
+                report_error(line_num, "Missing comma between operands\n");
+                return -1;
+            }
+            i = skip_spaces(line, i + 1);
+        }
+    }
+
+    /* Check if there are any non-space characters after the last operand */
+    if (!is_blank_or_end(line[i])) {
+        if (expected == 1) {
+            report_error(line_num, "Extra characters after operand\n");
+        }
+        else {
+            report_error(line_num, "Extra characters after second operand\n");
+        }
+        return -1;
+    }
+    return 0;
+}
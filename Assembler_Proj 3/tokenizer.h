@@ -0,0 +1,48 @@
+/*
+ * tokenizer.h - Source line tokenizer header
+ * 
+ * This header file defines the token array produced for one source line:
+ * the label, the mnemonic or directive, and the instruction operands with
+ * their addressing mode and position in the line. The first pass reads
+ * the tokens instead of re-parsing the line.
+ */
+
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include "order.h"
+
+#define MAX_OPERANDS 2          /* Most operands an instruction can take */
+
+/*
+ * Operand - One instruction operand as found in the line
+ */
+typedef struct Operand {
+    int mode;                   /* ADDR_* addressing mode, -1 if missing or invalid */
+    int start;                  /* Index of the first character in the line */
+    int length;                 /* Characters in the whole operand */
+    int name_length;            /* Characters in the symbol name (direct, matrix) */
+    int value;                  /* Immediate value (low word bits) or register number */
+    int row_register;           /* First matrix index register */
+    int column_register;        /* Second matrix index register */
+}Operand;
+
+/*
+ * LineTokens - Tokens of one source line
+ */
+typedef struct LineTokens {
+    int label_start;            /* Index of the label, if any */
+    int label_length;           /* Characters in the label, 0 if none */
+    int keyword_start;          /* Index of the mnemonic or directive */
+    int keyword_length;         /* Characters in the mnemonic or directive */
+    int directive;              /* Directive (1-5) as from is_directive, 0 if none */
+    const Instruction *instruction; /* Recognized mnemonic, NULL if none */
+    int operand_count;          /* Operands found by scan_operands */
+    Operand operands[MAX_OPERANDS]; /* Operands in source order */
+}LineTokens;
+
+/* Tokenizer functions */
+int scan_line_head(const char *line, LineTokens *tokens);              /* Finds the label and keyword */
+int scan_operands(const char *line, LineTokens *tokens, int line_num); /* Scans the instruction operands */
+
+#endif /* TOKENIZER_H */
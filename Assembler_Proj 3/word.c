@@ -1,12 +1,14 @@
 /*
- * word.c - Word data structure management
+ * word.c - Memory image management
  * 
- * This file contains functions for managing Word structures, which represent
- * individual words of data or instructions in memory. It handles:
- * - Creating new word instances
- * - Adding words to linked lists
+ * This file contains functions for managing Image structures, which hold
+ * the machine words of the code and data sections. It handles:
+ * - Creating empty images
+ * - Appending and reserving words
+ * - Growing the word array as needed
  * - Memory cleanup and destruction
- * - Address updates for data words
+ * - The table of .mat shapes used to run the image
+ * - The table of the source lines of the code words
  */
 
 #include "word.h"
@@ -14,67 +16,180 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_IMAGE_CAPACITY 256   /* Words allocated on first append */
+
+/*
+ * Makes room for at least extra more words, doubling the capacity so that
+ * appending stays amortized constant time.
+ */
+static void grow_image(Image *image, int extra) {
+    int new_capacity = image->capacity ? image->capacity : INITIAL_IMAGE_CAPACITY;
+
+    while (new_capacity < image->count + extra) {
+        new_capacity *= 2;
+    }
+    image->words = (unsigned short*)safe_realloc(image->words, sizeof(unsigned short) * new_capacity,
+                                              "Memory allocation failed in grow_image");
+    image->capacity = new_capacity;
+}
 
 /*
- * new_word - Creates a new Word structure
+ * init_image - Prepares an empty image with no words allocated
  */
-Word* new_word() {
-    Word* tmp = (Word*)safe_malloc(sizeof(Word), "Memory allocation error");
-    tmp->word = (char*)safe_malloc(11, "Memory allocation error for word field");
-    tmp->word[0] = '\0'; /* Initialize to empty string */
-    tmp->address = 0;
-    tmp->type = 0;
-    tmp->next = NULL;
-    return tmp;
+void init_image(Image *image) {
+    image->words = NULL;
+    image->count = 0;
+    image->capacity = 0;
+    image->base = 0;
 }
 
 /*
- * add_word - Adds a new word to a linked list
+ * add_image_word - Appends a word to the image and returns its index,
+ * counting the words dropped before base
  */
-Word* add_word(Word** head, Word** tail) {
-    Word* new_word = (Word*)safe_malloc(sizeof(Word), "Memory allocation failed in add_word");
-
-    /* Allocate memory for the string (11 chars + '\0') */
-    new_word->word = (char*)safe_malloc(11 * sizeof(char), "Memory allocation failed for word string");
-    new_word->word[0] = '\0'; /* Initialize empty string */
-
-    new_word->next = NULL;
-    new_word->type = 0;
-    new_word->address = 0; /* Initialize to 0 for consistency */
-
-    if (*head == NULL) {
-        *head = *tail = new_word;
-    } else {
-        (*tail)->next = new_word;
-        *tail = new_word;
+int add_image_word(Image *image, unsigned int bits) {
+    if (image->count == image->capacity) {
+        grow_image(image, 1);
     }
+    image->words[image->count] = (unsigned short)(bits & WORD_MASK);
+    return image->base + image->count++;
+}
+
+/*
+ * append_image_words - Appends a run of count words, left for the caller
+ * to fill, and returns its first word. The pointer is valid until the
+ * image grows again.
+ */
+unsigned short* append_image_words(Image *image, int count) {
+    unsigned short *run;
 
-    return new_word;
+    if (image->count + count > image->capacity) {
+        grow_image(image, count);
+    }
+    run = image->words + image->count;
+    image->count += count;
+    return run;
 }
 
 /*
- * destroy_word - Frees all memory allocated for a word list
+ * reserve_image_words - Appends count zero-filled words
  */
-void destroy_word(Word* head) {
-    if (head == NULL) {
+void reserve_image_words(Image *image, int count) {
+    if (count <= 0) {
         return;
     }
-    while (head != NULL) {
-        Word* tmp = head;
-        head = head->next;
-        free(tmp->word);
-        free(tmp);
+    memset(append_image_words(image, count), 0, sizeof(unsigned short) * count);
+}
+
+/*
+ * drop_image_words - Forgets the words in use, which the caller has
+ * written out, keeping the allocation for the words that follow
+ */
+void drop_image_words(Image *image) {
+    image->base += image->count;
+    image->count = 0;
+}
+
+/*
+ * destroy_image - Frees the word array and leaves the image empty
+ */
+void destroy_image(Image *image) {
+    free(image->words);
+    init_image(image);
+}
+
+/*
+ * init_shapes - Prepares an empty shape table with nothing allocated
+ */
+void init_shapes(ShapeTable *table) {
+    table->shapes = NULL;
+    table->count = 0;
+    table->capacity = 0;
+}
+
+/*
+ * add_shape - Records a .mat block starting at offset in the data image.
+ * Blocks are added in data order, so the table stays sorted.
+ */
+void add_shape(ShapeTable *table, int offset, int columns) {
+    int new_capacity;
+
+    if (table->count == table->capacity) {
+        new_capacity = table->capacity ? table->capacity * 2 : 16;
+        table->shapes = (MatrixShape*)safe_realloc(table->shapes, sizeof(MatrixShape) * new_capacity,
+                                                   "Memory allocation failed in add_shape");
+        table->capacity = new_capacity;
+    }
+    table->shapes[table->count].offset = offset;
+    table->shapes[table->count].columns = columns;
+    table->count++;
+}
+
+/*
+ * find_shape - Binary search for the block that starts at offset
+ */
+const MatrixShape* find_shape(const ShapeTable *table, int offset) {
+    int low = 0;
+    int high = table->count - 1;
+    int middle;
+
+    while (low <= high) {
+        middle = (low + high) / 2;
+        if (table->shapes[middle].offset == offset) {
+            return &table->shapes[middle];
+        }
+        if (table->shapes[middle].offset < offset) {
+            low = middle + 1;
+        }
+        else {
+            high = middle - 1;
+        }
     }
+    return NULL;
+}
+
+/*
+ * destroy_shapes - Frees the shapes and leaves the table empty
+ */
+void destroy_shapes(ShapeTable *table) {
+    free(table->shapes);
+    init_shapes(table);
+}
+
+/*
+ * init_lines - Prepares an empty line table with nothing allocated
+ */
+void init_lines(LineTable *table) {
+    table->lines = NULL;
+    table->count = 0;
+    table->capacity = 0;
 }
 
 /*
- * update_data - Updates addresses of data words
+ * add_lines - Records that the next count code words come from line
  */
-void update_data(Word* word_head,int IC) {
-    Word* curr_word = word_head;
-    while (curr_word != NULL) {
-        curr_word->address = curr_word->address + IC;
-        curr_word = curr_word->next;
+void add_lines(LineTable *table, int line, int count) {
+    int new_capacity = table->capacity ? table->capacity : INITIAL_IMAGE_CAPACITY;
+
+    if (table->count + count > table->capacity) {
+        while (new_capacity < table->count + count) {
+            new_capacity *= 2;
+        }
+        table->lines = (int*)safe_realloc(table->lines, sizeof(int) * new_capacity,
+                                          "Memory allocation failed in add_lines");
+        table->capacity = new_capacity;
+    }
+    while (count-- > 0) {
+        table->lines[table->count++] = line;
     }
 }
 
+/*
+ * destroy_lines - Frees the lines and leaves the table empty
+ */
+void destroy_lines(LineTable *table) {
+    free(table->lines);
+    init_lines(table);
+}
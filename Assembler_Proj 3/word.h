@@ -1,30 +1,87 @@
 /*
- * word.h - Word data structure header
+ * word.h - Machine word and memory image header
  * 
- * This header file defines the Word structure and related functions
+ * This header file defines the machine word layout and the Image structure
+ * that holds the assembled code and data words, and related functions
  */
 
 #ifndef WORD_H
 #define WORD_H
 
+/* Machine word layout */
+#define WORD_BITS 10                    /* Bits in a machine word */
+#define WORD_MASK ((1 << WORD_BITS) - 1) /* Mask of the valid word bits */
+
+/* ARE field - bits 0-1 of every operand word */
+#define ARE_ABSOLUTE    0               /* "00" - absolute value */
+#define ARE_EXTERNAL    1               /* "01" - external symbol reference */
+#define ARE_RELOCATABLE 2               /* "10" - internal (relocatable) symbol reference */
+
+#define IC_START 100                    /* Address of the first code word */
+#define ADDRESS_WORDS 256               /* Words an 8-bit address can reach */
+
 /*
- * Word - Represents a word in memory
+ * Image - Contiguous block of machine words
  * 
- * A word is the basic unit of data in the assembler's memory model.
- * Each word contains binary data, an address, a type, and a pointer
- * to the next word in a linked list.
+ * The code image and the data image each keep their words in one growable
+ * array. A word's address is implicit in its index: code words live at
+ * IC_START + index and data words follow the code, at ICF + index. When
+ * the .ob file is streamed, the words written out so far are dropped
+ * and base counts them, so words[0] is the word at index base.
+ */
+typedef struct Image {
+    unsigned short *words; /* Machine words packed in the low 10 bits */
+    int count;             /* Number of words in use */
+    int capacity;          /* Number of words allocated */
+    int base;              /* Index of words[0], words before it were dropped */
+}Image;
+
+/*
+ * MatrixShape - Where a .mat block starts in the data image and how many
+ * columns it has, so that matrix operands can be resolved when the image
+ * is run
+ */
+typedef struct MatrixShape {
+    int offset;            /* Index of the first cell in the data image */
+    int columns;           /* Cells in each row */
+}MatrixShape;
+
+/*
+ * ShapeTable - Growable array of the .mat shapes, in data image order
+ */
+typedef struct ShapeTable {
+    MatrixShape *shapes;   /* Shapes sorted by offset */
+    int count;             /* Number of shapes in use */
+    int capacity;          /* Number of shapes allocated */
+}ShapeTable;
+
+/*
+ * LineTable - Line of the expanded source that produced each code word,
+ * kept parallel to the code image so addresses can be mapped back
  */
-typedef struct Word {
-    char* word;         /* Binary representation of the word (10 bits) */
-    int address;        /* Memory address of this word */
-    int type;           /* Type: 0=data, 1=instruction */
-    struct Word* next;  /* Pointer to next word in list */
-}Word;
-
-/* Word management functions */
-Word* new_word();                           /* Creates a new word */
-Word* add_word(Word** head,Word** tail);   /* Adds word to list */
-void destroy_word(Word* head);              /* Frees word list */
-void update_data(Word* word_head,int IC);  /* Updates data addresses */
-
-#endif /* WORD_H */
\ No newline at end of file
+typedef struct LineTable {
+    int *lines;            /* .am line of each code word */
+    int count;             /* Number of words recorded */
+    int capacity;          /* Number of lines allocated */
+}LineTable;
+
+/* Image management functions */
+void init_image(Image *image);                          /* Prepares an empty image */
+int add_image_word(Image *image, unsigned int bits);    /* Appends a word, returns its index */
+unsigned short* append_image_words(Image *image, int count); /* Appends a run of words to fill */
+void reserve_image_words(Image *image, int count);      /* Appends count zero words */
+void drop_image_words(Image *image);                    /* Drops the words in use, after they were written */
+void destroy_image(Image *image);                       /* Frees the image words */
+
+/* Matrix shape functions */
+void init_shapes(ShapeTable *table);                    /* Prepares an empty table */
+void add_shape(ShapeTable *table, int offset, int columns); /* Records a .mat block */
+const MatrixShape* find_shape(const ShapeTable *table, int offset); /* Shape starting at offset, or NULL */
+void destroy_shapes(ShapeTable *table);                 /* Frees the shapes */
+
+/* Code line functions */
+void init_lines(LineTable *table);                      /* Prepares an empty table */
+void add_lines(LineTable *table, int line, int count);  /* Records count words of one line */
+void destroy_lines(LineTable *table);                   /* Frees the lines */
+
+#endif /* WORD_H */